@@ -39,6 +39,7 @@
 #include "dbus-client-track.h"
 #include "dbus-execute.h"
 #include "bus-errors.h"
+#include "bus-util.h"
 
 static int property_get_version(
                 sd_bus *bus,
@@ -704,6 +705,7 @@ static int method_list_units(sd_bus *bus, sd_bus_message *message, void *userdat
         HASHMAP_FOREACH_KEY(u, k, m->units, i) {
                 _cleanup_free_ char *unit_path = NULL, *job_path = NULL;
                 Unit *following;
+                UnitInfo info;
 
                 if (k != u->id)
                         continue;
@@ -720,18 +722,20 @@ static int method_list_units(sd_bus *bus, sd_bus_message *message, void *userdat
                                 return -ENOMEM;
                 }
 
-                r = sd_bus_message_append(
-                                reply, "(ssssssouso)",
-                                u->id,
-                                unit_description(u),
-                                unit_load_state_to_string(u->load_state),
-                                unit_active_state_to_string(unit_active_state(u)),
-                                unit_sub_state_to_string(u),
-                                following ? following->id : "",
-                                unit_path,
-                                u->job ? u->job->id : 0,
-                                u->job ? job_type_to_string(u->job->type) : "",
-                                job_path ? job_path : "/");
+                info = (UnitInfo) {
+                        .id = u->id,
+                        .description = unit_description(u),
+                        .load_state = unit_load_state_to_string(u->load_state),
+                        .active_state = unit_active_state_to_string(unit_active_state(u)),
+                        .sub_state = unit_sub_state_to_string(u),
+                        .following = following ? following->id : "",
+                        .unit_path = unit_path,
+                        .job_id = u->job ? u->job->id : 0,
+                        .job_type = u->job ? job_type_to_string(u->job->type) : "",
+                        .job_path = job_path ? job_path : "/",
+                };
+
+                r = bus_append_unit_info(reply, &info);
                 if (r < 0)
                         return r;
         }
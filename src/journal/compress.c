@@ -22,12 +22,96 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+
+#ifdef HAVE_XZ
 #include <lzma.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
 
 #include "macro.h"
+#include "util.h"
+#include "sparse-endian.h"
 #include "compress.h"
 
-bool compress_blob(const void *src, uint64_t src_size, void *dst, uint64_t *dst_size) {
+static const char* const object_compressed_table[_OBJECT_COMPRESSED_MAX] = {
+        [OBJECT_COMPRESSED_XZ] = "xz",
+        [OBJECT_COMPRESSED_LZ4] = "lz4",
+};
+
+DEFINE_STRING_TABLE_LOOKUP(object_compressed, int);
+
+bool compression_supported(int compression) {
+        switch (compression) {
+#ifdef HAVE_XZ
+        case OBJECT_COMPRESSED_XZ:
+                return true;
+#endif
+#ifdef HAVE_LZ4
+        case OBJECT_COMPRESSED_LZ4:
+                return true;
+#endif
+        default:
+                return false;
+        }
+}
+
+bool compress_blob(int compression, const void *src, uint64_t src_size, void *dst, uint64_t *dst_size) {
+        switch (compression) {
+#ifdef HAVE_XZ
+        case OBJECT_COMPRESSED_XZ:
+                return compress_blob_xz(src, src_size, dst, dst_size);
+#endif
+#ifdef HAVE_LZ4
+        case OBJECT_COMPRESSED_LZ4:
+                return compress_blob_lz4(src, src_size, dst, dst_size);
+#endif
+        default:
+                return false;
+        }
+}
+
+bool uncompress_blob(int compression,
+                     const void *src, uint64_t src_size,
+                     void **dst, uint64_t *dst_alloc_size, uint64_t* dst_size, uint64_t dst_max) {
+        switch (compression) {
+#ifdef HAVE_XZ
+        case OBJECT_COMPRESSED_XZ:
+                return uncompress_blob_xz(src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+#endif
+#ifdef HAVE_LZ4
+        case OBJECT_COMPRESSED_LZ4:
+                return uncompress_blob_lz4(src, src_size, dst, dst_alloc_size, dst_size, dst_max);
+#endif
+        default:
+                return false;
+        }
+}
+
+bool uncompress_startswith(int compression,
+                           const void *src, uint64_t src_size,
+                           void **buffer, uint64_t *buffer_size,
+                           const void *prefix, uint64_t prefix_len,
+                           uint8_t extra) {
+        switch (compression) {
+#ifdef HAVE_XZ
+        case OBJECT_COMPRESSED_XZ:
+                return uncompress_startswith_xz(src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+#endif
+#ifdef HAVE_LZ4
+        case OBJECT_COMPRESSED_LZ4:
+                return uncompress_startswith_lz4(src, src_size, buffer, buffer_size, prefix, prefix_len, extra);
+#endif
+        default:
+                return false;
+        }
+}
+
+#ifdef HAVE_XZ
+bool compress_blob_xz(const void *src, uint64_t src_size, void *dst, uint64_t *dst_size) {
         lzma_stream s = LZMA_STREAM_INIT;
         lzma_ret ret;
         bool b = false;
@@ -66,8 +150,8 @@ fail:
         return b;
 }
 
-bool uncompress_blob(const void *src, uint64_t src_size,
-                     void **dst, uint64_t *dst_alloc_size, uint64_t* dst_size, uint64_t dst_max) {
+bool uncompress_blob_xz(const void *src, uint64_t src_size,
+                        void **dst, uint64_t *dst_alloc_size, uint64_t* dst_size, uint64_t dst_max) {
 
         lzma_stream s = LZMA_STREAM_INIT;
         lzma_ret ret;
@@ -139,10 +223,10 @@ fail:
         return b;
 }
 
-bool uncompress_startswith(const void *src, uint64_t src_size,
-                           void **buffer, uint64_t *buffer_size,
-                           const void *prefix, uint64_t prefix_len,
-                           uint8_t extra) {
+bool uncompress_startswith_xz(const void *src, uint64_t src_size,
+                              void **buffer, uint64_t *buffer_size,
+                              const void *prefix, uint64_t prefix_len,
+                              uint8_t extra) {
 
         lzma_stream s = LZMA_STREAM_INIT;
         lzma_ret ret;
@@ -214,3 +298,124 @@ fail:
 
         return b;
 }
+#endif
+
+#ifdef HAVE_LZ4
+/* LZ4 blocks do not carry the size of the uncompressed data, hence
+ * we store it as 64bit little endian value in front of the block */
+
+bool compress_blob_lz4(const void *src, uint64_t src_size, void *dst, uint64_t *dst_size) {
+        int r;
+
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_size);
+
+        /* Returns false if we couldn't compress the data or the
+         * compressed result is longer than the original */
+
+        if (src_size <= 9 || src_size > INT_MAX)
+                return false;
+
+        r = LZ4_compress_default(src, (char*) dst + 8, src_size, src_size - 8 - 1);
+        if (r <= 0)
+                return false;
+
+        *(le64_t*) dst = htole64(src_size);
+        *dst_size = r + 8;
+
+        return true;
+}
+
+static bool lz4_buffer_reserve(void **p, uint64_t *allocated, uint64_t need) {
+        void *q;
+
+        if (*allocated >= need)
+                return true;
+
+        q = realloc(*p, need);
+        if (!q)
+                return false;
+
+        *p = q;
+        *allocated = need;
+        return true;
+}
+
+bool uncompress_blob_lz4(const void *src, uint64_t src_size,
+                         void **dst, uint64_t *dst_alloc_size, uint64_t* dst_size, uint64_t dst_max) {
+
+        uint64_t size, space;
+        int r;
+
+        assert(src);
+        assert(src_size > 0);
+        assert(dst);
+        assert(dst_alloc_size);
+        assert(dst_size);
+        assert(*dst_alloc_size == 0 || *dst);
+
+        if (src_size <= 8)
+                return false;
+
+        size = le64toh(*(const le64_t*) src);
+        if (size > INT_MAX || src_size - 8 > INT_MAX)
+                return false;
+
+        /* If only the beginning is of interest, don't bother
+         * uncompressing the rest */
+        space = dst_max > 0 ? MIN(size, dst_max) : size;
+
+        if (!lz4_buffer_reserve(dst, dst_alloc_size, MAX(space, 1u)))
+                return false;
+
+        if (space < size)
+                r = LZ4_decompress_safe_partial((const char*) src + 8, *dst, src_size - 8, space, space);
+        else
+                r = LZ4_decompress_safe((const char*) src + 8, *dst, src_size - 8, size);
+        if (r < 0 || (uint64_t) r < space)
+                return false;
+
+        *dst_size = r;
+        return true;
+}
+
+bool uncompress_startswith_lz4(const void *src, uint64_t src_size,
+                               void **buffer, uint64_t *buffer_size,
+                               const void *prefix, uint64_t prefix_len,
+                               uint8_t extra) {
+
+        uint64_t size;
+        int r;
+
+        /* Checks whether the uncompressed blob starts with the
+         * mentioned prefix. The byte extra needs to follow the
+         * prefix */
+
+        assert(src);
+        assert(src_size > 0);
+        assert(buffer);
+        assert(buffer_size);
+        assert(prefix);
+        assert(*buffer_size == 0 || *buffer);
+
+        if (src_size <= 8)
+                return false;
+
+        size = le64toh(*(const le64_t*) src);
+        if (size <= prefix_len || prefix_len >= INT_MAX || src_size - 8 > INT_MAX)
+                return false;
+
+        if (!lz4_buffer_reserve(buffer, buffer_size, prefix_len + 1))
+                return false;
+
+        /* Only uncompress as much as we need for the comparison */
+        r = LZ4_decompress_safe_partial((const char*) src + 8, *buffer, src_size - 8, prefix_len + 1, prefix_len + 1);
+        if (r < 0 || (uint64_t) r < prefix_len + 1)
+                return false;
+
+        return memcmp(*buffer, prefix, prefix_len) == 0 &&
+                ((const uint8_t*) *buffer)[prefix_len] == extra;
+}
+#endif
@@ -68,6 +68,20 @@
 /* How many entries to keep in the entry array chain cache at max */
 #define CHAIN_CACHE_MAX 20
 
+/* When writing, every entry appends to the chains of all its data
+ * objects, hence remember the ends of many more chains */
+#define CHAIN_CACHE_WRITABLE_MAX 1024
+
+/* How many recently appended data objects to remember the offsets of */
+#define DATA_CACHE_MAX 1024
+
+/* How many data objects copied to another file to remember the new
+ * offsets of */
+#define COPY_CACHE_MAX (64*1024)
+
+/* How many entries to append in batch mode before we notify readers anyway */
+#define BATCH_ENTRIES_MAX 256
+
 /* How much to increase the journal file size at once each time we allocate something new. */
 #define FILE_SIZE_INCREASE (8ULL*1024ULL*1024ULL)              /* 8MB */
 
@@ -124,13 +138,19 @@ void journal_file_close(JournalFile *f) {
                 journal_file_append_tag(f);
 #endif
 
+        /* Make sure readers learn about entries of an unfinished batch */
+        if (f->n_batched > 0 && f->fd >= 0)
+                journal_file_post_change(f);
+
         /* Sync everything to disk, before we mark the file offline */
         if (f->mmap && f->fd >= 0)
                 mmap_cache_close_fd(f->mmap, f->fd);
 
         journal_file_set_offline(f);
 
-        if (f->header)
+        if (f->lazy)
+                free(f->header);
+        else if (f->header)
                 munmap(f->header, PAGE_ALIGN(sizeof(Header)));
 
         if (f->fd >= 0)
@@ -142,10 +162,10 @@ void journal_file_close(JournalFile *f) {
                 mmap_cache_unref(f->mmap);
 
         hashmap_free_free(f->chain_cache);
+        hashmap_free_free(f->data_cache);
+        hashmap_free_free(f->copy_cache);
 
-#ifdef HAVE_XZ
         free(f->compress_buffer);
-#endif
 
 #ifdef HAVE_GCRYPT
         if (f->fss_file)
@@ -174,7 +194,8 @@ static int journal_file_init_header(JournalFile *f, JournalFile *template) {
         h.header_size = htole64(ALIGN64(sizeof(h)));
 
         h.incompatible_flags =
-                htole32(f->compress ? HEADER_INCOMPATIBLE_COMPRESSED : 0);
+                htole32(f->compress == OBJECT_COMPRESSED_XZ ? HEADER_INCOMPATIBLE_COMPRESSED_XZ :
+                        f->compress == OBJECT_COMPRESSED_LZ4 ? HEADER_INCOMPATIBLE_COMPRESSED_LZ4 : 0);
 
         h.compatible_flags =
                 htole32(f->seal ? HEADER_COMPATIBLE_SEALED : 0);
@@ -234,13 +255,8 @@ static int journal_file_verify_header(JournalFile *f) {
 
         /* In both read and write mode we refuse to open files with
          * incompatible flags we don't know */
-#ifdef HAVE_XZ
-        if ((le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_COMPRESSED) != 0)
+        if ((le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_SUPPORTED) != 0)
                 return -EPROTONOSUPPORT;
-#else
-        if (f->header->incompatible_flags != 0)
-                return -EPROTONOSUPPORT;
-#endif
 
         /* When open for writing we refuse to open files with
          * compatible flags, too */
@@ -307,7 +323,12 @@ static int journal_file_verify_header(JournalFile *f) {
                 }
         }
 
-        f->compress = JOURNAL_HEADER_COMPRESSED(f->header);
+        if (JOURNAL_HEADER_COMPRESSED_XZ(f->header))
+                f->compress = OBJECT_COMPRESSED_XZ;
+        else if (JOURNAL_HEADER_COMPRESSED_LZ4(f->header))
+                f->compress = OBJECT_COMPRESSED_LZ4;
+        else
+                f->compress = 0;
 
         f->seal = JOURNAL_HEADER_SEALED(f->header);
 
@@ -383,6 +404,14 @@ static int journal_file_move_to(JournalFile *f, int context, bool keep_always, u
         if (size <= 0)
                 return -EINVAL;
 
+        if (f->lazy) {
+                int r;
+
+                r = journal_file_load(f);
+                if (r < 0)
+                        return r;
+        }
+
         /* Avoid SIGBUS on invalid accesses */
         if (offset + size > (uint64_t) f->last_stat.st_size) {
                 /* Hmm, out of range? Let's refresh the fstat() data
@@ -538,7 +567,22 @@ int journal_file_append_object(JournalFile *f, int type, uint64_t size, Object *
         return 0;
 }
 
-static int journal_file_setup_data_hash_table(JournalFile *f) {
+/* Size a hash table so that the number of objects the file we are
+ * replacing ended up with fills it only halfway. */
+static uint64_t hash_table_size_for(JournalFile *f, uint64_t s, uint64_t n) {
+        uint64_t m;
+
+        assert(f);
+
+        m = f->metrics.max_size / 4 / sizeof(HashItem) * sizeof(HashItem);
+
+        if (n > m / sizeof(HashItem) / 2)
+                n = m / sizeof(HashItem) / 2;
+
+        return MAX(s, n * 2 * sizeof(HashItem));
+}
+
+static int journal_file_setup_data_hash_table(JournalFile *f, JournalFile *template) {
         uint64_t s, p;
         Object *o;
         int r;
@@ -554,6 +598,14 @@ static int journal_file_setup_data_hash_table(JournalFile *f) {
         if (s < DEFAULT_DATA_HASH_TABLE_SIZE)
                 s = DEFAULT_DATA_HASH_TABLE_SIZE;
 
+        /* The estimate might be too low for the data we get, hence
+           size the table after what the file we are replacing
+           needed, so that we do not end up rotating on the fill
+           level again and again. */
+
+        if (template && JOURNAL_HEADER_CONTAINS(template->header, n_data))
+                s = hash_table_size_for(f, s, le64toh(template->header->n_data));
+
         log_debug("Reserving %"PRIu64" entries in hash table.", s / sizeof(HashItem));
 
         r = journal_file_append_object(f,
@@ -571,7 +623,7 @@ static int journal_file_setup_data_hash_table(JournalFile *f) {
         return 0;
 }
 
-static int journal_file_setup_field_hash_table(JournalFile *f) {
+static int journal_file_setup_field_hash_table(JournalFile *f, JournalFile *template) {
         uint64_t s, p;
         Object *o;
         int r;
@@ -579,9 +631,13 @@ static int journal_file_setup_field_hash_table(JournalFile *f) {
         assert(f);
 
         /* We use a fixed size hash table for the fields as this
-         * number should grow very slowly only */
+         * number should grow very slowly only, unless the file we are
+         * replacing needed more */
 
         s = DEFAULT_FIELD_HASH_TABLE_SIZE;
+        if (template && JOURNAL_HEADER_CONTAINS(template->header, n_fields))
+                s = hash_table_size_for(f, s, le64toh(template->header->n_fields));
+
         r = journal_file_append_object(f,
                                        OBJECT_FIELD_HASH_TABLE,
                                        offsetof(Object, hash_table.items) + s,
@@ -732,7 +788,7 @@ int journal_file_find_field_object_with_hash(
                 const void *field, uint64_t size, uint64_t hash,
                 Object **ret, uint64_t *offset) {
 
-        uint64_t p, osize, h;
+        uint64_t p, osize, h, depth = 0;
         int r;
 
         assert(f);
@@ -740,6 +796,10 @@ int journal_file_find_field_object_with_hash(
 
         osize = offsetof(Object, field.payload) + size;
 
+        r = journal_file_load(f);
+        if (r < 0)
+                return r;
+
         if (f->header->field_hash_table_size == 0)
                 return -EBADMSG;
 
@@ -753,6 +813,8 @@ int journal_file_find_field_object_with_hash(
                 if (r < 0)
                         return r;
 
+                depth++;
+
                 if (le64toh(o->field.hash) == hash &&
                     le64toh(o->object.size) == osize &&
                     memcmp(o->field.payload, field, size) == 0) {
@@ -768,6 +830,13 @@ int journal_file_find_field_object_with_hash(
                 p = le64toh(o->field.next_hash_offset);
         }
 
+        /* A miss walks the whole chain, so remember the longest
+         * one, in order to rotate before lookups get too slow */
+        if (f->writable &&
+            JOURNAL_HEADER_CONTAINS(f->header, field_hash_chain_depth) &&
+            depth > le64toh(f->header->field_hash_chain_depth))
+                f->header->field_hash_chain_depth = htole64(depth);
+
         return 0;
 }
 
@@ -793,7 +862,7 @@ int journal_file_find_data_object_with_hash(
                 const void *data, uint64_t size, uint64_t hash,
                 Object **ret, uint64_t *offset) {
 
-        uint64_t p, osize, h;
+        uint64_t p, osize, h, depth = 0;
         int r;
 
         assert(f);
@@ -801,6 +870,10 @@ int journal_file_find_data_object_with_hash(
 
         osize = offsetof(Object, data.payload) + size;
 
+        r = journal_file_load(f);
+        if (r < 0)
+                return r;
+
         if (f->header->data_hash_table_size == 0)
                 return -EBADMSG;
 
@@ -814,20 +887,25 @@ int journal_file_find_data_object_with_hash(
                 if (r < 0)
                         return r;
 
+                depth++;
+
                 if (le64toh(o->data.hash) != hash)
                         goto next;
 
-                if (o->object.flags & OBJECT_COMPRESSED) {
-#ifdef HAVE_XZ
+                if (o->object.flags & OBJECT_COMPRESSION_MASK) {
+                        int compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                         uint64_t l, rsize;
 
+                        if (!compression_supported(compression))
+                                return -EPROTONOSUPPORT;
+
                         l = le64toh(o->object.size);
                         if (l <= offsetof(Object, data.payload))
                                 return -EBADMSG;
 
                         l -= offsetof(Object, data.payload);
 
-                        if (!uncompress_blob(o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0))
+                        if (!uncompress_blob(compression, o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, 0))
                                 return -EBADMSG;
 
                         if (rsize == size &&
@@ -841,9 +919,6 @@ int journal_file_find_data_object_with_hash(
 
                                 return 1;
                         }
-#else
-                        return -EPROTONOSUPPORT;
-#endif
 
                 } else if (le64toh(o->object.size) == osize &&
                            memcmp(o->data.payload, data, size) == 0) {
@@ -861,6 +936,13 @@ int journal_file_find_data_object_with_hash(
                 p = le64toh(o->data.next_hash_offset);
         }
 
+        /* A miss walks the whole chain, so remember the longest
+         * one, in order to rotate before lookups get too slow */
+        if (f->writable &&
+            JOURNAL_HEADER_CONTAINS(f->header, data_hash_chain_depth) &&
+            depth > le64toh(f->header->data_hash_chain_depth))
+                f->header->data_hash_chain_depth = htole64(depth);
+
         return 0;
 }
 
@@ -943,9 +1025,81 @@ static int journal_file_append_field(
         return 0;
 }
 
+typedef struct DataCacheItem {
+        uint64_t hash;
+        uint64_t offset;
+} DataCacheItem;
+
+static int data_cache_find(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset) {
+        DataCacheItem *di;
+        Object *o;
+        int r;
+
+        assert(f);
+
+        di = hashmap_get(f->data_cache, &hash);
+        if (!di)
+                return 0;
+
+        r = journal_file_move_to_object(f, OBJECT_DATA, di->offset, &o);
+        if (r < 0)
+                return r;
+
+        /* Only uncompressed objects are cached, and a hash collision
+         * is possible, hence compare the payload */
+        if (le64toh(o->object.size) != offsetof(Object, data.payload) + size ||
+            memcmp(o->data.payload, data, size) != 0)
+                return 0;
+
+        /* Move the item to the end, so that the least recently used
+         * items are the first to be evicted */
+        hashmap_remove(f->data_cache, &hash);
+        if (hashmap_put(f->data_cache, &di->hash, di) < 0)
+                free(di);
+
+        *ret = o;
+        *offset = di->offset;
+        return 1;
+}
+
+static void data_cache_put(JournalFile *f, uint64_t hash, uint64_t offset) {
+        DataCacheItem *di;
+
+        assert(f);
+
+        if (!f->data_cache) {
+                f->data_cache = hashmap_new(uint64_hash_func, uint64_compare_func);
+                if (!f->data_cache)
+                        return;
+        }
+
+        di = hashmap_get(f->data_cache, &hash);
+        if (di) {
+                /* A different object with the same hash, simply
+                 * replace it */
+                di->offset = offset;
+                return;
+        }
+
+        if (hashmap_size(f->data_cache) >= DATA_CACHE_MAX)
+                di = hashmap_steal_first(f->data_cache);
+        else {
+                di = new(DataCacheItem, 1);
+                if (!di)
+                        return;
+        }
+
+        di->hash = hash;
+        di->offset = offset;
+
+        if (hashmap_put(f->data_cache, &di->hash, di) < 0)
+                free(di);
+}
+
 static int journal_file_append_data(
                 JournalFile *f,
                 const void *data, uint64_t size,
+                const JournalCompressedData *c,
                 Object **ret, uint64_t *offset) {
 
         uint64_t hash, p;
@@ -960,10 +1114,20 @@ static int journal_file_append_data(
 
         hash = hash64(data, size);
 
-        r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
+        /* Most fields of an entry repeat those of recent entries,
+         * hence try to avoid walking the hash table chain */
+        r = data_cache_find(f, data, size, hash, &o, &p);
         if (r < 0)
                 return r;
-        else if (r > 0) {
+        if (r == 0) {
+                r = journal_file_find_data_object_with_hash(f, data, size, hash, &o, &p);
+                if (r < 0)
+                        return r;
+                if (r > 0 && !(o->object.flags & OBJECT_COMPRESSION_MASK))
+                        data_cache_put(f, hash, p);
+        }
+
+        if (r > 0) {
 
                 if (ret)
                         *ret = o;
@@ -974,28 +1138,45 @@ static int journal_file_append_data(
                 return 0;
         }
 
-        osize = offsetof(Object, data.payload) + size;
+        /* Only make use of data compressed by the caller if it
+         * used the same algorithm as the file */
+        if (c && (!f->compress || c->compression != f->compress))
+                c = NULL;
+
+        if (c && c->data)
+                osize = offsetof(Object, data.payload) + c->size;
+        else
+                osize = offsetof(Object, data.payload) + size;
+
         r = journal_file_append_object(f, OBJECT_DATA, osize, &o, &p);
         if (r < 0)
                 return r;
 
         o->data.hash = htole64(hash);
 
-#ifdef HAVE_XZ
-        if (f->compress &&
-            size >= COMPRESSION_SIZE_THRESHOLD) {
+        if (c) {
+                /* If the caller already tried to compress the data
+                 * but it didn't shrink, don't bother again */
+                if (c->data) {
+                        memcpy(o->data.payload, c->data, c->size);
+                        o->object.flags |= c->compression;
+                        compressed = true;
+                }
+
+        } else if (f->compress &&
+                   size >= COMPRESSION_SIZE_THRESHOLD) {
                 uint64_t rsize;
 
-                compressed = compress_blob(data, size, o->data.payload, &rsize);
+                compressed = compress_blob(f->compress, data, size, o->data.payload, &rsize);
 
                 if (compressed) {
                         o->object.size = htole64(offsetof(Object, data.payload) + rsize);
-                        o->object.flags |= OBJECT_COMPRESSED;
+                        o->object.flags |= f->compress;
 
-                        log_debug("Compressed data object %"PRIu64" -> %"PRIu64, size, rsize);
+                        log_debug("Compressed data object %"PRIu64" -> %"PRIu64" using %s",
+                                  size, rsize, object_compressed_to_string(f->compress));
                 }
         }
-#endif
 
         if (!compressed && size > 0)
                 memcpy(o->data.payload, data, size);
@@ -1004,6 +1185,9 @@ static int journal_file_append_data(
         if (r < 0)
                 return r;
 
+        if (!compressed)
+                data_cache_put(f, hash, p);
+
         /* The linking might have altered the window, so let's
          * refresh our pointer */
         r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
@@ -1068,13 +1252,60 @@ uint64_t journal_file_hash_table_n_items(Object *o) {
         return (le64toh(o->object.size) - offsetof(Object, hash_table.items)) / sizeof(HashItem);
 }
 
+typedef struct ChainCacheItem {
+        uint64_t first; /* the array at the begin of the chain */
+        uint64_t array; /* the cached array */
+        uint64_t begin; /* the first item in the cached array */
+        uint64_t total; /* the total number of items in all arrays before this one in the chain */
+        uint64_t last_index; /* the last index we looked at, to optimize locality when bisecting */
+} ChainCacheItem;
+
+static void chain_cache_put(
+                JournalFile *f,
+                ChainCacheItem *ci,
+                uint64_t first,
+                uint64_t array,
+                uint64_t begin,
+                uint64_t total,
+                uint64_t last_index) {
+
+        if (!ci) {
+                /* If the chain item to cache for this chain is the
+                 * first one it's not worth caching anything */
+                if (array == first)
+                        return;
+
+                if (hashmap_size(f->chain_cache) >= (f->writable ? CHAIN_CACHE_WRITABLE_MAX : CHAIN_CACHE_MAX))
+                        ci = hashmap_steal_first(f->chain_cache);
+                else {
+                        ci = new(ChainCacheItem, 1);
+                        if (!ci)
+                                return;
+                }
+
+                ci->first = first;
+
+                if (hashmap_put(f->chain_cache, &ci->first, ci) < 0) {
+                        free(ci);
+                        return;
+                }
+        } else
+                assert(ci->first == first);
+
+        ci->array = array;
+        ci->begin = begin;
+        ci->total = total;
+        ci->last_index = last_index;
+}
+
 static int link_entry_into_array(JournalFile *f,
                                  le64_t *first,
                                  le64_t *idx,
                                  uint64_t p) {
         int r;
-        uint64_t n = 0, ap = 0, q, i, a, hidx;
+        uint64_t n = 0, ap = 0, q, i, a, hidx, t = 0;
         Object *o;
+        ChainCacheItem *ci;
 
         assert(f);
         assert(first);
@@ -1083,6 +1314,17 @@ static int link_entry_into_array(JournalFile *f,
 
         a = le64toh(*first);
         i = hidx = le64toh(*idx);
+
+        /* Entries are always appended at the end of the chain,
+         * hence start from the last array we looked at, if we
+         * know it, instead of walking the whole chain again. */
+        ci = hashmap_get(f->chain_cache, &a);
+        if (ci && hidx >= ci->total) {
+                a = ci->array;
+                i -= ci->total;
+                t = ci->total;
+        }
+
         while (a > 0) {
 
                 r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
@@ -1093,10 +1335,13 @@ static int link_entry_into_array(JournalFile *f,
                 if (i < n) {
                         o->entry_array.items[i] = htole64(p);
                         *idx = htole64(hidx + 1);
+
+                        chain_cache_put(f, ci, le64toh(*first), a, le64toh(o->entry_array.items[0]), t, i);
                         return 0;
                 }
 
                 i -= n;
+                t += n;
                 ap = a;
                 a = le64toh(o->entry_array.next_entry_array_offset);
         }
@@ -1138,6 +1383,9 @@ static int link_entry_into_array(JournalFile *f,
 
         *idx = htole64(hidx + 1);
 
+        if (i == 0)
+                chain_cache_put(f, ci, le64toh(*first), q, p, t, 0);
+
         return 0;
 }
 
@@ -1294,6 +1542,28 @@ void journal_file_post_change(JournalFile *f) {
 
         if (ftruncate(f->fd, f->last_stat.st_size) < 0)
                 log_error("Failed to truncate file to its own size: %m");
+
+        f->n_batched = 0;
+}
+
+void journal_file_begin_batch(JournalFile *f) {
+        assert(f);
+
+        /* While in batch mode we don't notify readers after each
+         * appended entry, but only once when the batch is finished
+         * (or has grown too large), so that a burst of messages
+         * costs a single ftruncate() instead of one per entry. */
+
+        f->batching = true;
+}
+
+void journal_file_end_batch(JournalFile *f) {
+        assert(f);
+
+        f->batching = false;
+
+        if (f->n_batched > 0)
+                journal_file_post_change(f);
 }
 
 static int entry_item_cmp(const void *_a, const void *_b) {
@@ -1306,7 +1576,14 @@ static int entry_item_cmp(const void *_a, const void *_b) {
         return 0;
 }
 
-int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+int journal_file_append_entry_full(
+                JournalFile *f,
+                const dual_timestamp *ts,
+                const struct iovec iovec[], unsigned n_iovec,
+                const JournalCompressedData compressed[],
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
         unsigned i;
         EntryItem *items;
         int r;
@@ -1338,7 +1615,7 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
                 uint64_t p;
                 Object *o;
 
-                r = journal_file_append_data(f, iovec[i].iov_base, iovec[i].iov_len, &o, &p);
+                r = journal_file_append_data(f, iovec[i].iov_base, iovec[i].iov_len, compressed ? compressed + i : NULL, &o, &p);
                 if (r < 0)
                         return r;
 
@@ -1353,55 +1630,16 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
 
         r = journal_file_append_entry_internal(f, ts, xor_hash, items, n_iovec, seqnum, ret, offset);
 
-        journal_file_post_change(f);
+        if (f->batching && f->n_batched < BATCH_ENTRIES_MAX)
+                f->n_batched++;
+        else
+                journal_file_post_change(f);
 
         return r;
 }
 
-typedef struct ChainCacheItem {
-        uint64_t first; /* the array at the begin of the chain */
-        uint64_t array; /* the cached array */
-        uint64_t begin; /* the first item in the cached array */
-        uint64_t total; /* the total number of items in all arrays before this one in the chain */
-        uint64_t last_index; /* the last index we looked at, to optimize locality when bisecting */
-} ChainCacheItem;
-
-static void chain_cache_put(
-                Hashmap *h,
-                ChainCacheItem *ci,
-                uint64_t first,
-                uint64_t array,
-                uint64_t begin,
-                uint64_t total,
-                uint64_t last_index) {
-
-        if (!ci) {
-                /* If the chain item to cache for this chain is the
-                 * first one it's not worth caching anything */
-                if (array == first)
-                        return;
-
-                if (hashmap_size(h) >= CHAIN_CACHE_MAX)
-                        ci = hashmap_steal_first(h);
-                else {
-                        ci = new(ChainCacheItem, 1);
-                        if (!ci)
-                                return;
-                }
-
-                ci->first = first;
-
-                if (hashmap_put(h, &ci->first, ci) < 0) {
-                        free(ci);
-                        return;
-                }
-        } else
-                assert(ci->first == first);
-
-        ci->array = array;
-        ci->begin = begin;
-        ci->total = total;
-        ci->last_index = last_index;
+int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+        return journal_file_append_entry_full(f, ts, iovec, n_iovec, NULL, seqnum, ret, offset);
 }
 
 static int generic_array_get(
@@ -1449,7 +1687,7 @@ static int generic_array_get(
 
 found:
         /* Let's cache this item for the next invocation */
-        chain_cache_put(f->chain_cache, ci, first, a, o->entry_array.items[0], t, i);
+        chain_cache_put(f, ci, first, a, o->entry_array.items[0], t, i);
 
         r = journal_file_move_to_object(f, OBJECT_ENTRY, p, &o);
         if (r < 0)
@@ -1684,7 +1922,7 @@ found:
                 return 0;
 
         /* Let's cache this item for the next invocation */
-        chain_cache_put(f->chain_cache, ci, first, a, array->entry_array.items[0], t, subtract_one ? (i > 0 ? i-1 : (uint64_t) -1) : i);
+        chain_cache_put(f, ci, first, a, array->entry_array.items[0], t, subtract_one ? (i > 0 ? i-1 : (uint64_t) -1) : i);
 
         if (subtract_one && i == 0)
                 p = last_p;
@@ -2327,8 +2565,9 @@ void journal_file_dump(JournalFile *f) {
                         break;
                 }
 
-                if (o->object.flags & OBJECT_COMPRESSED)
-                        printf("Flags: COMPRESSED\n");
+                if (o->object.flags & OBJECT_COMPRESSION_MASK)
+                        printf("Flags: COMPRESSED-%s\n",
+                               object_compressed_to_string(o->object.flags & OBJECT_COMPRESSION_MASK) ?: "???");
 
                 if (p == le64toh(f->header->tail_object_offset))
                         p = 0;
@@ -2365,7 +2604,7 @@ void journal_file_print_header(JournalFile *f) {
                "Sequential Number ID: %s\n"
                "State: %s\n"
                "Compatible Flags:%s%s\n"
-               "Incompatible Flags:%s%s\n"
+               "Incompatible Flags:%s%s%s\n"
                "Header size: %"PRIu64"\n"
                "Arena size: %"PRIu64"\n"
                "Data Hash Table Size: %"PRIu64"\n"
@@ -2388,8 +2627,9 @@ void journal_file_print_header(JournalFile *f) {
                f->header->state == STATE_ARCHIVED ? "ARCHIVED" : "UNKNOWN",
                JOURNAL_HEADER_SEALED(f->header) ? " SEALED" : "",
                (le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_SEALED) ? " ???" : "",
-               JOURNAL_HEADER_COMPRESSED(f->header) ? " COMPRESSED" : "",
-               (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_COMPRESSED) ? " ???" : "",
+               JOURNAL_HEADER_COMPRESSED_XZ(f->header) ? " COMPRESSED-XZ" : "",
+               JOURNAL_HEADER_COMPRESSED_LZ4(f->header) ? " COMPRESSED-LZ4" : "",
+               (le32toh(f->header->incompatible_flags) & ~HEADER_INCOMPATIBLE_ANY) ? " ???" : "",
                le64toh(f->header->header_size),
                le64toh(f->header->arena_size),
                le64toh(f->header->data_hash_table_size) / sizeof(HashItem),
@@ -2421,16 +2661,26 @@ void journal_file_print_header(JournalFile *f) {
         if (JOURNAL_HEADER_CONTAINS(f->header, n_entry_arrays))
                 printf("Entry Array Objects: %"PRIu64"\n",
                        le64toh(f->header->n_entry_arrays));
+        if (JOURNAL_HEADER_CONTAINS(f->header, data_hash_chain_depth))
+                printf("Deepest Data Hash Chain: %"PRIu64"\n",
+                       le64toh(f->header->data_hash_chain_depth));
+        if (JOURNAL_HEADER_CONTAINS(f->header, field_hash_chain_depth))
+                printf("Deepest Field Hash Chain: %"PRIu64"\n",
+                       le64toh(f->header->field_hash_chain_depth));
 
-        if (fstat(f->fd, &st) >= 0)
-                printf("Disk usage: %s\n", format_bytes(bytes, sizeof(bytes), (off_t) st.st_blocks * 512ULL));
+        if (f->lazy)
+                st = f->last_stat;
+        else if (fstat(f->fd, &st) < 0)
+                return;
+
+        printf("Disk usage: %s\n", format_bytes(bytes, sizeof(bytes), (off_t) st.st_blocks * 512ULL));
 }
 
 int journal_file_open(
                 const char *fname,
                 int flags,
                 mode_t mode,
-                bool compress,
+                int compress,
                 bool seal,
                 JournalMetrics *metrics,
                 MMapCache *mmap_cache,
@@ -2462,9 +2712,11 @@ int journal_file_open(
         f->flags = flags;
         f->prot = prot_from_flags(flags);
         f->writable = (flags & O_ACCMODE) != O_RDONLY;
-#ifdef HAVE_XZ
+        /* Fall back to what we have if the requested algorithm is
+         * not available */
+        if (compress && !compression_supported(compress))
+                compress = DEFAULT_COMPRESSION;
         f->compress = compress;
-#endif
 #ifdef HAVE_GCRYPT
         f->seal = seal;
 #endif
@@ -2472,7 +2724,7 @@ int journal_file_open(
         if (mmap_cache)
                 f->mmap = mmap_cache_ref(mmap_cache);
         else {
-                f->mmap = mmap_cache_new();
+                f->mmap = mmap_cache_new(NULL);
                 if (!f->mmap) {
                         r = -ENOMEM;
                         goto fail;
@@ -2587,11 +2839,11 @@ int journal_file_open(
 #endif
 
         if (newly_created) {
-                r = journal_file_setup_field_hash_table(f);
+                r = journal_file_setup_field_hash_table(f, template);
                 if (r < 0)
                         goto fail;
 
-                r = journal_file_setup_data_hash_table(f);
+                r = journal_file_setup_data_hash_table(f, template);
                 if (r < 0)
                         goto fail;
 
@@ -2619,7 +2871,7 @@ fail:
         return r;
 }
 
-int journal_file_rotate(JournalFile **f, bool compress, bool seal) {
+int journal_file_rotate(JournalFile **f, int compress, bool seal) {
         _cleanup_free_ char *p = NULL;
         size_t l;
         JournalFile *old_file, *new_file = NULL;
@@ -2658,11 +2910,184 @@ int journal_file_rotate(JournalFile **f, bool compress, bool seal) {
         return r;
 }
 
+int journal_file_open_lazy(
+                const char *fname,
+                MMapCache *mmap_cache,
+                JournalFile **ret) {
+
+        _cleanup_close_ int fd = -1;
+        JournalFile *f;
+        ssize_t n;
+        int r;
+
+        assert(fname);
+        assert(ret);
+
+        /* Opens a file for reading, but only reads its header for
+         * now. The rest is mapped by journal_file_load(), once
+         * somebody actually looks at the objects of the file. This
+         * is only safe for archived files, which do not change
+         * anymore, hence all others are opened right away. */
+
+        if (!endswith(fname, ".journal") &&
+            !endswith(fname, ".journal~"))
+                return -EINVAL;
+
+        fd = open(fname, O_RDONLY|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        f = new0(JournalFile, 1);
+        if (!f)
+                return -ENOMEM;
+
+        f->fd = -1;
+        f->flags = O_RDONLY;
+        f->prot = prot_from_flags(O_RDONLY);
+        f->lazy = true;
+
+        if (mmap_cache)
+                f->mmap = mmap_cache_ref(mmap_cache);
+        else {
+                f->mmap = mmap_cache_new(NULL);
+                if (!f->mmap) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+        }
+
+        f->path = strdup(fname);
+        f->chain_cache = hashmap_new(uint64_hash_func, uint64_compare_func);
+        f->header = new0(Header, 1);
+        if (!f->path || !f->chain_cache || !f->header) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        if (fstat(fd, &f->last_stat) < 0) {
+                r = -errno;
+                goto fail;
+        }
+
+        if (f->last_stat.st_size < (off_t) HEADER_SIZE_MIN) {
+                r = -EIO;
+                goto fail;
+        }
+
+        n = pread(fd, f->header, sizeof(Header), 0);
+        if (n < 0) {
+                r = -errno;
+                goto fail;
+        }
+        if (n < (ssize_t) HEADER_SIZE_MIN) {
+                r = -EIO;
+                goto fail;
+        }
+
+        r = journal_file_verify_header(f);
+        if (r < 0)
+                goto fail;
+
+        if (f->header->state != STATE_ARCHIVED) {
+                journal_file_close(f);
+                return journal_file_open(fname, O_RDONLY, 0, false, false, NULL, mmap_cache, NULL, ret);
+        }
+
+        *ret = f;
+        return 0;
+
+fail:
+        journal_file_close(f);
+
+        return r;
+}
+
+int journal_file_load(JournalFile *f) {
+        Header *copy;
+        struct stat st;
+        void *h;
+        int fd, r;
+
+        assert(f);
+
+        if (!f->lazy)
+                return 0;
+
+        fd = open(f->path, f->flags|O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        if (fstat(fd, &st) < 0) {
+                r = -errno;
+                close_nointr_nofail(fd);
+                return r;
+        }
+
+        h = mmap(NULL, PAGE_ALIGN(sizeof(Header)), f->prot, MAP_SHARED, fd, 0);
+        if (h == MAP_FAILED) {
+                r = -errno;
+                close_nointr_nofail(fd);
+                return r;
+        }
+
+        /* Make sure the file wasn't replaced since we read the
+         * header */
+        if (st.st_size != f->last_stat.st_size ||
+            !sd_id128_equal(((Header*) h)->file_id, f->header->file_id)) {
+                munmap(h, PAGE_ALIGN(sizeof(Header)));
+                close_nointr_nofail(fd);
+                return -ESTALE;
+        }
+
+        copy = f->header;
+        f->header = h;
+        f->fd = fd;
+        f->last_stat = st;
+        f->lazy = false;
+
+#ifdef HAVE_GCRYPT
+        r = journal_file_hmac_setup(f);
+        if (r < 0)
+                goto fail;
+#endif
+
+        r = journal_file_map_field_hash_table(f);
+        if (r < 0)
+                goto fail;
+
+        r = journal_file_map_data_hash_table(f);
+        if (r < 0)
+                goto fail;
+
+        free(copy);
+        return 0;
+
+fail:
+#ifdef HAVE_GCRYPT
+        if (f->hmac) {
+                gcry_md_close(f->hmac);
+                f->hmac = NULL;
+        }
+#endif
+
+        mmap_cache_close_fd(f->mmap, f->fd);
+        munmap(f->header, PAGE_ALIGN(sizeof(Header)));
+        close_nointr_nofail(f->fd);
+
+        f->header = copy;
+        f->fd = -1;
+        f->field_hash_table = NULL;
+        f->data_hash_table = NULL;
+        f->lazy = true;
+
+        return r;
+}
+
 int journal_file_open_reliably(
                 const char *fname,
                 int flags,
                 mode_t mode,
-                bool compress,
+                int compress,
                 bool seal,
                 JournalMetrics *metrics,
                 MMapCache *mmap_cache,
@@ -2711,6 +3136,39 @@ int journal_file_open_reliably(
                                  metrics, mmap_cache, template, ret);
 }
 
+typedef struct CopyCacheItem {
+        uint64_t from_offset;
+        uint64_t to_offset;
+        le64_t hash;
+} CopyCacheItem;
+
+static void copy_cache_put(JournalFile *from, uint64_t from_offset, uint64_t to_offset, le64_t hash) {
+        CopyCacheItem *ci;
+
+        assert(from);
+
+        if (!from->copy_cache) {
+                from->copy_cache = hashmap_new(uint64_hash_func, uint64_compare_func);
+                if (!from->copy_cache)
+                        return;
+        }
+
+        if (hashmap_size(from->copy_cache) >= COPY_CACHE_MAX)
+                ci = hashmap_steal_first(from->copy_cache);
+        else {
+                ci = new(CopyCacheItem, 1);
+                if (!ci)
+                        return;
+        }
+
+        ci->from_offset = from_offset;
+        ci->to_offset = to_offset;
+        ci->hash = hash;
+
+        if (hashmap_put(from->copy_cache, &ci->from_offset, ci) < 0)
+                free(ci);
+}
+
 int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint64_t p, uint64_t *seqnum, Object **ret, uint64_t *offset) {
         uint64_t i, n;
         uint64_t q, xor_hash = 0;
@@ -2726,6 +3184,16 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
         if (!to->writable)
                 return -EPERM;
 
+        /* Most entries share most of their data objects, hence we
+         * remember where we copied them to, so that they are
+         * decompressed, hashed and looked up only once. This is
+         * only valid as long as we copy to the same file. */
+        if (!sd_id128_equal(from->copy_cache_file_id, to->header->file_id)) {
+                hashmap_free_free(from->copy_cache);
+                from->copy_cache = NULL;
+                from->copy_cache_file_id = to->header->file_id;
+        }
+
         ts.monotonic = le64toh(o->entry.monotonic);
         ts.realtime = le64toh(o->entry.realtime);
 
@@ -2738,10 +3206,19 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 size_t t;
                 void *data;
                 Object *u;
+                CopyCacheItem *ci;
 
                 q = le64toh(o->entry.items[i].object_offset);
                 le_hash = o->entry.items[i].hash;
 
+                ci = hashmap_get(from->copy_cache, &q);
+                if (ci && ci->hash == le_hash) {
+                        xor_hash ^= le64toh(le_hash);
+                        items[i].object_offset = htole64(ci->to_offset);
+                        items[i].hash = le_hash;
+                        continue;
+                }
+
                 r = journal_file_move_to_object(from, OBJECT_DATA, q, &o);
                 if (r < 0)
                         return r;
@@ -2756,22 +3233,22 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 if ((uint64_t) t != l)
                         return -E2BIG;
 
-                if (o->object.flags & OBJECT_COMPRESSED) {
-#ifdef HAVE_XZ
+                if (o->object.flags & OBJECT_COMPRESSION_MASK) {
+                        int compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                         uint64_t rsize;
 
-                        if (!uncompress_blob(o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0))
+                        if (!compression_supported(compression))
+                                return -EPROTONOSUPPORT;
+
+                        if (!uncompress_blob(compression, o->data.payload, l, &from->compress_buffer, &from->compress_buffer_size, &rsize, 0))
                                 return -EBADMSG;
 
                         data = from->compress_buffer;
                         l = rsize;
-#else
-                        return -EPROTONOSUPPORT;
-#endif
                 } else
                         data = o->data.payload;
 
-                r = journal_file_append_data(to, data, l, &u, &h);
+                r = journal_file_append_data(to, data, l, NULL, &u, &h);
                 if (r < 0)
                         return r;
 
@@ -2779,6 +3256,8 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                 items[i].object_offset = htole64(h);
                 items[i].hash = u->data.hash;
 
+                copy_cache_put(from, q, h, u->data.hash);
+
                 r = journal_file_move_to_object(from, OBJECT_ENTRY, p, &o);
                 if (r < 0)
                         return r;
@@ -2963,6 +3442,12 @@ bool journal_file_rotate_suggested(JournalFile *f, usec_t max_file_usec) {
                         return true;
                 }
 
+        /* We do not rotate on the depth of the hash chains alone:
+         * the hash function is not keyed, hence anybody who may log
+         * could craft colliding data and make us rotate, and thus
+         * vacuum, as often as they like. The depth is recorded in
+         * the header for inspection only. */
+
         /* Are the data objects properly indexed by field objects? */
         if (JOURNAL_HEADER_CONTAINS(f->header, n_data) &&
             JOURNAL_HEADER_CONTAINS(f->header, n_fields) &&
@@ -55,11 +55,20 @@ typedef struct JournalFile {
         int flags;
         int prot;
         bool writable:1;
-        bool compress:1;
         bool seal:1;
 
         bool tail_entry_monotonic_valid:1;
 
+        /* Only the header has been read so far, into memory of
+         * its own, see journal_file_open_lazy() */
+        bool lazy:1;
+
+        bool batching:1;
+        unsigned n_batched;
+
+        /* The OBJECT_COMPRESSED_xyz algorithm to use, or 0 */
+        int compress;
+
         direction_t last_direction;
 
         char *path;
@@ -75,11 +84,14 @@ typedef struct JournalFile {
         MMapCache *mmap;
 
         Hashmap *chain_cache;
+        Hashmap *data_cache;
+
+        /* Offsets of data objects of this file copied to another one */
+        Hashmap *copy_cache;
+        sd_id128_t copy_cache_file_id;
 
-#ifdef HAVE_XZ
         void *compress_buffer;
         uint64_t compress_buffer_size;
-#endif
 
 #ifdef HAVE_GCRYPT
         gcry_md_hd_t hmac;
@@ -99,17 +111,34 @@ typedef struct JournalFile {
 #endif
 } JournalFile;
 
+/* A field that has been compressed ahead of time, for example on a
+ * different thread. If compression doesn't match the algorithm of
+ * the file it is ignored, and if data is NULL the field didn't
+ * compress and is stored as is. */
+typedef struct JournalCompressedData {
+        int compression;
+        void *data;
+        uint64_t size;
+} JournalCompressedData;
+
 int journal_file_open(
                 const char *fname,
                 int flags,
                 mode_t mode,
-                bool compress,
+                int compress,
                 bool seal,
                 JournalMetrics *metrics,
                 MMapCache *mmap_cache,
                 JournalFile *template,
                 JournalFile **ret);
 
+int journal_file_open_lazy(
+                const char *fname,
+                MMapCache *mmap_cache,
+                JournalFile **ret);
+
+int journal_file_load(JournalFile *f);
+
 int journal_file_set_offline(JournalFile *f);
 void journal_file_close(JournalFile *j);
 
@@ -117,7 +146,7 @@ int journal_file_open_reliably(
                 const char *fname,
                 int flags,
                 mode_t mode,
-                bool compress,
+                int compress,
                 bool seal,
                 JournalMetrics *metrics,
                 MMapCache *mmap_cache,
@@ -148,8 +177,11 @@ static inline bool VALID_EPOCH(uint64_t u) {
 #define JOURNAL_HEADER_SEALED(h) \
         (!!(le32toh((h)->compatible_flags) & HEADER_COMPATIBLE_SEALED))
 
-#define JOURNAL_HEADER_COMPRESSED(h) \
-        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED))
+#define JOURNAL_HEADER_COMPRESSED_XZ(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_XZ))
+
+#define JOURNAL_HEADER_COMPRESSED_LZ4(h) \
+        (!!(le32toh((h)->incompatible_flags) & HEADER_INCOMPATIBLE_COMPRESSED_LZ4))
 
 int journal_file_move_to_object(JournalFile *f, int type, uint64_t offset, Object **ret);
 
@@ -159,6 +191,7 @@ uint64_t journal_file_hash_table_n_items(Object *o) _pure_;
 
 int journal_file_append_object(JournalFile *f, int type, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqno, Object **ret, uint64_t *offset);
+int journal_file_append_entry_full(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, const JournalCompressedData compressed[], uint64_t *seqno, Object **ret, uint64_t *offset);
 
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
@@ -186,10 +219,13 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
 void journal_file_dump(JournalFile *f);
 void journal_file_print_header(JournalFile *f);
 
-int journal_file_rotate(JournalFile **f, bool compress, bool seal);
+int journal_file_rotate(JournalFile **f, int compress, bool seal);
 
 void journal_file_post_change(JournalFile *f);
 
+void journal_file_begin_batch(JournalFile *f);
+void journal_file_end_batch(JournalFile *f);
+
 void journal_default_metrics(JournalMetrics *m, int fd);
 
 int journal_file_get_cutoff_realtime_usec(JournalFile *f, usec_t *from, usec_t *to);
@@ -51,6 +51,12 @@ typedef struct RequestMeta {
         FILE *tmp;
         uint64_t delta, size;
 
+        /* Export format is serialized into this buffer rather than
+         * into the temporary file. It contains the bytes from delta
+         * to delta + size of the stream. */
+        char *buffer;
+        size_t buffer_allocated;
+
         int argument_parse_error;
 
         bool follow;
@@ -98,6 +104,7 @@ static void request_meta_free(
         if (m->tmp)
                 fclose(m->tmp);
 
+        free(m->buffer);
         free(m->cursor);
         free(m);
 }
@@ -164,6 +171,65 @@ static int respond_error(
         return r;
 }
 
+static int request_meta_next(RequestMeta *m) {
+        int r;
+
+        assert(m);
+
+        /* Returns > 0 if we moved to the next entry, 0 at the end of
+         * the requested range, and -EAGAIN if there are no further
+         * entries right now. */
+
+        if (m->n_entries_set &&
+            m->n_entries <= 0)
+                return 0;
+
+        if (m->n_skip < 0)
+                r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
+        else if (m->n_skip > 0)
+                r = sd_journal_next_skip(m->journal, (uint64_t) m->n_skip + 1);
+        else
+                r = sd_journal_next(m->journal);
+
+        if (r < 0) {
+                log_error("Failed to advance journal pointer: %s", strerror(-r));
+                return r;
+        } else if (r == 0)
+                return -EAGAIN;
+
+        if (m->discrete) {
+                assert(m->cursor);
+
+                r = sd_journal_test_cursor(m->journal, m->cursor);
+                if (r < 0) {
+                        log_error("Failed to test cursor: %s", strerror(-r));
+                        return r;
+                }
+
+                if (r == 0)
+                        return 0;
+        }
+
+        if (m->n_entries_set)
+                m->n_entries -= 1;
+
+        m->n_skip = 0;
+
+        return 1;
+}
+
+static int request_meta_wait(RequestMeta *m) {
+        int r;
+
+        assert(m);
+
+        r = sd_journal_wait(m->journal, (uint64_t) -1);
+        if (r < 0)
+                log_error("Couldn't wait for journal event: %s", strerror(-r));
+
+        return r;
+}
+
 static ssize_t request_reader_entries(
                 void *cls,
                 uint64_t pos,
@@ -187,56 +253,25 @@ static ssize_t request_reader_entries(
                 /* End of this entry, so let's serialize the next
                  * one */
 
-                if (m->n_entries_set &&
-                    m->n_entries <= 0)
-                        return MHD_CONTENT_READER_END_OF_STREAM;
-
-                if (m->n_skip < 0)
-                        r = sd_journal_previous_skip(m->journal, (uint64_t) -m->n_skip + 1);
-                else if (m->n_skip > 0)
-                        r = sd_journal_next_skip(m->journal, (uint64_t) m->n_skip + 1);
-                else
-                        r = sd_journal_next(m->journal);
-
-                if (r < 0) {
-                        log_error("Failed to advance journal pointer: %s", strerror(-r));
-                        return MHD_CONTENT_READER_END_WITH_ERROR;
-                } else if (r == 0) {
+                r = request_meta_next(m);
+                if (r == -EAGAIN) {
 
                         if (m->follow) {
-                                r = sd_journal_wait(m->journal, (uint64_t) -1);
-                                if (r < 0) {
-                                        log_error("Couldn't wait for journal event: %s", strerror(-r));
+                                if (request_meta_wait(m) < 0)
                                         return MHD_CONTENT_READER_END_WITH_ERROR;
-                                }
 
                                 continue;
                         }
 
                         return MHD_CONTENT_READER_END_OF_STREAM;
-                }
-
-                if (m->discrete) {
-                        assert(m->cursor);
-
-                        r = sd_journal_test_cursor(m->journal, m->cursor);
-                        if (r < 0) {
-                                log_error("Failed to test cursor: %s", strerror(-r));
-                                return MHD_CONTENT_READER_END_WITH_ERROR;
-                        }
-
-                        if (r == 0)
-                                return MHD_CONTENT_READER_END_OF_STREAM;
-                }
+                } else if (r < 0)
+                        return MHD_CONTENT_READER_END_WITH_ERROR;
+                else if (r == 0)
+                        return MHD_CONTENT_READER_END_OF_STREAM;
 
                 pos -= m->size;
                 m->delta += m->size;
 
-                if (m->n_entries_set)
-                        m->n_entries -= 1;
-
-                m->n_skip = 0;
-
                 if (m->tmp)
                         rewind(m->tmp);
                 else {
@@ -281,6 +316,87 @@ static ssize_t request_reader_entries(
         return (ssize_t) k;
 }
 
+static int request_serialize_export(RequestMeta *m) {
+        size_t size = 0;
+        int r;
+
+        assert(m);
+
+        r = output_export_append(m->journal, &m->buffer, &m->buffer_allocated, &size);
+        m->size = size;
+
+        return r;
+}
+
+static ssize_t request_reader_export(
+                void *cls,
+                uint64_t pos,
+                char *buf,
+                size_t max) {
+
+        RequestMeta *m = cls;
+        size_t n = 0;
+        int r;
+
+        assert(m);
+        assert(buf);
+        assert(max > 0);
+        assert(pos >= m->delta);
+
+        pos -= m->delta;
+
+        /* Fill as much of the response buffer as we can, so that
+         * each call passes on many entries rather than one */
+
+        while (n < max) {
+                size_t k;
+
+                if (pos >= m->size) {
+                        r = request_meta_next(m);
+                        if (r == -EAGAIN) {
+
+                                /* Pass on what we have before
+                                 * waiting for more */
+                                if (n > 0)
+                                        break;
+
+                                if (m->follow) {
+                                        if (request_meta_wait(m) < 0)
+                                                return MHD_CONTENT_READER_END_WITH_ERROR;
+
+                                        continue;
+                                }
+
+                                return MHD_CONTENT_READER_END_OF_STREAM;
+                        } else if (r < 0)
+                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                        else if (r == 0) {
+                                if (n > 0)
+                                        break;
+
+                                return MHD_CONTENT_READER_END_OF_STREAM;
+                        }
+
+                        pos -= m->size;
+                        m->delta += m->size;
+
+                        r = request_serialize_export(m);
+                        if (r < 0) {
+                                log_error("Failed to serialize item: %s", strerror(-r));
+                                return MHD_CONTENT_READER_END_WITH_ERROR;
+                        }
+                }
+
+                k = MIN(m->size - pos, max - n);
+                memcpy(buf + n, m->buffer + pos, k);
+
+                n += k;
+                pos += k;
+        }
+
+        return (ssize_t) n;
+}
+
 static int request_parse_accept(
                 RequestMeta *m,
                 struct MHD_Connection *connection) {
@@ -522,7 +638,11 @@ static int request_handler_entries(
         if (r < 0)
                 return respond_error(connection, MHD_HTTP_BAD_REQUEST, "Failed to seek in journal.\n");
 
-        response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_entries, m, NULL);
+        if (m->mode == OUTPUT_EXPORT) {
+                sd_journal_set_data_threshold(m->journal, 0);
+                response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 256*1024, request_reader_export, m, NULL);
+        } else
+                response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, 4*1024, request_reader_entries, m, NULL);
         if (!response)
                 return respond_oom(connection);
 
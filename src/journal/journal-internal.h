@@ -31,11 +31,13 @@
 #include "list.h"
 #include "hashmap.h"
 #include "set.h"
+#include "prioq.h"
 #include "journal-file.h"
 
 typedef struct Match Match;
 typedef struct Location Location;
 typedef struct Directory Directory;
+typedef struct BootId BootId;
 
 typedef enum MatchType {
         MATCH_DISCRETE,
@@ -55,6 +57,10 @@ struct Match {
 
         /* For terms */
         LIST_HEAD(Match, matches);
+
+        /* For OR terms of concrete matches, per file: the next
+         * entry of each of them, in a priority queue */
+        Hashmap *cursors;
 };
 
 typedef enum LocationType {
@@ -96,6 +102,12 @@ struct Directory {
         bool is_root;
 };
 
+struct BootId {
+        sd_id128_t id;
+        uint64_t first;
+        uint64_t last;
+};
+
 struct sd_journal {
         char *path;
 
@@ -118,6 +130,7 @@ struct sd_journal {
         char *unique_field;
         JournalFile *unique_file;
         uint64_t unique_offset;
+        Set *unique_values;
 
         int flags;
 
@@ -130,10 +143,18 @@ struct sd_journal {
         Hashmap *directories_by_wd;
 
         Set *errors;
+
+        /* The files sd_journal_next() and sd_journal_previous() are
+         * merging, ordered by the next entry each has to offer, and
+         * the files which had nothing to offer but might grow */
+        Prioq *merge_queue;
+        Set *merge_exhausted;
+        direction_t merge_direction;
 };
 
 char *journal_make_match_string(sd_journal *j);
 void journal_print_header(sd_journal *j);
+int journal_get_boots(sd_journal *j, BootId **ret, unsigned *n);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(sd_journal*, sd_journal_close);
 #define _cleanup_journal_close_ _cleanup_(sd_journal_closep)
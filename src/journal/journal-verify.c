@@ -23,6 +23,7 @@
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <stddef.h>
+#include <pthread.h>
 
 #include "util.h"
 #include "macro.h"
@@ -38,6 +39,21 @@
  * files without adding to many zeros. */
 #define OFSfmt "%06"PRIx64
 
+/* journalctl --verify checks several files in parallel threads, but
+ * logging is not thread-safe. Hence serialize everything this file
+ * logs, as well as the progress bar. */
+static pthread_mutex_t output_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#undef log_full
+#define log_full(level, ...)                                            \
+do {                                                                    \
+        if (log_get_max_level() >= (level)) {                           \
+                assert_se(pthread_mutex_lock(&output_mutex) == 0);      \
+                log_meta((level), __FILE__, __LINE__, __func__, __VA_ARGS__); \
+                assert_se(pthread_mutex_unlock(&output_mutex) == 0);    \
+        }                                                               \
+} while (0)
+
 static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o) {
         uint64_t i;
 
@@ -49,7 +65,7 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
          * possible field values. It does not follow any references to
          * other objects. */
 
-        if ((o->object.flags & OBJECT_COMPRESSED) &&
+        if ((o->object.flags & OBJECT_COMPRESSION_MASK) &&
             o->object.type != OBJECT_DATA)
                 return -EBADMSG;
 
@@ -76,12 +92,19 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
 
                 h1 = le64toh(o->data.hash);
 
-                if (o->object.flags & OBJECT_COMPRESSED) {
-#ifdef HAVE_XZ
+                if (o->object.flags & OBJECT_COMPRESSION_MASK) {
+                        int compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                         void *b = NULL;
                         uint64_t alloc = 0, b_size;
 
-                        if (!uncompress_blob(o->data.payload,
+                        if (!compression_supported(compression)) {
+                                log_error("Compression %s is not supported",
+                                          object_compressed_to_string(compression) ?: "unknown");
+                                return -EPROTONOSUPPORT;
+                        }
+
+                        if (!uncompress_blob(compression,
+                                             o->data.payload,
                                              le64toh(o->object.size) - offsetof(Object, data.payload),
                                              &b, &alloc, &b_size, 0)) {
                                 log_error(OFSfmt": uncompression failed", offset);
@@ -90,10 +113,6 @@ static int journal_file_object_verify(JournalFile *f, uint64_t offset, Object *o
 
                         h2 = hash64(b, b_size);
                         free(b);
-#else
-                        log_error("Compression is not supported");
-                        return -EPROTONOSUPPORT;
-#endif
                 } else
                         h2 = hash64(o->data.payload, le64toh(o->object.size) - offsetof(Object, data.payload));
 
@@ -296,6 +315,8 @@ static void draw_progress(uint64_t p, usec_t *last_usec) {
 
         *last_usec = z;
 
+        assert_se(pthread_mutex_lock(&output_mutex) == 0);
+
         n = (3 * columns()) / 4;
         j = (n * (unsigned) p) / 65535ULL;
         k = n - j;
@@ -314,6 +335,8 @@ static void draw_progress(uint64_t p, usec_t *last_usec) {
 
         fputs("\r\x1B[?25h", stdout);
         fflush(stdout);
+
+        assert_se(pthread_mutex_unlock(&output_mutex) == 0);
 }
 
 static void flush_progress(void) {
@@ -322,6 +345,8 @@ static void flush_progress(void) {
         if (!on_tty())
                 return;
 
+        assert_se(pthread_mutex_lock(&output_mutex) == 0);
+
         n = (3 * columns()) / 4;
 
         putchar('\r');
@@ -331,70 +356,80 @@ static void flush_progress(void) {
 
         putchar('\r');
         fflush(stdout);
+
+        assert_se(pthread_mutex_unlock(&output_mutex) == 0);
 }
 
-static int write_uint64(int fd, uint64_t p) {
-        ssize_t k;
+typedef struct OffsetList {
+        uint64_t *items;
+        size_t n, allocated;
+} OffsetList;
+
+static void offset_list_free(OffsetList *l) {
+        assert(l);
+
+        free(l->items);
+        l->items = NULL;
+        l->n = l->allocated = 0;
+}
 
-        k = write(fd, &p, sizeof(p));
-        if (k < 0)
-                return -errno;
-        if (k != sizeof(p))
-                return -EIO;
+static int offset_list_add(OffsetList *l, uint64_t p) {
+        assert(l);
 
+        /* Objects are enumerated in file order, hence the list stays
+         * sorted without further ado */
+        assert(l->n == 0 || l->items[l->n - 1] < p);
+
+        if (!GREEDY_REALLOC(l->items, l->allocated, l->n + 1))
+                return -ENOMEM;
+
+        l->items[l->n++] = p;
         return 0;
 }
 
-static int contains_uint64(MMapCache *m, int fd, uint64_t n, uint64_t p) {
-        uint64_t a, b;
-        int r;
+static ssize_t offset_list_find(const OffsetList *l, uint64_t p) {
+        size_t a, b;
 
-        assert(m);
-        assert(fd >= 0);
+        assert(l);
 
         /* Bisection ... */
 
-        a = 0; b = n;
+        a = 0; b = l->n;
         while (a < b) {
-                uint64_t c, *z;
+                size_t c;
 
                 c = (a + b) / 2;
 
-                r = mmap_cache_get(m, fd, PROT_READ|PROT_WRITE, 0, false, c * sizeof(uint64_t), sizeof(uint64_t), NULL, (void **) &z);
-                if (r < 0)
-                        return r;
+                if (l->items[c] == p)
+                        return (ssize_t) c;
 
-                if (*z == p)
-                        return 1;
-
-                if (a + 1 >= b)
-                        return 0;
-
-                if (p < *z)
+                if (p < l->items[c])
                         b = c;
                 else
-                        a = c;
+                        a = c + 1;
         }
 
-        return 0;
+        return -1;
+}
+
+static bool offset_list_contains(const OffsetList *l, uint64_t p) {
+        return offset_list_find(l, p) >= 0;
 }
 
 static int entry_points_to_data(
                 JournalFile *f,
-                int entry_fd,
-                uint64_t n_entries,
+                const OffsetList *entries,
                 uint64_t entry_p,
                 uint64_t data_p) {
 
         int r;
-        uint64_t i, n, a;
+        uint64_t i, n;
         Object *o;
-        bool found = false;
 
         assert(f);
-        assert(entry_fd >= 0);
+        assert(entries);
 
-        if (!contains_uint64(f->mmap, entry_fd, n_entries, entry_p)) {
+        if (!offset_list_contains(entries, entry_p)) {
                 log_error("Data object references invalid entry at %"PRIu64, data_p);
                 return -EBADMSG;
         }
@@ -405,79 +440,31 @@ static int entry_points_to_data(
 
         n = journal_file_entry_n_items(o);
         for (i = 0; i < n; i++)
-                if (le64toh(o->entry.items[i].object_offset) == data_p) {
-                        found = true;
-                        break;
-                }
-
-        if (!found) {
-                log_error("Data object not referenced by linked entry at %"PRIu64, data_p);
-                return -EBADMSG;
-        }
-
-        /* Check if this entry is also in main entry array. Since the
-         * main entry array has already been verified we can rely on
-         * its consistency.*/
-
-        i = 0;
-        n = le64toh(f->header->n_entries);
-        a = le64toh(f->header->entry_array_offset);
-
-        while (i < n) {
-                uint64_t m, u;
-
-                r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
-                if (r < 0)
-                        return r;
-
-                m = journal_file_entry_array_n_items(o);
-                u = MIN(n - i, m);
-
-                if (entry_p <= le64toh(o->entry_array.items[u-1])) {
-                        uint64_t x, y, z;
-
-                        x = 0;
-                        y = u;
-
-                        while (x < y) {
-                                z = (x + y) / 2;
-
-                                if (le64toh(o->entry_array.items[z]) == entry_p)
-                                        return 0;
-
-                                if (x + 1 >= y)
-                                        break;
-
-                                if (entry_p < le64toh(o->entry_array.items[z]))
-                                        y = z;
-                                else
-                                        x = z;
-                        }
-
-                        log_error("Entry object doesn't exist in main entry array at %"PRIu64, entry_p);
-                        return -EBADMSG;
-                }
+                if (le64toh(o->entry.items[i].object_offset) == data_p)
+                        return 0;
 
-                i += u;
-                a = le64toh(o->entry_array.next_entry_array_offset);
-        }
+        /* Note that we don't need to look for the entry in the main
+         * entry array: that has already been verified to list
+         * exactly n_entries strictly ascending entry objects, hence
+         * it contains every entry object of the file. */
 
-        return 0;
+        log_error("Data object not referenced by linked entry at %"PRIu64, data_p);
+        return -EBADMSG;
 }
 
 static int verify_data(
                 JournalFile *f,
                 Object *o, uint64_t p,
-                int entry_fd, uint64_t n_entries,
-                int entry_array_fd, uint64_t n_entry_arrays) {
+                const OffsetList *entries,
+                const OffsetList *entry_arrays) {
 
         uint64_t i, n, a, last, q;
         int r;
 
         assert(f);
         assert(o);
-        assert(entry_fd >= 0);
-        assert(entry_array_fd >= 0);
+        assert(entries);
+        assert(entry_arrays);
 
         n = le64toh(o->data.n_entries);
         a = le64toh(o->data.entry_array_offset);
@@ -496,7 +483,7 @@ static int verify_data(
         assert(o->data.entry_offset);
 
         last = q = le64toh(o->data.entry_offset);
-        r = entry_points_to_data(f, entry_fd, n_entries, q, p);
+        r = entry_points_to_data(f, entries, q, p);
         if (r < 0)
                 return r;
 
@@ -509,7 +496,7 @@ static int verify_data(
                         return -EBADMSG;
                 }
 
-                if (!contains_uint64(f->mmap, entry_array_fd, n_entry_arrays, a)) {
+                if (!offset_list_contains(entry_arrays, a)) {
                         log_error("Invalid array at %"PRIu64, p);
                         return -EBADMSG;
                 }
@@ -534,7 +521,7 @@ static int verify_data(
                         }
                         last = q;
 
-                        r = entry_points_to_data(f, entry_fd, n_entries, q, p);
+                        r = entry_points_to_data(f, entries, q, p);
                         if (r < 0)
                                 return r;
 
@@ -552,24 +539,24 @@ static int verify_data(
 
 static int verify_hash_table(
                 JournalFile *f,
-                int data_fd, uint64_t n_data,
-                int entry_fd, uint64_t n_entries,
-                int entry_array_fd, uint64_t n_entry_arrays,
+                const OffsetList *data,
+                const OffsetList *entries,
+                const OffsetList *entry_arrays,
                 usec_t *last_usec,
                 bool show_progress) {
 
-        uint64_t i, n;
+        uint64_t i, n, max_depth = 0;
         int r;
 
         assert(f);
-        assert(data_fd >= 0);
-        assert(entry_fd >= 0);
-        assert(entry_array_fd >= 0);
+        assert(data);
+        assert(entries);
+        assert(entry_arrays);
         assert(last_usec);
 
         n = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
         for (i = 0; i < n; i++) {
-                uint64_t last = 0, p;
+                uint64_t last = 0, p, depth = 0;
 
                 if (show_progress)
                         draw_progress(0xC000 + (0x3FFF * i / n), last_usec);
@@ -579,7 +566,7 @@ static int verify_hash_table(
                         Object *o;
                         uint64_t next;
 
-                        if (!contains_uint64(f->mmap, data_fd, n_data, p)) {
+                        if (!offset_list_contains(data, p)) {
                                 log_error("Invalid data object at hash entry %"PRIu64" of %"PRIu64,
                                           i, n);
                                 return -EBADMSG;
@@ -602,43 +589,81 @@ static int verify_hash_table(
                                 return -EBADMSG;
                         }
 
-                        r = verify_data(f, o, p, entry_fd, n_entries, entry_array_fd, n_entry_arrays);
+                        r = verify_data(f, o, p, entries, entry_arrays);
                         if (r < 0)
                                 return r;
 
                         last = p;
                         p = next;
+                        depth++;
                 }
 
                 if (last != le64toh(f->data_hash_table[i].tail_hash_offset)) {
                         log_error("Tail hash pointer mismatch in hash table");
                         return -EBADMSG;
                 }
+
+                max_depth = MAX(max_depth, depth);
+        }
+
+        /* The header records the longest chain a lookup walked, and
+         * chains never shrink */
+        if (JOURNAL_HEADER_CONTAINS(f->header, data_hash_chain_depth) &&
+            le64toh(f->header->data_hash_chain_depth) > max_depth) {
+                log_error("Data hash chain depth in header larger than deepest hash chain");
+                return -EBADMSG;
         }
 
         return 0;
 }
 
-static int data_object_in_hash_table(JournalFile *f, uint64_t hash, uint64_t p) {
-        uint64_t n, h, q;
+static int mark_hashed_data(
+                JournalFile *f,
+                const OffsetList *data,
+                uint8_t *hashed) {
+
+        uint64_t i, n;
         int r;
+
         assert(f);
+        assert(data);
+        assert(hashed);
+
+        /* Remember which data objects are linked from the hash
+         * table, so that checking the data objects of each entry
+         * doesn't require walking a hash chain every time */
 
         n = le64toh(f->header->data_hash_table_size) / sizeof(HashItem);
-        h = hash % n;
+        for (i = 0; i < n; i++) {
+                uint64_t p;
 
-        q = le64toh(f->data_hash_table[h].head_hash_offset);
-        while (q != 0) {
-                Object *o;
+                p = le64toh(f->data_hash_table[i].head_hash_offset);
+                while (p != 0) {
+                        Object *o;
+                        uint64_t next;
+                        ssize_t k;
 
-                if (p == q)
-                        return 1;
+                        k = offset_list_find(data, p);
+                        if (k < 0) {
+                                log_error("Invalid data object at hash entry %"PRIu64" of %"PRIu64,
+                                          i, n);
+                                return -EBADMSG;
+                        }
 
-                r = journal_file_move_to_object(f, OBJECT_DATA, q, &o);
-                if (r < 0)
-                        return r;
+                        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                        if (r < 0)
+                                return r;
+
+                        next = le64toh(o->data.next_hash_offset);
+                        if (next != 0 && next <= p) {
+                                log_error("Hash chain has a cycle in hash entry %"PRIu64" of %"PRIu64,
+                                          i, n);
+                                return -EBADMSG;
+                        }
 
-                q = le64toh(o->data.next_hash_offset);
+                        hashed[k / 8] |= 1 << (k % 8);
+                        p = next;
+                }
         }
 
         return 0;
@@ -647,24 +672,28 @@ static int data_object_in_hash_table(JournalFile *f, uint64_t hash, uint64_t p)
 static int verify_entry(
                 JournalFile *f,
                 Object *o, uint64_t p,
-                int data_fd, uint64_t n_data) {
+                const OffsetList *data,
+                const uint8_t *hashed) {
 
         uint64_t i, n;
         int r;
 
         assert(f);
         assert(o);
-        assert(data_fd >= 0);
+        assert(data);
+        assert(hashed);
 
         n = journal_file_entry_n_items(o);
         for (i = 0; i < n; i++) {
                 uint64_t q, h;
                 Object *u;
+                ssize_t k;
 
                 q = le64toh(o->entry.items[i].object_offset);
                 h = le64toh(o->entry.items[i].hash);
 
-                if (!contains_uint64(f->mmap, data_fd, n_data, q)) {
+                k = offset_list_find(data, q);
+                if (k < 0) {
                         log_error("Invalid data object at entry %"PRIu64, p);
                                 return -EBADMSG;
                         }
@@ -678,10 +707,7 @@ static int verify_entry(
                         return -EBADMSG;
                 }
 
-                r = data_object_in_hash_table(f, h, q);
-                if (r < 0)
-                        return r;
-                if (r == 0) {
+                if (!(hashed[k / 8] & (1 << (k % 8)))) {
                         log_error("Data object missing from hash at entry %"PRIu64, p);
                         return -EBADMSG;
                 }
@@ -692,9 +718,10 @@ static int verify_entry(
 
 static int verify_entry_array(
                 JournalFile *f,
-                int data_fd, uint64_t n_data,
-                int entry_fd, uint64_t n_entries,
-                int entry_array_fd, uint64_t n_entry_arrays,
+                const OffsetList *data,
+                const uint8_t *hashed,
+                const OffsetList *entries,
+                const OffsetList *entry_arrays,
                 usec_t *last_usec,
                 bool show_progress) {
 
@@ -702,9 +729,10 @@ static int verify_entry_array(
         int r;
 
         assert(f);
-        assert(data_fd >= 0);
-        assert(entry_fd >= 0);
-        assert(entry_array_fd >= 0);
+        assert(data);
+        assert(hashed);
+        assert(entries);
+        assert(entry_arrays);
         assert(last_usec);
 
         n = le64toh(f->header->n_entries);
@@ -721,7 +749,7 @@ static int verify_entry_array(
                         return -EBADMSG;
                 }
 
-                if (!contains_uint64(f->mmap, entry_array_fd, n_entry_arrays, a)) {
+                if (!offset_list_contains(entry_arrays, a)) {
                         log_error("Invalid array at %"PRIu64" of %"PRIu64, i, n);
                         return -EBADMSG;
                 }
@@ -748,7 +776,7 @@ static int verify_entry_array(
                         }
                         last = p;
 
-                        if (!contains_uint64(f->mmap, entry_fd, n_entries, p)) {
+                        if (!offset_list_contains(entries, p)) {
                                 log_error("Invalid array entry at %"PRIu64" of %"PRIu64,
                                           i, n);
                                 return -EBADMSG;
@@ -758,7 +786,7 @@ static int verify_entry_array(
                         if (r < 0)
                                 return r;
 
-                        r = verify_entry(f, o, p, data_fd, n_data);
+                        r = verify_entry(f, o, p, data, hashed);
                         if (r < 0)
                                 return r;
 
@@ -788,10 +816,8 @@ int journal_file_verify(
         bool entry_seqnum_set = false, entry_monotonic_set = false, entry_realtime_set = false, found_main_entry_array = false;
         uint64_t n_weird = 0, n_objects = 0, n_entries = 0, n_data = 0, n_fields = 0, n_data_hash_tables = 0, n_field_hash_tables = 0, n_entry_arrays = 0, n_tags = 0;
         usec_t last_usec = 0;
-        int data_fd = -1, entry_fd = -1, entry_array_fd = -1;
-        char data_path[] = "/var/tmp/journal-data-XXXXXX",
-                entry_path[] = "/var/tmp/journal-entry-XXXXXX",
-                entry_array_path[] = "/var/tmp/journal-entry-array-XXXXXX";
+        OffsetList data = {}, entries = {}, entry_arrays = {};
+        uint8_t *hashed = NULL;
         unsigned i;
         bool found_last;
 #ifdef HAVE_GCRYPT
@@ -799,6 +825,10 @@ int journal_file_verify(
 #endif
         assert(f);
 
+        r = journal_file_load(f);
+        if (r < 0)
+                return r;
+
         if (key) {
 #ifdef HAVE_GCRYPT
                 r = journal_file_parse_verification_key(f, key);
@@ -809,32 +839,10 @@ int journal_file_verify(
 #else
                 return -ENOTSUP;
 #endif
-        } else if (f->seal)
-                return -ENOKEY;
-
-        data_fd = mkostemp(data_path, O_CLOEXEC);
-        if (data_fd < 0) {
-                log_error("Failed to create data file: %m");
-                r = -errno;
-                goto fail;
         }
-        unlink(data_path);
 
-        entry_fd = mkostemp(entry_path, O_CLOEXEC);
-        if (entry_fd < 0) {
-                log_error("Failed to create entry file: %m");
-                r = -errno;
-                goto fail;
-        }
-        unlink(entry_path);
-
-        entry_array_fd = mkostemp(entry_array_path, O_CLOEXEC);
-        if (entry_array_fd < 0) {
-                log_error("Failed to create entry array file: %m");
-                r = -errno;
-                goto fail;
-        }
-        unlink(entry_array_path);
+        /* Without a key the tags of sealed files cannot be
+         * authenticated, but everything else is still checked */
 
 #ifdef HAVE_GCRYPT
         if ((le32toh(f->header->compatible_flags) & ~HEADER_COMPATIBLE_SEALED) != 0)
@@ -885,8 +893,14 @@ int journal_file_verify(
                         goto fail;
                 }
 
-                if ((o->object.flags & OBJECT_COMPRESSED) && !JOURNAL_HEADER_COMPRESSED(f->header)) {
-                        log_error("Compressed object in file without compression at "OFSfmt, p);
+                if ((o->object.flags & OBJECT_COMPRESSED_XZ) && !JOURNAL_HEADER_COMPRESSED_XZ(f->header)) {
+                        log_error("XZ compressed object in file without XZ compression at "OFSfmt, p);
+                        r = -EBADMSG;
+                        goto fail;
+                }
+
+                if ((o->object.flags & OBJECT_COMPRESSED_LZ4) && !JOURNAL_HEADER_COMPRESSED_LZ4(f->header)) {
+                        log_error("LZ4 compressed object in file without LZ4 compression at "OFSfmt, p);
                         r = -EBADMSG;
                         goto fail;
                 }
@@ -894,7 +908,7 @@ int journal_file_verify(
                 switch (o->object.type) {
 
                 case OBJECT_DATA:
-                        r = write_uint64(data_fd, p);
+                        r = offset_list_add(&data, p);
                         if (r < 0)
                                 goto fail;
 
@@ -912,7 +926,7 @@ int journal_file_verify(
                                 goto fail;
                         }
 
-                        r = write_uint64(entry_fd, p);
+                        r = offset_list_add(&entries, p);
                         if (r < 0)
                                 goto fail;
 
@@ -999,7 +1013,7 @@ int journal_file_verify(
                         break;
 
                 case OBJECT_ENTRY_ARRAY:
-                        r = write_uint64(entry_array_fd, p);
+                        r = offset_list_add(&entry_arrays, p);
                         if (r < 0)
                                 goto fail;
 
@@ -1036,7 +1050,7 @@ int journal_file_verify(
                         }
 
 #ifdef HAVE_GCRYPT
-                        if (f->seal) {
+                        if (f->seal && key) {
                                 uint64_t q, rt;
 
                                 log_debug("Checking tag %"PRIu64"...", le64toh(o->tag.seqnum));
@@ -1207,19 +1221,25 @@ int journal_file_verify(
          * unreferenced objects. We only care that everything that is
          * referenced is consistent. */
 
+        hashed = new0(uint8_t, (data.n + 7) / 8);
+        if (!hashed) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        r = mark_hashed_data(f, &data, hashed);
+        if (r < 0)
+                goto fail;
+
         r = verify_entry_array(f,
-                               data_fd, n_data,
-                               entry_fd, n_entries,
-                               entry_array_fd, n_entry_arrays,
+                               &data, hashed, &entries, &entry_arrays,
                                &last_usec,
                                show_progress);
         if (r < 0)
                 goto fail;
 
         r = verify_hash_table(f,
-                              data_fd, n_data,
-                              entry_fd, n_entries,
-                              entry_array_fd, n_entry_arrays,
+                              &data, &entries, &entry_arrays,
                               &last_usec,
                               show_progress);
         if (r < 0)
@@ -1228,13 +1248,10 @@ int journal_file_verify(
         if (show_progress)
                 flush_progress();
 
-        mmap_cache_close_fd(f->mmap, data_fd);
-        mmap_cache_close_fd(f->mmap, entry_fd);
-        mmap_cache_close_fd(f->mmap, entry_array_fd);
-
-        close_nointr_nofail(data_fd);
-        close_nointr_nofail(entry_fd);
-        close_nointr_nofail(entry_array_fd);
+        offset_list_free(&data);
+        offset_list_free(&entries);
+        offset_list_free(&entry_arrays);
+        free(hashed);
 
         if (first_contained)
                 *first_contained = le64toh(f->header->head_entry_realtime);
@@ -1255,20 +1272,10 @@ fail:
                   (unsigned long long) f->last_stat.st_size,
                   100 * p / f->last_stat.st_size);
 
-        if (data_fd >= 0) {
-                mmap_cache_close_fd(f->mmap, data_fd);
-                close_nointr_nofail(data_fd);
-        }
-
-        if (entry_fd >= 0) {
-                mmap_cache_close_fd(f->mmap, entry_fd);
-                close_nointr_nofail(entry_fd);
-        }
-
-        if (entry_array_fd >= 0) {
-                mmap_cache_close_fd(f->mmap, entry_array_fd);
-                close_nointr_nofail(entry_array_fd);
-        }
+        offset_list_free(&data);
+        offset_list_free(&entries);
+        offset_list_free(&entry_arrays);
+        free(hashed);
 
         return r;
 }
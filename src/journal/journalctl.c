@@ -32,6 +32,7 @@
 #include <signal.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <pthread.h>
 #include <linux/fs.h>
 
 #ifdef HAVE_ACL
@@ -107,12 +108,6 @@ static enum {
         ACTION_LIST_BOOTS,
 } arg_action = ACTION_SHOW;
 
-typedef struct boot_id_t {
-        sd_id128_t id;
-        uint64_t first;
-        uint64_t last;
-} boot_id_t;
-
 static int help(void) {
 
         printf("%s [OPTIONS...] [MATCHES...]\n\n"
@@ -701,80 +696,17 @@ static int add_matches(sd_journal *j, char **args) {
         return 0;
 }
 
-static int boot_id_cmp(const void *a, const void *b) {
-        uint64_t _a, _b;
-
-        _a = ((const boot_id_t *)a)->first;
-        _b = ((const boot_id_t *)b)->first;
-
-        return _a < _b ? -1 : (_a > _b ? 1 : 0);
-}
-
 static int list_boots(sd_journal *j) {
         int r;
-        const void *data;
         unsigned int count = 0;
         int w, i;
-        size_t length, allocated = 0;
-        boot_id_t *id;
-        _cleanup_free_ boot_id_t *all_ids = NULL;
+        BootId *id;
+        _cleanup_free_ BootId *all_ids = NULL;
 
-        r = sd_journal_query_unique(j, "_BOOT_ID");
+        r = journal_get_boots(j, &all_ids, &count);
         if (r < 0)
                 return r;
 
-        SD_JOURNAL_FOREACH_UNIQUE(j, data, length) {
-                if (length < strlen("_BOOT_ID="))
-                        continue;
-
-                if (!GREEDY_REALLOC(all_ids, allocated, count + 1))
-                        return log_oom();
-
-                id = &all_ids[count];
-
-                r = sd_id128_from_string(((const char *)data) + strlen("_BOOT_ID="), &id->id);
-                if (r < 0)
-                        continue;
-
-                r = sd_journal_add_match(j, data, length);
-                if (r < 0)
-                        return r;
-
-                r = sd_journal_seek_head(j);
-                if (r < 0)
-                        return r;
-
-                r = sd_journal_next(j);
-                if (r < 0)
-                        return r;
-                else if (r == 0)
-                        goto flush;
-
-                r = sd_journal_get_realtime_usec(j, &id->first);
-                if (r < 0)
-                        return r;
-
-                r = sd_journal_seek_tail(j);
-                if (r < 0)
-                        return r;
-
-                r = sd_journal_previous(j);
-                if (r < 0)
-                        return r;
-                else if (r == 0)
-                        goto flush;
-
-                r = sd_journal_get_realtime_usec(j, &id->last);
-                if (r < 0)
-                        return r;
-
-                count++;
-        flush:
-                sd_journal_flush_matches(j);
-        }
-
-        qsort_safe(all_ids, count, sizeof(boot_id_t), boot_id_cmp);
-
         /* numbers are one less, but we need an extra char for the sign */
         w = DECIMAL_STR_WIDTH(count - 1) + 1;
 
@@ -793,11 +725,9 @@ static int list_boots(sd_journal *j) {
 
 static int get_relative_boot_id(sd_journal *j, sd_id128_t *boot_id, int relative) {
         int r;
-        const void *data;
         unsigned int count = 0;
-        size_t length, allocated = 0;
-        boot_id_t ref_boot_id = {SD_ID128_NULL}, *id;
-        _cleanup_free_ boot_id_t *all_ids = NULL;
+        BootId *id;
+        _cleanup_free_ BootId *all_ids = NULL;
 
         assert(j);
         assert(boot_id);
@@ -805,62 +735,23 @@ static int get_relative_boot_id(sd_journal *j, sd_id128_t *boot_id, int relative
         if (relative == 0 && !sd_id128_equal(*boot_id, SD_ID128_NULL))
                 return 0;
 
-        r = sd_journal_query_unique(j, "_BOOT_ID");
+        r = journal_get_boots(j, &all_ids, &count);
         if (r < 0)
                 return r;
 
-        SD_JOURNAL_FOREACH_UNIQUE(j, data, length) {
-                if (length < strlen("_BOOT_ID="))
-                        continue;
-
-                if (!GREEDY_REALLOC(all_ids, allocated, count + 1))
-                        return log_oom();
-
-                id = &all_ids[count];
-
-                r = sd_id128_from_string(((const char *)data) + strlen("_BOOT_ID="), &id->id);
-                if (r < 0)
-                        continue;
-
-                r = sd_journal_add_match(j, data, length);
-                if (r < 0)
-                        return r;
-
-                r = sd_journal_seek_head(j);
-                if (r < 0)
-                        return r;
-
-                r = sd_journal_next(j);
-                if (r < 0)
-                        return r;
-                else if (r == 0)
-                        goto flush;
-
-                r = sd_journal_get_realtime_usec(j, &id->first);
-                if (r < 0)
-                        return r;
-
-                if (sd_id128_equal(id->id, *boot_id))
-                        ref_boot_id = *id;
-
-                count++;
-        flush:
-                sd_journal_flush_matches(j);
-        }
-
-        qsort_safe(all_ids, count, sizeof(boot_id_t), boot_id_cmp);
-
         if (sd_id128_equal(*boot_id, SD_ID128_NULL)) {
                 if (relative > (int) count || relative <= -(int)count)
                         return -EADDRNOTAVAIL;
 
                 *boot_id = all_ids[(relative <= 0)*count + relative - 1].id;
         } else {
-                id = bsearch(&ref_boot_id, all_ids, count, sizeof(boot_id_t), boot_id_cmp);
+                for (id = all_ids; id < all_ids + count; id++)
+                        if (sd_id128_equal(id->id, *boot_id))
+                                break;
 
-                if (!id ||
-                    relative <= 0 ? (id - all_ids) + relative < 0 :
-                                    (id - all_ids) + relative >= (int) count)
+                if (id >= all_ids + count ||
+                    (relative <= 0 ? (id - all_ids) + relative < 0 :
+                                     (id - all_ids) + relative >= (int) count))
                         return -EADDRNOTAVAIL;
 
                 *boot_id = (id + relative)->id;
@@ -1236,6 +1127,109 @@ finish:
 #endif
 }
 
+typedef struct VerifyJob {
+        const char *path;
+        int r;
+} VerifyJob;
+
+typedef struct VerifyQueue {
+        VerifyJob *jobs;
+        unsigned n_jobs;
+        unsigned next;
+} VerifyQueue;
+
+static void *verify_thread(void *userdata) {
+        VerifyQueue *q = userdata;
+
+        for (;;) {
+                VerifyJob *job;
+                JournalFile *f;
+                unsigned k;
+
+                k = __sync_fetch_and_add(&q->next, 1);
+                if (k >= q->n_jobs)
+                        break;
+
+                job = q->jobs + k;
+
+                /* The mmap cache is not thread-safe, hence every
+                 * file is opened a second time, with a cache of its
+                 * own */
+                job->r = journal_file_open(job->path, O_RDONLY, 0, false, false, NULL, NULL, NULL, &f);
+                if (job->r < 0)
+                        continue;
+
+                job->r = journal_file_verify(f, NULL, NULL, NULL, NULL, false);
+                journal_file_close(f);
+        }
+
+        return NULL;
+}
+
+static int verify_parallel(sd_journal *j) {
+        _cleanup_free_ VerifyJob *jobs = NULL;
+        _cleanup_free_ pthread_t *threads = NULL;
+        VerifyQueue q = {};
+        unsigned n_threads = 0, n, k;
+        Iterator i;
+        JournalFile *f;
+        long ncpus;
+        int r = 0;
+
+        assert(j);
+
+        jobs = new0(VerifyJob, hashmap_size(j->files));
+        if (!jobs)
+                return log_oom();
+
+        q.jobs = jobs;
+
+        HASHMAP_FOREACH(f, j->files, i) {
+                VerifyJob *job = jobs + q.n_jobs++;
+
+                job->path = f->path;
+
+#ifdef HAVE_GCRYPT
+                if (JOURNAL_HEADER_SEALED(f->header))
+                        log_notice("Journal file %s has sealing enabled but verification key has not been passed using --verify-key=.", f->path);
+#endif
+        }
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = MIN((unsigned) MAX(ncpus, 1L), q.n_jobs);
+
+        threads = new(pthread_t, n);
+        if (!threads)
+                return log_oom();
+
+        for (k = 0; k < n; k++) {
+                r = pthread_create(threads + n_threads, NULL, verify_thread, &q);
+                if (r != 0) {
+                        log_debug("Failed to start verification thread: %s", strerror(r));
+                        break;
+                }
+
+                n_threads++;
+        }
+
+        /* If we couldn't start any thread, do the work ourselves */
+        if (n_threads == 0)
+                verify_thread(&q);
+
+        for (k = 0; k < n_threads; k++)
+                pthread_join(threads[k], NULL);
+
+        r = 0;
+        for (k = 0; k < q.n_jobs; k++)
+                if (jobs[k].r < 0) {
+                        log_warning("FAIL: %s (%s)", jobs[k].path, strerror(-jobs[k].r));
+                        r = jobs[k].r;
+                } else
+                        log_info("PASS: %s", jobs[k].path);
+
+        return r;
+}
+
 static int verify(sd_journal *j) {
         int r = 0;
         Iterator i;
@@ -1245,6 +1239,11 @@ static int verify(sd_journal *j) {
 
         log_show_color(true);
 
+        /* Without a key there is nothing to report but PASS or FAIL,
+         * hence the files may be verified in parallel */
+        if (!arg_verify_key && hashmap_size(j->files) > 1)
+                return verify_parallel(j);
+
         HASHMAP_FOREACH(f, j->files, i) {
                 int k;
                 usec_t first, validated, last;
@@ -1400,6 +1399,9 @@ int main(int argc, char *argv[]) {
         bool previous_boot_id_valid = false, first_line = true;
         int n_shown = 0;
         bool ellipsized = false;
+        OutputPipeline *pipeline = NULL;
+        long ncpus;
+        int flags;
 
         setlocale(LC_ALL, "");
         log_parse_environment();
@@ -1662,9 +1664,26 @@ int main(int argc, char *argv[]) {
                 }
         }
 
+        flags =
+                arg_all * OUTPUT_SHOW_ALL |
+                arg_full * OUTPUT_FULL_WIDTH |
+                on_tty() * OUTPUT_COLOR |
+                arg_catalog * OUTPUT_CATALOG;
+
+        /* Formatting is what takes the time when exporting, hence do
+         * that on the other CPUs while we keep reading the journal. On
+         * a single CPU that would only add copying. */
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (output_pipeline_supported(arg_output) && ncpus > 1) {
+                r = output_pipeline_new(&pipeline, stdout, arg_output, flags, (unsigned) ncpus);
+                if (r < 0) {
+                        log_error("Failed to set up output: %s", strerror(-r));
+                        goto finish;
+                }
+        }
+
         for (;;) {
                 while (arg_lines < 0 || n_shown < arg_lines || (arg_follow && !first_line)) {
-                        int flags;
 
                         if (need_seek) {
                                 if (!arg_reverse)
@@ -1709,22 +1728,26 @@ int main(int argc, char *argv[]) {
                                 r = sd_journal_get_monotonic_usec(j, NULL, &boot_id);
                                 if (r >= 0) {
                                         if (previous_boot_id_valid &&
-                                            !sd_id128_equal(boot_id, previous_boot_id))
+                                            !sd_id128_equal(boot_id, previous_boot_id)) {
+                                                if (pipeline) {
+                                                        r = output_pipeline_flush(pipeline);
+                                                        if (r < 0)
+                                                                goto finish;
+                                                }
+
                                                 printf("%s-- Reboot --%s\n",
                                                        ansi_highlight(), ansi_highlight_off());
+                                        }
 
                                         previous_boot_id = boot_id;
                                         previous_boot_id_valid = true;
                                 }
                         }
 
-                        flags =
-                                arg_all * OUTPUT_SHOW_ALL |
-                                arg_full * OUTPUT_FULL_WIDTH |
-                                on_tty() * OUTPUT_COLOR |
-                                arg_catalog * OUTPUT_CATALOG;
-
-                        r = output_journal(stdout, j, arg_output, 0, flags, &ellipsized);
+                        if (pipeline)
+                                r = output_pipeline_add(pipeline, j);
+                        else
+                                r = output_journal(stdout, j, arg_output, 0, flags, &ellipsized);
                         need_seek = true;
                         if (r == -EADDRNOTAVAIL)
                                 break;
@@ -1734,6 +1757,12 @@ int main(int argc, char *argv[]) {
                         n_shown++;
                 }
 
+                if (pipeline) {
+                        r = output_pipeline_flush(pipeline);
+                        if (r < 0)
+                                goto finish;
+                }
+
                 if (!arg_follow) {
                         if (arg_show_cursor) {
                                 _cleanup_free_ char *cursor = NULL;
@@ -1748,6 +1777,8 @@ int main(int argc, char *argv[]) {
                         break;
                 }
 
+                fflush(stdout);
+
                 r = sd_journal_wait(j, (uint64_t) -1);
                 if (r < 0) {
                         log_error("Couldn't wait for journal event: %s", strerror(-r));
@@ -1758,6 +1789,18 @@ int main(int argc, char *argv[]) {
         }
 
 finish:
+        if (pipeline) {
+                if (r >= 0) {
+                        int k;
+
+                        k = output_pipeline_flush(pipeline);
+                        if (k < 0)
+                                r = k;
+                }
+
+                output_pipeline_free(pipeline);
+        }
+
         pager_close();
 
         return r < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
@@ -0,0 +1,344 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2026 agent <agent@local>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "list.h"
+#include "compress.h"
+#include "journald-server.h"
+#include "journald-compressor.h"
+
+/* Only fields at least this large are compressed on the compressor
+ * thread, smaller ones are cheap enough to compress inline */
+#define COMPRESSOR_SIZE_MIN (64*1024)
+
+/* How many entries may be in flight before we fall back to
+ * compressing inline */
+#define COMPRESSOR_QUEUE_MAX 64
+
+typedef struct CompressorEntry CompressorEntry;
+
+struct CompressorEntry {
+        uid_t uid;
+        int priority;
+
+        unsigned n_iovec;
+        JournalCompressedData *compressed;
+
+        /* Set by the compressor thread if it failed to compress a
+         * field, for the main loop to log */
+        int error;
+
+        LIST_FIELDS(CompressorEntry, entries);
+
+        struct iovec iovec[];
+};
+
+struct Compressor {
+        Server *server;
+        int compression;
+
+        pthread_t thread;
+
+        /* Signalled by the compressor thread whenever entries are
+         * ready to be written */
+        int event_fd;
+
+        /* Protects the queue fields below */
+        pthread_mutex_t mutex;
+        pthread_cond_t cond;
+
+        LIST_HEAD(CompressorEntry, queue);
+        CompressorEntry *queue_tail;
+
+        LIST_HEAD(CompressorEntry, done);
+        CompressorEntry *done_tail;
+
+        /* Entries queued, being compressed or waiting to be
+         * written */
+        unsigned n_pending;
+        bool quit;
+};
+
+static void compressor_entry_free(CompressorEntry *e) {
+        unsigned i;
+
+        if (!e)
+                return;
+
+        for (i = 0; i < e->n_iovec; i++)
+                free(e->compressed[i].data);
+
+        free(e);
+}
+
+static void compressor_compress_entry(Compressor *c, CompressorEntry *e) {
+        unsigned i;
+
+        assert(c);
+        assert(e);
+
+        for (i = 0; i < e->n_iovec; i++) {
+                JournalCompressedData *d = e->compressed + i;
+                uint64_t rsize;
+
+                if (e->iovec[i].iov_len < COMPRESSOR_SIZE_MIN)
+                        continue;
+
+                d->compression = c->compression;
+
+                /* If this fails or the data doesn't compress, data
+                 * stays NULL and the field is stored as is */
+                d->data = malloc(e->iovec[i].iov_len);
+                if (!d->data) {
+                        e->error = -ENOMEM;
+                        continue;
+                }
+
+                if (compress_blob(c->compression, e->iovec[i].iov_base, e->iovec[i].iov_len, d->data, &rsize))
+                        d->size = rsize;
+                else {
+                        free(d->data);
+                        d->data = NULL;
+                }
+        }
+}
+
+static void *compressor_thread(void *p) {
+        Compressor *c = p;
+
+        assert(c);
+
+        for (;;) {
+                CompressorEntry *e;
+                uint64_t one = 1;
+
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
+
+                while (!c->queue && !c->quit)
+                        assert_se(pthread_cond_wait(&c->cond, &c->mutex) == 0);
+
+                /* We only quit once the queue is empty */
+                e = c->queue;
+                if (e)
+                        LIST_REMOVE(entries, c->queue, e);
+                if (!c->queue)
+                        c->queue_tail = NULL;
+
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+                if (!e)
+                        break;
+
+                compressor_compress_entry(c, e);
+
+                assert_se(pthread_mutex_lock(&c->mutex) == 0);
+                LIST_INSERT_AFTER(entries, c->done, c->done_tail, e);
+                c->done_tail = e;
+                assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+                /* Nothing we could do if this fails, we may not
+                 * even log it */
+                (void) write(c->event_fd, &one, sizeof(one));
+        }
+
+        return NULL;
+}
+
+int compressor_new(Server *s, Compressor **ret) {
+        struct epoll_event ev;
+        Compressor *c;
+        int r;
+
+        assert(s);
+        assert(ret);
+
+        c = new0(Compressor, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->server = s;
+        c->compression = s->compress;
+
+        c->event_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (c->event_fd < 0) {
+                free(c);
+                return -errno;
+        }
+
+        zero(ev);
+        ev.events = EPOLLIN;
+        ev.data.fd = c->event_fd;
+
+        if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, c->event_fd, &ev) < 0) {
+                r = -errno;
+                close_nointr_nofail(c->event_fd);
+                free(c);
+                return r;
+        }
+
+        assert_se(pthread_mutex_init(&c->mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&c->cond, NULL) == 0);
+
+        r = pthread_create(&c->thread, NULL, compressor_thread, c);
+        if (r != 0) {
+                pthread_cond_destroy(&c->cond);
+                pthread_mutex_destroy(&c->mutex);
+                close_nointr_nofail(c->event_fd);
+                free(c);
+                return -r;
+        }
+
+        *ret = c;
+        return 0;
+}
+
+void compressor_free(Compressor *c) {
+        if (!c)
+                return;
+
+        /* Let the thread compress what is still queued, wait for it
+         * to finish, and then write everything out */
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        c->quit = true;
+        assert_se(pthread_cond_signal(&c->cond) == 0);
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        assert_se(pthread_join(c->thread, NULL) == 0);
+
+        compressor_dispatch(c);
+
+        pthread_cond_destroy(&c->cond);
+        pthread_mutex_destroy(&c->mutex);
+
+        close_nointr_nofail(c->event_fd);
+
+        free(c);
+}
+
+int compressor_get_fd(Compressor *c) {
+        assert(c);
+
+        return c->event_fd;
+}
+
+int compressor_enqueue(Compressor *c, uid_t uid, const struct iovec *iovec, unsigned n, int priority) {
+        CompressorEntry *e;
+        bool large = false;
+        unsigned i, n_pending;
+        size_t size;
+        uint8_t *p;
+
+        assert(c);
+        assert(iovec);
+        assert(n > 0);
+
+        /* Returns 0 if the entry should rather be written directly,
+         * and > 0 if it has been queued */
+
+        for (i = 0; i < n; i++)
+                if (iovec[i].iov_len >= COMPRESSOR_SIZE_MIN) {
+                        large = true;
+                        break;
+                }
+
+        if (!large)
+                return 0;
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        n_pending = c->n_pending;
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        if (n_pending >= COMPRESSOR_QUEUE_MAX)
+                return 0;
+
+        /* The compression results and the data are placed after the
+         * iovec array, so that the entry is a single allocation */
+        size = offsetof(CompressorEntry, iovec) + n * (sizeof(struct iovec) + sizeof(JournalCompressedData));
+        for (i = 0; i < n; i++)
+                size += iovec[i].iov_len;
+
+        e = malloc(size);
+        if (!e)
+                return -ENOMEM;
+
+        e->uid = uid;
+        e->priority = priority;
+        e->n_iovec = n;
+        e->error = 0;
+
+        e->compressed = (JournalCompressedData*) (e->iovec + n);
+        memzero(e->compressed, n * sizeof(JournalCompressedData));
+
+        p = (uint8_t*) (e->compressed + n);
+        for (i = 0; i < n; i++) {
+                e->iovec[i].iov_base = p;
+                e->iovec[i].iov_len = iovec[i].iov_len;
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+        }
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+
+        LIST_INSERT_AFTER(entries, c->queue, c->queue_tail, e);
+        c->queue_tail = e;
+        c->n_pending++;
+
+        assert_se(pthread_cond_signal(&c->cond) == 0);
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        return 1;
+}
+
+void compressor_dispatch(Compressor *c) {
+        CompressorEntry *done, *e;
+        uint64_t x;
+        unsigned n = 0;
+
+        assert(c);
+
+        /* Reset the counter; if this fails, there was nothing to
+         * read, which is fine */
+        (void) read(c->event_fd, &x, sizeof(x));
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        done = c->done;
+        c->done = c->done_tail = NULL;
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+
+        /* The entries are timestamped now rather than when they were
+         * received, since entries must be appended in monotonic
+         * order */
+        while ((e = done)) {
+                LIST_REMOVE(entries, done, e);
+
+                if (e->error < 0)
+                        log_error("Failed to compress entry, storing it uncompressed: %s", strerror(-e->error));
+
+                server_write_entry(c->server, e->uid, e->iovec, e->n_iovec, e->compressed, e->priority);
+                compressor_entry_free(e);
+                n++;
+        }
+
+        assert_se(pthread_mutex_lock(&c->mutex) == 0);
+        c->n_pending -= n;
+        assert_se(pthread_mutex_unlock(&c->mutex) == 0);
+}
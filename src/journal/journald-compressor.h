@@ -0,0 +1,34 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  Copyright 2026 agent <agent@local>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/uio.h>
+
+#include "journald-server.h"
+
+int compressor_new(Server *s, Compressor **ret);
+void compressor_free(Compressor *c);
+
+int compressor_get_fd(Compressor *c);
+
+int compressor_enqueue(Compressor *c, uid_t uid, const struct iovec *iovec, unsigned n, int priority);
+void compressor_dispatch(Compressor *c);
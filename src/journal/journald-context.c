@@ -0,0 +1,176 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2026 agent <agent@local>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_SELINUX
+#include <selinux/selinux.h>
+#endif
+
+#include "hashmap.h"
+#include "cgroup-util.h"
+#include "audit.h"
+#include "selinux-util.h"
+#include "journald-context.h"
+
+/* How many processes to keep metadata for at max */
+#define CLIENT_CONTEXTS_MAX 1024
+
+/* After this time we re-read the metadata even if the process is
+ * still the same, since it might have called exec() or changed its
+ * cgroup in the meantime */
+#define CLIENT_CONTEXT_MAX_AGE_USEC (5*USEC_PER_SEC)
+
+static void client_context_reset(ClientContext *c) {
+        assert(c);
+
+        free(c->comm);
+        free(c->exe);
+        free(c->cmdline);
+        free(c->capeff);
+        free(c->cgroup);
+        free(c->session);
+        free(c->unit);
+        free(c->user_unit);
+        free(c->slice);
+        free(c->label);
+
+        c->comm = c->exe = c->cmdline = c->capeff = NULL;
+        c->cgroup = c->session = c->unit = c->user_unit = c->slice = NULL;
+        c->label = NULL;
+
+        c->audit_session_valid = c->loginuid_valid = c->owner_uid_valid = false;
+}
+
+static void client_context_free(ClientContext *c) {
+        if (!c)
+                return;
+
+        client_context_reset(c);
+        free(c);
+}
+
+static void client_context_read(ClientContext *c, unsigned long long starttime, usec_t n) {
+        assert(c);
+
+        client_context_reset(c);
+
+        c->starttime = starttime;
+        c->timestamp = n;
+
+        get_process_comm(c->pid, &c->comm);
+        get_process_exe(c->pid, &c->exe);
+        get_process_cmdline(c->pid, 0, false, &c->cmdline);
+        get_process_capeff(c->pid, &c->capeff);
+
+#ifdef HAVE_AUDIT
+        c->audit_session_valid = audit_session_from_pid(c->pid, &c->audit_session) >= 0;
+        c->loginuid_valid = audit_loginuid_from_pid(c->pid, &c->loginuid) >= 0;
+#endif
+
+        if (cg_pid_get_path_shifted(c->pid, NULL, &c->cgroup) >= 0) {
+                cg_path_get_session(c->cgroup, &c->session);
+                c->owner_uid_valid = cg_path_get_owner_uid(c->cgroup, &c->owner_uid) >= 0;
+                cg_path_get_unit(c->cgroup, &c->unit);
+                cg_path_get_user_unit(c->cgroup, &c->user_unit);
+                cg_path_get_slice(c->cgroup, &c->slice);
+        }
+
+#ifdef HAVE_SELINUX
+        if (use_selinux()) {
+                security_context_t con;
+
+                if (getpidcon(c->pid, &con) >= 0) {
+                        c->label = strdup(con);
+                        freecon(con);
+                }
+        }
+#endif
+}
+
+int client_context_get(Server *s, pid_t pid, ClientContext **ret) {
+        ClientContext *c;
+        unsigned long long st = 0;
+        usec_t n;
+        int r;
+
+        assert(s);
+        assert(ret);
+
+        if (pid <= 0)
+                return -EINVAL;
+
+        n = now(CLOCK_MONOTONIC);
+
+        c = hashmap_get(s->client_contexts, UINT32_TO_PTR(pid));
+        if (c) {
+                /* The PID might have been reused by now, hence
+                 * check that it is still the same process before
+                 * handing out what we have. If the process is
+                 * already gone we cannot refresh anything, so stick
+                 * to what we have as long as it is not too old. */
+                r = get_starttime_of_pid(pid, &st);
+                if ((r < 0 || st == c->starttime) &&
+                    c->timestamp + CLIENT_CONTEXT_MAX_AGE_USEC > n) {
+                        *ret = c;
+                        return 0;
+                }
+
+                client_context_read(c, st, n);
+                *ret = c;
+                return 0;
+        }
+
+        while (hashmap_size(s->client_contexts) >= CLIENT_CONTEXTS_MAX)
+                /* Too many cached? Then let's drop the oldest one */
+                client_context_free(hashmap_steal_first(s->client_contexts));
+
+        c = new0(ClientContext, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->pid = pid;
+
+        r = hashmap_put(s->client_contexts, UINT32_TO_PTR(pid), c);
+        if (r < 0) {
+                free(c);
+                return r;
+        }
+
+        get_starttime_of_pid(pid, &st);
+        client_context_read(c, st, n);
+
+        *ret = c;
+        return 0;
+}
+
+void client_context_flush(Server *s, pid_t pid) {
+        assert(s);
+
+        client_context_free(hashmap_remove(s->client_contexts, UINT32_TO_PTR(pid)));
+}
+
+void client_context_flush_all(Server *s) {
+        ClientContext *c;
+
+        assert(s);
+
+        while ((c = hashmap_steal_first(s->client_contexts)))
+                client_context_free(c);
+}
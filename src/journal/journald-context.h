@@ -0,0 +1,62 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  Copyright 2026 agent <agent@local>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "util.h"
+#include "journald-server.h"
+
+/* Metadata about a sending process, as read from /proc and
+ * cgroupfs. Strings are NULL if they couldn't be determined. */
+typedef struct ClientContext {
+        pid_t pid;
+        unsigned long long starttime;
+
+        usec_t timestamp;
+
+        char *comm;
+        char *exe;
+        char *cmdline;
+        char *capeff;
+
+        uint32_t audit_session;
+        bool audit_session_valid;
+        uid_t loginuid;
+        bool loginuid_valid;
+
+        char *cgroup;
+        char *session;
+        uid_t owner_uid;
+        bool owner_uid_valid;
+        char *unit;
+        char *user_unit;
+        char *slice;
+
+        char *label;
+} ClientContext;
+
+int client_context_get(Server *s, pid_t pid, ClientContext **ret);
+void client_context_flush(Server *s, pid_t pid);
+void client_context_flush_all(Server *s);
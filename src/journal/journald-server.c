@@ -25,6 +25,7 @@
 #include <sys/statvfs.h>
 #include <sys/mman.h>
 #include <sys/timerfd.h>
+#include <sys/eventfd.h>
 
 #include <libudev.h>
 
@@ -44,12 +45,16 @@
 #include "journal-internal.h"
 #include "journal-vacuum.h"
 #include "journal-authenticate.h"
+#include "compress.h"
 #include "journald-rate-limit.h"
 #include "journald-kmsg.h"
 #include "journald-syslog.h"
 #include "journald-stream.h"
 #include "journald-console.h"
 #include "journald-native.h"
+#include "journald-writer.h"
+#include "journald-context.h"
+#include "journald-compressor.h"
 #include "journald-server.h"
 
 #ifdef HAVE_ACL
@@ -70,6 +75,22 @@
 
 #define RECHECK_AVAILABLE_SPACE_USEC (30*USEC_PER_SEC)
 
+/* How many datagrams to receive with a single recvmmsg() call, and
+ * the smallest slot for a datagram received that way. Clients ask for
+ * send buffers of 8M, and pass anything larger as file descriptor. The
+ * slots are made large enough for the biggest datagram such a send
+ * buffer can hold, see datagram_batch_new(). Bigger datagrams are
+ * received one by one. */
+#if __SIZEOF_POINTER__ >= 8
+#define DATAGRAM_BATCH_MAX 32
+#else
+#define DATAGRAM_BATCH_MAX 4
+#endif
+#define DATAGRAM_SLOT_SIZE_MIN (8U*1024U*1024U)
+
+/* Slot memory is returned to the kernel after datagrams of this size */
+#define DATAGRAM_SLOT_RELEASE (64U*1024U)
+
 static const char* const storage_table[] = {
         [STORAGE_AUTO] = "auto",
         [STORAGE_VOLATILE] = "volatile",
@@ -89,6 +110,52 @@ static const char* const split_mode_table[] = {
 DEFINE_STRING_TABLE_LOOKUP(split_mode, SplitMode);
 DEFINE_CONFIG_PARSE_ENUM(config_parse_split_mode, split_mode, SplitMode, "Failed to parse split mode setting");
 
+int config_parse_compress(const char* unit,
+                          const char *filename,
+                          unsigned line,
+                          const char *section,
+                          unsigned section_line,
+                          const char *lvalue,
+                          int ltype,
+                          const char *rvalue,
+                          void *data,
+                          void *userdata) {
+
+        int *compress = data;
+        int k;
+
+        assert(filename);
+        assert(lvalue);
+        assert(rvalue);
+        assert(data);
+
+        /* Either a boolean to pick the default algorithm, or the
+         * name of the algorithm to use */
+
+        k = parse_boolean(rvalue);
+        if (k >= 0) {
+                *compress = k ? DEFAULT_COMPRESSION : 0;
+                return 0;
+        }
+
+        k = object_compressed_from_string(rvalue);
+        if (k < 0) {
+                log_syntax(unit, LOG_ERR, filename, line, EINVAL,
+                           "Failed to parse compression setting, ignoring: %s", rvalue);
+                return 0;
+        }
+
+        if (!compression_supported(k)) {
+                log_syntax(unit, LOG_WARNING, filename, line, EOPNOTSUPP,
+                           "Compression algorithm %s not supported, using default: %s", rvalue,
+                           strna(object_compressed_to_string(DEFAULT_COMPRESSION)));
+                k = DEFAULT_COMPRESSION;
+        }
+
+        *compress = k;
+        return 0;
+}
+
 static uint64_t available_space(Server *s, bool verbose) {
         char ids[33];
         _cleanup_free_ char *p = NULL;
@@ -232,12 +299,37 @@ finish:
 #endif
 }
 
-static JournalFile* find_journal(Server *s, uid_t uid) {
+static int open_user_journal(Server *s, uid_t uid, MMapCache *m, JournalFile **ret) {
         _cleanup_free_ char *p = NULL;
         int r;
         JournalFile *f;
         sd_id128_t machine;
 
+        assert(s);
+        assert(ret);
+
+        r = sd_id128_get_machine(&machine);
+        if (r < 0)
+                return r;
+
+        if (asprintf(&p, "/var/log/journal/" SD_ID128_FORMAT_STR "/user-%lu.journal",
+                     SD_ID128_FORMAT_VAL(machine), (unsigned long) uid) < 0)
+                return -ENOMEM;
+
+        r = journal_file_open_reliably(p, O_RDWR|O_CREAT, 0640, s->compress, s->seal, &s->system_metrics, m, NULL, &f);
+        if (r < 0)
+                return r;
+
+        server_fix_perms(s, f, uid);
+
+        *ret = f;
+        return 0;
+}
+
+static JournalFile* find_journal(Server *s, uid_t uid) {
+        int r;
+        JournalFile *f;
+
         assert(s);
 
         /* We split up user logs only on /var, not on /run. If the
@@ -251,18 +343,10 @@ static JournalFile* find_journal(Server *s, uid_t uid) {
         if (uid <= 0)
                 return s->system_journal;
 
-        r = sd_id128_get_machine(&machine);
-        if (r < 0)
-                return s->system_journal;
-
         f = hashmap_get(s->user_journals, UINT32_TO_PTR(uid));
         if (f)
                 return f;
 
-        if (asprintf(&p, "/var/log/journal/" SD_ID128_FORMAT_STR "/user-%lu.journal",
-                     SD_ID128_FORMAT_VAL(machine), (unsigned long) uid) < 0)
-                return s->system_journal;
-
         while (hashmap_size(s->user_journals) >= USER_JOURNALS_MAX) {
                 /* Too many open? Then let's close one */
                 f = hashmap_steal_first(s->user_journals);
@@ -270,12 +354,10 @@ static JournalFile* find_journal(Server *s, uid_t uid) {
                 journal_file_close(f);
         }
 
-        r = journal_file_open_reliably(p, O_RDWR|O_CREAT, 0640, s->compress, s->seal, &s->system_metrics, s->mmap, NULL, &f);
+        r = open_user_journal(s, uid, s->mmap, &f);
         if (r < 0)
                 return s->system_journal;
 
-        server_fix_perms(s, f, uid);
-
         r = hashmap_put(s->user_journals, UINT32_TO_PTR(uid), f);
         if (r < 0) {
                 journal_file_close(f);
@@ -285,8 +367,58 @@ static JournalFile* find_journal(Server *s, uid_t uid) {
         return f;
 }
 
+static Writer* find_writer(Server *s, uid_t uid) {
+        Writer *w;
+        JournalFile *f;
+        MMapCache *m;
+        int r;
+
+        assert(s);
+        assert(uid > 0);
+
+        w = hashmap_get(s->user_writers, UINT32_TO_PTR(uid));
+        if (w)
+                return w;
+
+        while (hashmap_size(s->user_writers) >= USER_JOURNALS_MAX) {
+                /* Too many running? Then let's stop one */
+                w = hashmap_steal_first(s->user_writers);
+                assert(w);
+                writer_free(w);
+        }
+
+        /* Each writer thread gets its own mmap cache, since the
+         * cache is not thread-safe */
+        m = mmap_cache_new(&s->mmap_policy);
+        if (!m) {
+                log_oom();
+                return NULL;
+        }
+
+        r = open_user_journal(s, uid, m, &f);
+        mmap_cache_unref(m);
+        if (r < 0)
+                return NULL;
+
+        r = writer_new(s, uid, f, &w);
+        if (r < 0) {
+                log_error("Failed to start writer thread for %s: %s", f->path, strerror(-r));
+                journal_file_close(f);
+                return NULL;
+        }
+
+        r = hashmap_put(s->user_writers, UINT32_TO_PTR(uid), w);
+        if (r < 0) {
+                writer_free(w);
+                return NULL;
+        }
+
+        return w;
+}
+
 void server_rotate(Server *s) {
         JournalFile *f;
+        Writer *w;
         void *k;
         Iterator i;
         int r;
@@ -330,11 +462,15 @@ void server_rotate(Server *s) {
                         server_fix_perms(s, f, PTR_TO_UINT32(k));
                 }
         }
+
+        HASHMAP_FOREACH(w, s->user_writers, i)
+                writer_rotate(w);
 }
 
 void server_sync(Server *s) {
         static const struct itimerspec sync_timer_disable = {};
         JournalFile *f;
+        Writer *w;
         void *k;
         Iterator i;
         int r;
@@ -351,6 +487,9 @@ void server_sync(Server *s) {
                         log_error("Failed to sync user journal: %s", strerror(-r));
         }
 
+        HASHMAP_FOREACH(w, s->user_writers, i)
+                writer_sync(w);
+
         r = timerfd_settime(s->sync_timer_fd, 0, &sync_timer_disable, NULL);
         if (r < 0)
                 log_error("Failed to disable max timer: %m");
@@ -394,7 +533,39 @@ void server_vacuum(Server *s) {
         s->cached_available_space_timestamp = 0;
 }
 
-bool shall_try_append_again(JournalFile *f, int r) {
+void server_maybe_vacuum(Server *s) {
+        assert(s);
+
+        /* Writer threads rotate their files themselves, but leave
+         * the vacuuming to us */
+        if (__sync_bool_compare_and_swap(&s->vacuum_requested, true, false))
+                server_vacuum(s);
+}
+
+void server_process_writers(Server *s) {
+        Writer *w;
+        Iterator i;
+        void *k;
+        uint64_t x;
+
+        assert(s);
+
+        /* Reset the counter; if this fails, there was nothing to
+         * read, which is fine */
+        (void) read(s->writer_event_fd, &x, sizeof(x));
+
+        HASHMAP_FOREACH_KEY(w, k, s->user_writers, i)
+                if (writer_process(w) < 0) {
+                        /* The journal file is gone, drop the writer,
+                         * so that the file is opened again for the
+                         * next entry, like server_rotate() does for
+                         * user journals */
+                        hashmap_remove(s->user_writers, k);
+                        writer_free(w);
+                }
+}
+
+const char *shall_try_append_again_reason(int r, int *level) {
 
         /* -E2BIG            Hit configured limit
            -EFBIG            Hit fs limit
@@ -407,23 +578,101 @@ bool shall_try_append_again(JournalFile *f, int r) {
            -ENODATA          Truncated
            -ESHUTDOWN        Already archived */
 
-        if (r == -E2BIG || r == -EFBIG || r == -EDQUOT || r == -ENOSPC)
-                log_debug("%s: Allocation limit reached, rotating.", f->path);
-        else if (r == -EHOSTDOWN)
-                log_info("%s: Journal file from other machine, rotating.", f->path);
-        else if (r == -EBUSY)
-                log_info("%s: Unclean shutdown, rotating.", f->path);
-        else if (r == -EPROTONOSUPPORT)
-                log_info("%s: Unsupported feature, rotating.", f->path);
-        else if (r == -EBADMSG || r == -ENODATA || r == ESHUTDOWN)
-                log_warning("%s: Journal file corrupted, rotating.", f->path);
-        else
+        assert(level);
+
+        if (r == -E2BIG || r == -EFBIG || r == -EDQUOT || r == -ENOSPC) {
+                *level = LOG_DEBUG;
+                return "Allocation limit reached";
+        } else if (r == -EHOSTDOWN) {
+                *level = LOG_INFO;
+                return "Journal file from other machine";
+        } else if (r == -EBUSY) {
+                *level = LOG_INFO;
+                return "Unclean shutdown";
+        } else if (r == -EPROTONOSUPPORT) {
+                *level = LOG_INFO;
+                return "Unsupported feature";
+        } else if (r == -EBADMSG || r == -ENODATA || r == -ESHUTDOWN) {
+                *level = LOG_WARNING;
+                return "Journal file corrupted";
+        }
+
+        return NULL;
+}
+
+bool shall_try_append_again(JournalFile *f, int r) {
+        const char *reason;
+        int level;
+
+        reason = shall_try_append_again_reason(r, &level);
+        if (!reason)
                 return false;
 
+        log_full(level, "%s: %s, rotating.", f->path, reason);
         return true;
 }
 
 static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, unsigned n, int priority) {
+        int r;
+
+        assert(s);
+        assert(iovec);
+        assert(n > 0);
+
+        if (s->writer_threads && uid > 0 && !s->runtime_journal) {
+                Writer *w;
+
+                /* Hand off entries for user journals to the writer
+                 * thread of the user, and fall back to the system
+                 * journal if that doesn't work out. */
+
+                w = find_writer(s, uid);
+                if (w) {
+                        r = writer_enqueue(w, iovec, n, priority);
+                        if (r >= 0) {
+                                /* The writer syncs important messages
+                                 * itself */
+                                if (priority > LOG_CRIT)
+                                        server_schedule_sync(s, priority);
+                                return;
+                        }
+
+                        log_error("Failed to queue entry, writing to system journal: %s", strerror(-r));
+
+                        /* Start over with a new writer for the
+                         * next entry */
+                        hashmap_remove(s->user_writers, UINT32_TO_PTR(uid));
+                        writer_free(w);
+                }
+
+                uid = 0;
+        }
+
+        if (s->compress == OBJECT_COMPRESSED_XZ) {
+
+                /* XZ is slow enough to stall the main loop on large
+                 * fields, hence let the compressor thread do that
+                 * work. LZ4 is fast enough to be done inline. */
+
+                if (!s->compressor) {
+                        r = compressor_new(s, &s->compressor);
+                        if (r < 0)
+                                log_error("Failed to start compressor thread: %s", strerror(-r));
+                }
+
+                if (s->compressor) {
+                        r = compressor_enqueue(s->compressor, uid, iovec, n, priority);
+                        if (r > 0)
+                                return;
+                        if (r < 0)
+                                log_error("Failed to queue entry for compression, writing directly: %s", strerror(-r));
+                }
+        }
+
+        server_write_entry(s, uid, iovec, n, NULL, priority);
+}
+
+void server_write_entry(Server *s, uid_t uid, const struct iovec *iovec, unsigned n, const JournalCompressedData *compressed, int priority) {
         JournalFile *f;
         bool vacuumed = false;
         int r;
@@ -447,7 +696,10 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, unsigned
                         return;
         }
 
-        r = journal_file_append_entry(f, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        if (s->batching)
+                journal_file_begin_batch(f);
+
+        r = journal_file_append_entry_full(f, NULL, iovec, n, compressed, &s->seqnum, NULL, NULL);
         if (r >= 0) {
                 server_schedule_sync(s, priority);
                 return;
@@ -470,8 +722,11 @@ static void write_to_journal(Server *s, uid_t uid, struct iovec *iovec, unsigned
         if (!f)
                 return;
 
+        if (s->batching)
+                journal_file_begin_batch(f);
+
         log_debug("Retrying write.");
-        r = journal_file_append_entry(f, NULL, iovec, n, &s->seqnum, NULL, NULL);
+        r = journal_file_append_entry_full(f, NULL, iovec, n, compressed, &s->seqnum, NULL, NULL);
         if (r < 0) {
                 size_t size = 0;
                 unsigned i;
@@ -511,6 +766,7 @@ static void dispatch_message_real(
         char *t, *c;
         uid_t realuid = 0, owner = 0, journal_uid;
         bool owner_valid = false;
+        ClientContext *cc = NULL;
 #ifdef HAVE_AUDIT
         char    audit_session[sizeof("_AUDIT_SESSION=") + DECIMAL_STR_MAX(uint32_t)],
                 audit_loginuid[sizeof("_AUDIT_LOGINUID=") + DECIMAL_STR_MAX(uid_t)],
@@ -538,94 +794,86 @@ static void dispatch_message_real(
                 sprintf(gid, "_GID=%lu", (unsigned long) ucred->gid);
                 IOVEC_SET_STRING(iovec[n++], gid);
 
-                r = get_process_comm(ucred->pid, &t);
-                if (r >= 0) {
-                        x = strappenda("_COMM=", t);
-                        free(t);
+                /* The sender's PID is 0 if it is not visible in
+                 * our PID namespace, there is nothing to look up
+                 * then */
+                if (ucred->pid > 0) {
+                        r = client_context_get(s, ucred->pid, &cc);
+                        if (r < 0)
+                                cc = NULL;
+                }
+        }
+
+        if (cc) {
+                if (cc->comm) {
+                        x = strappenda("_COMM=", cc->comm);
                         IOVEC_SET_STRING(iovec[n++], x);
                 }
 
-                r = get_process_exe(ucred->pid, &t);
-                if (r >= 0) {
-                        x = strappenda("_EXE=", t);
-                        free(t);
+                if (cc->exe) {
+                        x = strappenda("_EXE=", cc->exe);
                         IOVEC_SET_STRING(iovec[n++], x);
                 }
 
-                r = get_process_cmdline(ucred->pid, 0, false, &t);
-                if (r >= 0) {
-                        x = strappenda("_CMDLINE=", t);
-                        free(t);
+                if (cc->cmdline) {
+                        x = strappenda("_CMDLINE=", cc->cmdline);
                         IOVEC_SET_STRING(iovec[n++], x);
                 }
 
-                r = get_process_capeff(ucred->pid, &t);
-                if (r >= 0) {
-                        x = strappenda("_CAP_EFFECTIVE=", t);
-                        free(t);
+                if (cc->capeff) {
+                        x = strappenda("_CAP_EFFECTIVE=", cc->capeff);
                         IOVEC_SET_STRING(iovec[n++], x);
                 }
 
 #ifdef HAVE_AUDIT
-                r = audit_session_from_pid(ucred->pid, &audit);
-                if (r >= 0) {
-                        sprintf(audit_session, "_AUDIT_SESSION=%lu", (unsigned long) audit);
+                if (cc->audit_session_valid) {
+                        sprintf(audit_session, "_AUDIT_SESSION=%lu", (unsigned long) cc->audit_session);
                         IOVEC_SET_STRING(iovec[n++], audit_session);
                 }
 
-                r = audit_loginuid_from_pid(ucred->pid, &loginuid);
-                if (r >= 0) {
-                        sprintf(audit_loginuid, "_AUDIT_LOGINUID=%lu", (unsigned long) loginuid);
+                if (cc->loginuid_valid) {
+                        sprintf(audit_loginuid, "_AUDIT_LOGINUID=%lu", (unsigned long) cc->loginuid);
                         IOVEC_SET_STRING(iovec[n++], audit_loginuid);
                 }
 #endif
 
-                r = cg_pid_get_path_shifted(ucred->pid, NULL, &c);
-                if (r >= 0) {
-                        char *session = NULL;
-
-                        x = strappenda("_SYSTEMD_CGROUP=", c);
+                if (cc->cgroup) {
+                        x = strappenda("_SYSTEMD_CGROUP=", cc->cgroup);
                         IOVEC_SET_STRING(iovec[n++], x);
 
-                        r = cg_path_get_session(c, &t);
-                        if (r >= 0) {
-                                session = strappenda("_SYSTEMD_SESSION=", t);
-                                free(t);
-                                IOVEC_SET_STRING(iovec[n++], session);
+                        if (cc->session) {
+                                x = strappenda("_SYSTEMD_SESSION=", cc->session);
+                                IOVEC_SET_STRING(iovec[n++], x);
                         }
 
-                        if (cg_path_get_owner_uid(c, &owner) >= 0) {
+                        if (cc->owner_uid_valid) {
+                                owner = cc->owner_uid;
                                 owner_valid = true;
 
                                 sprintf(owner_uid, "_SYSTEMD_OWNER_UID=%lu", (unsigned long) owner);
                                 IOVEC_SET_STRING(iovec[n++], owner_uid);
                         }
 
-                        if (cg_path_get_unit(c, &t) >= 0) {
-                                x = strappenda("_SYSTEMD_UNIT=", t);
-                                free(t);
+                        if (cc->unit) {
+                                x = strappenda("_SYSTEMD_UNIT=", cc->unit);
                                 IOVEC_SET_STRING(iovec[n++], x);
-                        } else if (unit_id && !session) {
+                        } else if (unit_id && !cc->session) {
                                 x = strappenda("_SYSTEMD_UNIT=", unit_id);
                                 IOVEC_SET_STRING(iovec[n++], x);
                         }
 
-                        if (cg_path_get_user_unit(c, &t) >= 0) {
-                                x = strappenda("_SYSTEMD_USER_UNIT=", t);
-                                free(t);
+                        if (cc->user_unit) {
+                                x = strappenda("_SYSTEMD_USER_UNIT=", cc->user_unit);
                                 IOVEC_SET_STRING(iovec[n++], x);
-                        } else if (unit_id && session) {
+                        } else if (unit_id && cc->session) {
                                 x = strappenda("_SYSTEMD_USER_UNIT=", unit_id);
                                 IOVEC_SET_STRING(iovec[n++], x);
                         }
 
-                        if (cg_path_get_slice(c, &t) >= 0) {
-                                x = strappenda("_SYSTEMD_SLICE=", t);
-                                free(t);
+                        if (cc->slice) {
+                                x = strappenda("_SYSTEMD_SLICE=", cc->slice);
                                 IOVEC_SET_STRING(iovec[n++], x);
                         }
-
-                        free(c);
                 }
 
 #ifdef HAVE_SELINUX
@@ -635,15 +883,9 @@ static void dispatch_message_real(
 
                                 *((char*) mempcpy(stpcpy(x, "_SELINUX_CONTEXT="), label, label_len)) = 0;
                                 IOVEC_SET_STRING(iovec[n++], x);
-                        } else {
-                                security_context_t con;
-
-                                if (getpidcon(ucred->pid, &con) >= 0) {
-                                        x = strappenda("_SELINUX_CONTEXT=", con);
-
-                                        freecon(con);
-                                        IOVEC_SET_STRING(iovec[n++], x);
-                                }
+                        } else if (cc->label) {
+                                x = strappenda("_SELINUX_CONTEXT=", cc->label);
+                                IOVEC_SET_STRING(iovec[n++], x);
                         }
                 }
 #endif
@@ -823,8 +1065,9 @@ void server_dispatch_message(
                 pid_t object_pid) {
 
         int rl, r;
-        _cleanup_free_ char *path = NULL;
-        char *c;
+        ClientContext *cc;
+        _cleanup_free_ char *uncached = NULL;
+        char *path, *c;
 
         assert(s);
         assert(iovec || n == 0);
@@ -843,9 +1086,21 @@ void server_dispatch_message(
         if (!ucred)
                 goto finish;
 
-        r = cg_pid_get_path_shifted(ucred->pid, NULL, &path);
-        if (r < 0)
-                goto finish;
+        if (ucred->pid > 0) {
+                r = client_context_get(s, ucred->pid, &cc);
+                if (r < 0 || !cc->cgroup)
+                        goto finish;
+
+                path = strdupa(cc->cgroup);
+        } else {
+                /* Senders outside of our PID namespace have no
+                 * PID we could cache their metadata under */
+                r = cg_pid_get_path_shifted(ucred->pid, NULL, &uncached);
+                if (r < 0)
+                        goto finish;
+
+                path = uncached;
+        }
 
         /* example: /user/lennart/3/foobar
          *          /system/dbus.service/foobar
@@ -1064,6 +1319,273 @@ finish:
         return r;
 }
 
+typedef union DatagramControl {
+        struct cmsghdr cmsghdr;
+
+        /* We use NAME_MAX space for the SELinux label here. The
+         * kernel currently enforces no limit, but according to
+         * suggestions from the SELinux people this will change and
+         * it will probably be identical to NAME_MAX. For now we use
+         * that, but this should be updated one day when the final
+         * limit is known.*/
+        uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
+                    CMSG_SPACE(sizeof(struct timeval)) +
+                    CMSG_SPACE(sizeof(int)) + /* fd */
+                    CMSG_SPACE(NAME_MAX)]; /* selinux label */
+} DatagramControl;
+
+struct DatagramBatch {
+        struct mmsghdr msgs[DATAGRAM_BATCH_MAX];
+        struct iovec iovecs[DATAGRAM_BATCH_MAX];
+        DatagramControl controls[DATAGRAM_BATCH_MAX];
+
+        /* DATAGRAM_BATCH_MAX slots of slot_size bytes each, only
+         * backed by memory where datagrams were written to */
+        uint8_t *slots;
+        size_t slot_size;
+};
+
+static void datagram_batch_free(DatagramBatch *b) {
+        if (!b)
+                return;
+
+        if (b->slots)
+                munmap(b->slots, DATAGRAM_BATCH_MAX * b->slot_size);
+
+        free(b);
+}
+
+static size_t datagram_slot_size(void) {
+        _cleanup_free_ char *line = NULL;
+        unsigned wmem_max;
+
+        /* Senders may raise their send buffer up to wmem_max, which
+         * the kernel doubles for bookkeeping overhead. That bounds
+         * the datagram size for everybody but privileged senders
+         * using SO_SNDBUFFORCE. */
+        if (read_one_line_file("/proc/sys/net/core/wmem_max", &line) < 0 ||
+            safe_atou(line, &wmem_max) < 0)
+                return DATAGRAM_SLOT_SIZE_MIN;
+
+        return PAGE_ALIGN(MAX((size_t) wmem_max * 2, (size_t) DATAGRAM_SLOT_SIZE_MIN));
+}
+
+static int datagram_batch_new(DatagramBatch **ret) {
+        DatagramBatch *b;
+        unsigned i;
+
+        assert(ret);
+
+        b = new0(DatagramBatch, 1);
+        if (!b)
+                return -ENOMEM;
+
+        b->slot_size = datagram_slot_size();
+        b->slots = mmap(NULL, DATAGRAM_BATCH_MAX * b->slot_size, PROT_READ|PROT_WRITE,
+                        MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+        if (b->slots == MAP_FAILED) {
+                b->slots = NULL;
+                datagram_batch_free(b);
+                return -errno;
+        }
+
+        for (i = 0; i < DATAGRAM_BATCH_MAX; i++) {
+                /* Leave room for the trailing NUL of syslog
+                 * messages */
+                b->iovecs[i].iov_base = b->slots + i * b->slot_size;
+                b->iovecs[i].iov_len = b->slot_size - 1;
+
+                b->msgs[i].msg_hdr.msg_iov = b->iovecs + i;
+                b->msgs[i].msg_hdr.msg_iovlen = 1;
+                b->msgs[i].msg_hdr.msg_control = b->controls + i;
+        }
+
+        *ret = b;
+        return 0;
+}
+
+static void server_close_datagram_fds(struct msghdr *msghdr) {
+        struct cmsghdr *cmsg;
+
+        assert(msghdr);
+
+        for (cmsg = CMSG_FIRSTHDR(msghdr); cmsg; cmsg = CMSG_NXTHDR(msghdr, cmsg))
+                if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_RIGHTS)
+                        close_many((int*) CMSG_DATA(cmsg), (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+}
+
+static void server_dispatch_datagram(Server *s, int fd, struct msghdr *msghdr, char *buffer, size_t n) {
+        struct ucred *ucred = NULL;
+        struct timeval *tv = NULL;
+        struct cmsghdr *cmsg;
+        char *label = NULL;
+        size_t label_len = 0;
+        int *fds = NULL;
+        unsigned n_fds = 0;
+
+        assert(s);
+        assert(msghdr);
+        assert(buffer);
+
+        /* The buffer needs to have room for one more byte after the
+         * message */
+
+        for (cmsg = CMSG_FIRSTHDR(msghdr); cmsg; cmsg = CMSG_NXTHDR(msghdr, cmsg)) {
+
+                if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_CREDENTIALS &&
+                    cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred)))
+                        ucred = (struct ucred*) CMSG_DATA(cmsg);
+                else if (cmsg->cmsg_level == SOL_SOCKET &&
+                         cmsg->cmsg_type == SCM_SECURITY) {
+                        label = (char*) CMSG_DATA(cmsg);
+                        label_len = cmsg->cmsg_len - CMSG_LEN(0);
+                } else if (cmsg->cmsg_level == SOL_SOCKET &&
+                           cmsg->cmsg_type == SO_TIMESTAMP &&
+                           cmsg->cmsg_len == CMSG_LEN(sizeof(struct timeval)))
+                        tv = (struct timeval*) CMSG_DATA(cmsg);
+                else if (cmsg->cmsg_level == SOL_SOCKET &&
+                         cmsg->cmsg_type == SCM_RIGHTS) {
+                        fds = (int*) CMSG_DATA(cmsg);
+                        n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                }
+        }
+
+        if (fd == s->syslog_fd) {
+                if (n > 0 && n_fds == 0) {
+                        buffer[n] = 0;
+                        server_process_syslog_message(s, strstrip(buffer), ucred, tv, label, label_len);
+                } else if (n_fds > 0)
+                        log_warning("Got file descriptors via syslog socket. Ignoring.");
+
+        } else {
+                if (n > 0 && n_fds == 0)
+                        server_process_native_message(s, buffer, n, ucred, tv, label, label_len);
+                else if (n == 0 && n_fds == 1)
+                        server_process_native_file(s, fds[0], ucred, tv, label, label_len);
+                else if (n_fds > 0)
+                        log_warning("Got too many file descriptors via native socket. Ignoring.");
+        }
+
+        close_many(fds, n_fds);
+}
+
+static int server_receive_datagram(Server *s, int fd, size_t size) {
+        DatagramControl control = {};
+        struct iovec iovec;
+        struct msghdr msghdr = {
+                .msg_iov = &iovec,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        ssize_t n;
+
+        assert(s);
+
+        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, LINE_MAX + size))
+                return log_oom();
+
+        iovec.iov_base = s->buffer;
+        iovec.iov_len = s->buffer_size - 1;
+
+        n = recvmsg(fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+        if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN)
+                        return 0;
+
+                log_error("recvmsg() failed: %m");
+                return -errno;
+        }
+
+        if (msghdr.msg_flags & MSG_TRUNC) {
+                log_warning("Got datagram larger than %zu bytes, ignoring.", iovec.iov_len);
+                server_close_datagram_fds(&msghdr);
+                return 1;
+        }
+
+        server_dispatch_datagram(s, fd, &msghdr, s->buffer, n);
+        return 1;
+}
+
+static int server_process_datagrams(Server *s, int fd) {
+        DatagramBatch *b;
+        unsigned i;
+        int n, v, r;
+
+        assert(s);
+
+        if (!s->datagram_batch) {
+                r = datagram_batch_new(&s->datagram_batch);
+                if (r < 0) {
+                        log_error("Failed to allocate datagram buffers: %s", strerror(-r));
+                        return r;
+                }
+        }
+
+        b = s->datagram_batch;
+
+        for (;;) {
+                /* This tells us the size of the next datagram
+                 * only. If that one doesn't fit into a slot, take it
+                 * on its own. */
+                if (ioctl(fd, SIOCINQ, &v) < 0) {
+                        log_error("SIOCINQ failed: %m");
+                        return -errno;
+                }
+
+                if ((size_t) v >= b->slot_size) {
+                        r = server_receive_datagram(s, fd, v);
+                        if (r <= 0)
+                                return r < 0 ? r : 1;
+
+                        continue;
+                }
+
+                for (i = 0; i < DATAGRAM_BATCH_MAX; i++)
+                        b->msgs[i].msg_hdr.msg_controllen = sizeof(DatagramControl);
+
+                n = recvmmsg(fd, b->msgs, DATAGRAM_BATCH_MAX, MSG_DONTWAIT|MSG_CMSG_CLOEXEC, NULL);
+                if (n < 0) {
+                        if (errno == EINTR || errno == EAGAIN)
+                                return 1;
+
+                        log_error("recvmmsg() failed: %m");
+                        return -errno;
+                }
+
+                for (i = 0; i < (unsigned) n; i++) {
+                        struct msghdr *msghdr = &b->msgs[i].msg_hdr;
+                        size_t l = b->msgs[i].msg_len;
+
+                        /* Only a privileged sender can get a datagram
+                         * past the slot size, and only if it wasn't
+                         * at the head of the queue. Whatever is left
+                         * of it is useless, and any file descriptor
+                         * with it must not be mistaken for a
+                         * memfd. */
+                        if (msghdr->msg_flags & MSG_TRUNC) {
+                                log_warning("Got datagram larger than %zu bytes, ignoring.", b->slot_size - 1);
+                                server_close_datagram_fds(msghdr);
+                                (void) madvise(msghdr->msg_iov->iov_base, b->slot_size, MADV_DONTNEED);
+                                continue;
+                        }
+
+                        server_dispatch_datagram(s, fd, msghdr, msghdr->msg_iov->iov_base, l);
+
+                        /* Give back memory used by large datagrams */
+                        if (l >= DATAGRAM_SLOT_RELEASE)
+                                (void) madvise(msghdr->msg_iov->iov_base, PAGE_ALIGN(l + 1), MADV_DONTNEED);
+                }
+
+                /* If we didn't fill the batch the socket is most
+                 * likely drained, and if not epoll will tell us */
+                if (n < DATAGRAM_BATCH_MAX)
+                        return 1;
+        }
+}
+
 int process_event(Server *s, struct epoll_event *ev) {
         assert(s);
         assert(ev);
@@ -1152,103 +1674,28 @@ int process_event(Server *s, struct epoll_event *ev) {
                         return -EIO;
                 }
 
-                for (;;) {
-                        struct ucred *ucred = NULL;
-                        struct timeval *tv = NULL;
-                        struct cmsghdr *cmsg;
-                        char *label = NULL;
-                        size_t label_len = 0;
-
-                        struct iovec iovec;
-                        union {
-                                struct cmsghdr cmsghdr;
-
-                                /* We use NAME_MAX space for the
-                                 * SELinux label here. The kernel
-                                 * currently enforces no limit, but
-                                 * according to suggestions from the
-                                 * SELinux people this will change and
-                                 * it will probably be identical to
-                                 * NAME_MAX. For now we use that, but
-                                 * this should be updated one day when
-                                 * the final limit is known.*/
-                                uint8_t buf[CMSG_SPACE(sizeof(struct ucred)) +
-                                            CMSG_SPACE(sizeof(struct timeval)) +
-                                            CMSG_SPACE(sizeof(int)) + /* fd */
-                                            CMSG_SPACE(NAME_MAX)]; /* selinux label */
-                        } control = {};
-                        struct msghdr msghdr = {
-                                .msg_iov = &iovec,
-                                .msg_iovlen = 1,
-                                .msg_control = &control,
-                                .msg_controllen = sizeof(control),
-                        };
-
-                        ssize_t n;
-                        int v;
-                        int *fds = NULL;
-                        unsigned n_fds = 0;
-
-                        if (ioctl(ev->data.fd, SIOCINQ, &v) < 0) {
-                                log_error("SIOCINQ failed: %m");
-                                return -errno;
-                        }
-
-                        if (!GREEDY_REALLOC(s->buffer, s->buffer_size, LINE_MAX + (size_t) v))
-                                return log_oom();
+                return server_process_datagrams(s, ev->data.fd);
 
-                        iovec.iov_base = s->buffer;
-                        iovec.iov_len = s->buffer_size;
+        } else if (s->compressor && ev->data.fd == compressor_get_fd(s->compressor)) {
 
-                        n = recvmsg(ev->data.fd, &msghdr, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
-                        if (n < 0) {
-                                if (errno == EINTR || errno == EAGAIN)
-                                        return 1;
-
-                                log_error("recvmsg() failed: %m");
-                                return -errno;
-                        }
+                if (ev->events != EPOLLIN) {
+                        log_error("Got invalid event from epoll for %s: %"PRIx32,
+                                  "compressor fd", ev->events);
+                        return -EIO;
+                }
 
-                        for (cmsg = CMSG_FIRSTHDR(&msghdr); cmsg; cmsg = CMSG_NXTHDR(&msghdr, cmsg)) {
-
-                                if (cmsg->cmsg_level == SOL_SOCKET &&
-                                    cmsg->cmsg_type == SCM_CREDENTIALS &&
-                                    cmsg->cmsg_len == CMSG_LEN(sizeof(struct ucred)))
-                                        ucred = (struct ucred*) CMSG_DATA(cmsg);
-                                else if (cmsg->cmsg_level == SOL_SOCKET &&
-                                         cmsg->cmsg_type == SCM_SECURITY) {
-                                        label = (char*) CMSG_DATA(cmsg);
-                                        label_len = cmsg->cmsg_len - CMSG_LEN(0);
-                                } else if (cmsg->cmsg_level == SOL_SOCKET &&
-                                           cmsg->cmsg_type == SO_TIMESTAMP &&
-                                           cmsg->cmsg_len == CMSG_LEN(sizeof(struct timeval)))
-                                        tv = (struct timeval*) CMSG_DATA(cmsg);
-                                else if (cmsg->cmsg_level == SOL_SOCKET &&
-                                         cmsg->cmsg_type == SCM_RIGHTS) {
-                                        fds = (int*) CMSG_DATA(cmsg);
-                                        n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
-                                }
-                        }
+                compressor_dispatch(s->compressor);
+                return 1;
 
-                        if (ev->data.fd == s->syslog_fd) {
-                                if (n > 0 && n_fds == 0) {
-                                        s->buffer[n] = 0;
-                                        server_process_syslog_message(s, strstrip(s->buffer), ucred, tv, label, label_len);
-                                } else if (n_fds > 0)
-                                        log_warning("Got file descriptors via syslog socket. Ignoring.");
-
-                        } else {
-                                if (n > 0 && n_fds == 0)
-                                        server_process_native_message(s, s->buffer, n, ucred, tv, label, label_len);
-                                else if (n == 0 && n_fds == 1)
-                                        server_process_native_file(s, fds[0], ucred, tv, label, label_len);
-                                else if (n_fds > 0)
-                                        log_warning("Got too many file descriptors via native socket. Ignoring.");
-                        }
+        } else if (ev->data.fd == s->writer_event_fd) {
 
-                        close_many(fds, n_fds);
+                if (ev->events != EPOLLIN) {
+                        log_error("Got invalid event from epoll for %s: %"PRIx32,
+                                  "writer event fd", ev->events);
+                        return -EIO;
                 }
 
+                server_process_writers(s);
                 return 1;
 
         } else if (ev->data.fd == s->stdout_fd) {
@@ -1290,6 +1737,34 @@ int process_event(Server *s, struct epoll_event *ev) {
         return 0;
 }
 
+void server_begin_batch(Server *s) {
+        assert(s);
+
+        /* All entries written until server_end_batch() is called
+         * are committed together, and readers are notified only
+         * once per journal file. */
+
+        s->batching = true;
+}
+
+void server_end_batch(Server *s) {
+        JournalFile *f;
+        Iterator i;
+
+        assert(s);
+
+        s->batching = false;
+
+        if (s->runtime_journal)
+                journal_file_end_batch(s->runtime_journal);
+
+        if (s->system_journal)
+                journal_file_end_batch(s->system_journal);
+
+        HASHMAP_FOREACH(f, s->user_journals, i)
+                journal_file_end_batch(f);
+}
+
 static int open_signalfd(Server *s) {
         sigset_t mask;
         struct epoll_event ev;
@@ -1409,6 +1884,32 @@ static int server_open_sync_timer(Server *s) {
         return 0;
 }
 
+static int server_open_writer_event_fd(Server *s) {
+        struct epoll_event ev;
+        int r;
+
+        assert(s);
+
+        if (!s->writer_threads)
+                return 0;
+
+        s->writer_event_fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (s->writer_event_fd < 0)
+                return -errno;
+
+        zero(ev);
+        ev.events = EPOLLIN;
+        ev.data.fd = s->writer_event_fd;
+
+        r = epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, s->writer_event_fd, &ev);
+        if (r < 0) {
+                log_error("Failed to add writer event fd to epoll object: %m");
+                return -errno;
+        }
+
+        return 0;
+}
+
 int server_schedule_sync(Server *s, int priority) {
         int r;
 
@@ -1445,8 +1946,8 @@ int server_init(Server *s) {
 
         zero(*s);
         s->sync_timer_fd = s->syslog_fd = s->native_fd = s->stdout_fd =
-                s->signal_fd = s->epoll_fd = s->dev_kmsg_fd = -1;
-        s->compress = true;
+                s->signal_fd = s->epoll_fd = s->dev_kmsg_fd = s->writer_event_fd = -1;
+        s->compress = DEFAULT_COMPRESSION;
         s->seal = true;
 
         s->sync_interval_usec = DEFAULT_SYNC_INTERVAL_USEC;
@@ -1480,7 +1981,22 @@ int server_init(Server *s) {
         if (!s->user_journals)
                 return log_oom();
 
-        s->mmap = mmap_cache_new();
+        s->user_writers = hashmap_new(trivial_hash_func, trivial_compare_func);
+        if (!s->user_writers)
+                return log_oom();
+
+        s->client_contexts = hashmap_new(trivial_hash_func, trivial_compare_func);
+        if (!s->client_contexts)
+                return log_oom();
+
+        /* We mostly append to the end of files and look up hash
+         * table items, neither of which profits from large windows,
+         * which would stay mapped for our whole lifetime however */
+        s->mmap_policy = mmap_cache_policy_default;
+        s->mmap_policy.window_size_max = s->mmap_policy.window_size;
+        s->mmap_policy.prefetch = false;
+
+        s->mmap = mmap_cache_new(&s->mmap_policy);
         if (!s->mmap)
                 return log_oom();
 
@@ -1555,6 +2071,10 @@ int server_init(Server *s) {
         if (r < 0)
                 return r;
 
+        r = server_open_writer_event_fd(s);
+        if (r < 0)
+                return r;
+
         r = open_signalfd(s);
         if (r < 0)
                 return r;
@@ -1578,6 +2098,7 @@ int server_init(Server *s) {
 void server_maybe_append_tags(Server *s) {
 #ifdef HAVE_GCRYPT
         JournalFile *f;
+        Writer *w;
         Iterator i;
         usec_t n;
 
@@ -1588,16 +2109,32 @@ void server_maybe_append_tags(Server *s) {
 
         HASHMAP_FOREACH(f, s->user_journals, i)
                 journal_file_maybe_append_tag(f, n);
+
+        HASHMAP_FOREACH(w, s->user_writers, i)
+                writer_maybe_append_tag(w, n);
 #endif
 }
 
 void server_done(Server *s) {
         JournalFile *f;
+        Writer *w;
         assert(s);
 
         while (s->stdout_streams)
                 stdout_stream_free(s->stdout_streams);
 
+        client_context_flush_all(s);
+        hashmap_free(s->client_contexts);
+
+        /* Write out what is still being compressed before the
+         * journal files are closed */
+        compressor_free(s->compressor);
+
+        while ((w = hashmap_steal_first(s->user_writers)))
+                writer_free(w);
+
+        hashmap_free(s->user_writers);
+
         if (s->system_journal)
                 journal_file_close(s->system_journal);
 
@@ -1630,6 +2167,9 @@ void server_done(Server *s) {
         if (s->sync_timer_fd >= 0)
                 close_nointr_nofail(s->sync_timer_fd);
 
+        if (s->writer_event_fd >= 0)
+                close_nointr_nofail(s->writer_event_fd);
+
         if (s->rate_limit)
                 journal_rate_limit_free(s->rate_limit);
 
@@ -1637,6 +2177,7 @@ void server_done(Server *s) {
                 munmap(s->kernel_seqnum, sizeof(uint64_t));
 
         free(s->buffer);
+        datagram_batch_free(s->datagram_batch);
         free(s->tty_path);
 
         if (s->mmap)
@@ -52,6 +52,8 @@ typedef enum SplitMode {
 } SplitMode;
 
 typedef struct StdoutStream StdoutStream;
+typedef struct Compressor Compressor;
+typedef struct DatagramBatch DatagramBatch;
 
 typedef struct Server {
         int epoll_fd;
@@ -64,11 +66,15 @@ typedef struct Server {
         JournalFile *runtime_journal;
         JournalFile *system_journal;
         Hashmap *user_journals;
+        Hashmap *user_writers;
+
+        Hashmap *client_contexts;
 
         uint64_t seqnum;
 
         char *buffer;
         size_t buffer_size;
+        DatagramBatch *datagram_batch;
 
         JournalRateLimit *rate_limit;
         usec_t sync_interval_usec;
@@ -78,7 +84,7 @@ typedef struct Server {
         JournalMetrics runtime_metrics;
         JournalMetrics system_metrics;
 
-        bool compress;
+        int compress;
         bool seal;
 
         bool forward_to_kmsg;
@@ -110,7 +116,17 @@ typedef struct Server {
         Storage storage;
         SplitMode split_mode;
 
+        bool writer_threads;
+        bool vacuum_requested;
+
+        /* Woken up by writer threads that have something for the
+         * main loop to do */
+        int writer_event_fd;
+
+        Compressor *compressor;
+
         MMapCache *mmap;
+        MMapCachePolicy mmap_policy;
 
         bool dev_kmsg_readable;
 
@@ -120,6 +136,8 @@ typedef struct Server {
 
         int sync_timer_fd;
         bool sync_scheduled;
+
+        bool batching;
 } Server;
 
 #define N_IOVEC_META_FIELDS 20
@@ -143,14 +161,22 @@ int config_parse_split_mode(const char *unit, const char *filename, unsigned lin
 const char *split_mode_to_string(SplitMode s) _const_;
 SplitMode split_mode_from_string(const char *s) _pure_;
 
+int config_parse_compress(const char *unit, const char *filename, unsigned line, const char *section, unsigned section_line, const char *lvalue, int ltype, const char *rvalue, void *data, void *userdata);
+
 void server_fix_perms(Server *s, JournalFile *f, uid_t uid);
+const char *shall_try_append_again_reason(int r, int *level);
 bool shall_try_append_again(JournalFile *f, int r);
 int server_init(Server *s);
 void server_done(Server *s);
 void server_sync(Server *s);
 void server_vacuum(Server *s);
+void server_maybe_vacuum(Server *s);
+void server_process_writers(Server *s);
 void server_rotate(Server *s);
 int server_schedule_sync(Server *s, int priority);
+void server_write_entry(Server *s, uid_t uid, const struct iovec *iovec, unsigned n, const JournalCompressedData *compressed, int priority);
 int server_flush_to_var(Server *s);
 int process_event(Server *s, struct epoll_event *ev);
+void server_begin_batch(Server *s);
+void server_end_batch(Server *s);
 void server_maybe_append_tags(Server *s);
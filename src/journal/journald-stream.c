@@ -35,6 +35,7 @@
 #include "journald-syslog.h"
 #include "journald-kmsg.h"
 #include "journald-console.h"
+#include "journald-context.h"
 
 #define STDOUT_STREAMS_MAX 4096
 
@@ -63,6 +64,13 @@ struct StdoutStream {
         char *identifier;
         char *unit_id;
         int priority;
+
+        /* The fields that are the same for every line, serialized
+         * once when the stream enters STDOUT_STREAM_RUNNING */
+        char *syslog_identifier;
+        char syslog_priority[sizeof("PRIORITY=") + DECIMAL_STR_MAX(int)];
+        char syslog_facility[sizeof("SYSLOG_FACILITY=") + DECIMAL_STR_MAX(int)];
+
         bool level_prefix:1;
         bool forward_to_syslog:1;
         bool forward_to_kmsg:1;
@@ -74,9 +82,34 @@ struct StdoutStream {
         LIST_FIELDS(StdoutStream, stdout_stream);
 };
 
+static void stdout_stream_format_priority(int priority, char *syslog_priority, char *syslog_facility) {
+        sprintf(syslog_priority, "PRIORITY=%i", priority & LOG_PRIMASK);
+
+        if (priority & LOG_FACMASK)
+                sprintf(syslog_facility, "SYSLOG_FACILITY=%i", LOG_FAC(priority));
+        else
+                syslog_facility[0] = 0;
+}
+
+static int stdout_stream_setup_fields(StdoutStream *s) {
+        assert(s);
+
+        if (s->identifier) {
+                s->syslog_identifier = strappend("SYSLOG_IDENTIFIER=", s->identifier);
+                if (!s->syslog_identifier)
+                        return log_oom();
+        }
+
+        stdout_stream_format_priority(s->priority, s->syslog_priority, s->syslog_facility);
+        return 0;
+}
+
 static int stdout_stream_log(StdoutStream *s, const char *p) {
         struct iovec iovec[N_IOVEC_META_FIELDS + 5];
-        char *message = NULL, *syslog_priority = NULL, *syslog_facility = NULL, *syslog_identifier = NULL;
+        char syslog_priority[sizeof("PRIORITY=") + DECIMAL_STR_MAX(int)],
+             syslog_facility[sizeof("SYSLOG_FACILITY=") + DECIMAL_STR_MAX(int)];
+        const char *priority_field, *facility_field;
+        char *message;
         unsigned n = 0;
         int priority;
         char *label = NULL;
@@ -102,24 +135,29 @@ static int stdout_stream_log(StdoutStream *s, const char *p) {
         if (s->forward_to_console || s->server->forward_to_console)
                 server_forward_console(s->server, priority, s->identifier, p, &s->ucred);
 
+        /* Only lines carrying their own level prefix need their
+         * priority fields formatted individually */
+        if (priority == s->priority) {
+                priority_field = s->syslog_priority;
+                facility_field = s->syslog_facility;
+        } else {
+                stdout_stream_format_priority(priority, syslog_priority, syslog_facility);
+                priority_field = syslog_priority;
+                facility_field = syslog_facility;
+        }
+
         IOVEC_SET_STRING(iovec[n++], "_TRANSPORT=stdout");
+        IOVEC_SET_STRING(iovec[n++], priority_field);
 
-        if (asprintf(&syslog_priority, "PRIORITY=%i", priority & LOG_PRIMASK) >= 0)
-                IOVEC_SET_STRING(iovec[n++], syslog_priority);
+        if (facility_field[0])
+                IOVEC_SET_STRING(iovec[n++], facility_field);
 
-        if (priority & LOG_FACMASK)
-                if (asprintf(&syslog_facility, "SYSLOG_FACILITY=%i", LOG_FAC(priority)) >= 0)
-                        IOVEC_SET_STRING(iovec[n++], syslog_facility);
+        if (s->syslog_identifier)
+                IOVEC_SET_STRING(iovec[n++], s->syslog_identifier);
 
-        if (s->identifier) {
-                syslog_identifier = strappend("SYSLOG_IDENTIFIER=", s->identifier);
-                if (syslog_identifier)
-                        IOVEC_SET_STRING(iovec[n++], syslog_identifier);
-        }
-
-        message = strappend("MESSAGE=", p);
-        if (message)
-                IOVEC_SET_STRING(iovec[n++], message);
+        /* Lines are bounded by LINE_MAX, so this is fine on the stack */
+        message = strappenda("MESSAGE=", p);
+        IOVEC_SET_STRING(iovec[n++], message);
 
 #ifdef HAVE_SELINUX
         if (s->security_context) {
@@ -129,12 +167,6 @@ static int stdout_stream_log(StdoutStream *s, const char *p) {
 #endif
 
         server_dispatch_message(s->server, iovec, n, ELEMENTSOF(iovec), &s->ucred, NULL, label, label_len, s->unit_id, priority, 0);
-
-        free(message);
-        free(syslog_priority);
-        free(syslog_facility);
-        free(syslog_identifier);
-
         return 0;
 }
 
@@ -225,6 +257,11 @@ static int stdout_stream_line(StdoutStream *s, char *p) {
                 }
 
                 s->forward_to_console = !!r;
+
+                r = stdout_stream_setup_fields(s);
+                if (r < 0)
+                        return r;
+
                 s->state = STDOUT_STREAM_RUNNING;
                 return 0;
 
@@ -325,6 +362,11 @@ void stdout_stream_free(StdoutStream *s) {
                 assert(s->server->n_stdout_streams > 0);
                 s->server->n_stdout_streams --;
                 LIST_REMOVE(stdout_stream, s->server->stdout_streams, s);
+
+                /* The process is likely to go away with its stream,
+                 * so don't keep its metadata around */
+                if (s->ucred.pid > 0)
+                        client_context_flush(s->server, s->ucred.pid);
         }
 
         if (s->fd >= 0) {
@@ -340,6 +382,8 @@ void stdout_stream_free(StdoutStream *s) {
 #endif
 
         free(s->identifier);
+        free(s->unit_id);
+        free(s->syslog_identifier);
         free(s);
 }
 
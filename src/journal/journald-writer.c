@@ -0,0 +1,472 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2026 agent <agent@local>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pthread.h>
+#include <syslog.h>
+
+#include "list.h"
+#include "journal-authenticate.h"
+#include "journald-server.h"
+#include "journald-writer.h"
+
+/* How many entries may be queued for a writer before we make the
+ * main loop wait for the writer thread to catch up */
+#define WRITER_QUEUE_MAX 4096
+
+typedef struct WriterEntry WriterEntry;
+
+struct WriterEntry {
+        dual_timestamp ts;
+        int priority;
+
+        unsigned n_iovec;
+
+        LIST_FIELDS(WriterEntry, entries);
+
+        struct iovec iovec[];
+};
+
+typedef struct WriterMessage WriterMessage;
+
+struct WriterMessage {
+        int level;
+        char *text;
+
+        LIST_FIELDS(WriterMessage, messages);
+};
+
+struct Writer {
+        Server *server;
+        uid_t uid;
+
+        pthread_t thread;
+
+        /* Protects the queue fields below, and is only ever held
+         * briefly */
+        pthread_mutex_t queue_mutex;
+        pthread_cond_t queue_cond;
+        pthread_cond_t drained_cond;
+
+        LIST_HEAD(WriterEntry, queue);
+        WriterEntry *queue_tail;
+        unsigned n_queued;
+        bool quit;
+
+        /* Logging is not thread-safe, hence everything the thread
+         * logs is passed to the main loop to log, as is fixing the
+         * permissions of new files. If the file could not be recreated on
+         * rotation, the writer has failed and takes no more
+         * entries. */
+        LIST_HEAD(WriterMessage, messages);
+        WriterMessage *messages_tail;
+        bool fix_perms;
+        bool failed;
+
+        /* Protects the journal file, and is held by the writer
+         * thread while it writes out a batch of entries */
+        pthread_mutex_t file_mutex;
+
+        JournalFile *file;
+        unsigned n_dropped;
+};
+
+static void writer_notify(Writer *w) {
+        static const uint64_t one = 1;
+
+        /* Nothing we could do if this fails, we may not even log
+         * it */
+        (void) write(w->server->writer_event_fd, &one, sizeof(one));
+}
+
+static void writer_log(int level, const char *message, void *userdata) {
+        Writer *w = userdata;
+        WriterMessage *m;
+
+        assert(w);
+        assert(message);
+
+        m = new0(WriterMessage, 1);
+        if (!m)
+                return;
+
+        m->text = strdup(message);
+        if (!m->text) {
+                free(m);
+                return;
+        }
+
+        m->level = level;
+
+        assert_se(pthread_mutex_lock(&w->queue_mutex) == 0);
+        LIST_INSERT_AFTER(messages, w->messages, w->messages_tail, m);
+        w->messages_tail = m;
+        assert_se(pthread_mutex_unlock(&w->queue_mutex) == 0);
+
+        writer_notify(w);
+}
+
+static void writer_file_changed(Writer *w) {
+        assert(w);
+
+        assert_se(pthread_mutex_lock(&w->queue_mutex) == 0);
+        if (w->file)
+                w->fix_perms = true;
+        else
+                w->failed = true;
+        assert_se(pthread_mutex_unlock(&w->queue_mutex) == 0);
+
+        writer_notify(w);
+}
+
+static void writer_request_vacuum(Writer *w) {
+        /* Vacuuming touches state of the main loop, hence leave it
+         * to the main loop */
+        (void) __sync_lock_test_and_set(&w->server->vacuum_requested, true);
+}
+
+static void writer_write_entry(Writer *w, WriterEntry *e) {
+        const char *reason;
+        int r, level;
+
+        assert(w);
+        assert(e);
+
+        if (!w->file)
+                goto drop;
+
+        if (journal_file_rotate_suggested(w->file, w->server->max_file_usec)) {
+                log_debug("%s: Journal header limits reached or header out-of-date, rotating.", w->file->path);
+                writer_rotate(w);
+                writer_request_vacuum(w);
+
+                if (!w->file)
+                        goto drop;
+        }
+
+        r = journal_file_append_entry(w->file, &e->ts, e->iovec, e->n_iovec, NULL, NULL, NULL);
+        if (r < 0 && (reason = shall_try_append_again_reason(r, &level))) {
+                log_full(level, "%s: %s, rotating.", w->file->path, reason);
+                writer_rotate(w);
+                writer_request_vacuum(w);
+
+                if (!w->file)
+                        goto drop;
+
+                log_debug("Retrying write.");
+                r = journal_file_append_entry(w->file, &e->ts, e->iovec, e->n_iovec, NULL, NULL, NULL);
+        }
+
+        if (r < 0) {
+                size_t size = 0;
+                unsigned i;
+                for (i = 0; i < e->n_iovec; i++)
+                        size += e->iovec[i].iov_len;
+
+                log_error("Failed to write entry (%d items, %zu bytes), ignoring: %s", e->n_iovec, size, strerror(-r));
+                return;
+        }
+
+        /* Immediately sync to disk when this is of priority CRIT, ALERT, EMERG */
+        if (e->priority <= LOG_CRIT)
+                journal_file_set_offline(w->file);
+
+        return;
+
+drop:
+        /* Entries queued before the writer failed have nowhere to
+         * go anymore, later ones go to the system journal */
+        w->n_dropped++;
+}
+
+static void *writer_thread(void *p) {
+        Writer *w = p;
+
+        assert(w);
+
+        /* This covers the journal file code we call, too */
+        log_set_redirect(writer_log, w);
+
+        for (;;) {
+                WriterEntry *queue, *e;
+
+                assert_se(pthread_mutex_lock(&w->queue_mutex) == 0);
+
+                while (!w->queue && !w->quit)
+                        assert_se(pthread_cond_wait(&w->queue_cond, &w->queue_mutex) == 0);
+
+                /* Take the whole queue at once, so that the main
+                 * loop can continue queuing while we write */
+                queue = w->queue;
+                w->queue = w->queue_tail = NULL;
+                w->n_queued = 0;
+
+                assert_se(pthread_cond_broadcast(&w->drained_cond) == 0);
+                assert_se(pthread_mutex_unlock(&w->queue_mutex) == 0);
+
+                /* We only quit once the queue is empty */
+                if (!queue)
+                        break;
+
+                assert_se(pthread_mutex_lock(&w->file_mutex) == 0);
+
+                if (w->file)
+                        journal_file_begin_batch(w->file);
+
+                while ((e = queue)) {
+                        LIST_REMOVE(entries, queue, e);
+
+                        writer_write_entry(w, e);
+                        free(e);
+                }
+
+                if (w->file)
+                        journal_file_end_batch(w->file);
+
+                if (w->n_dropped > 0) {
+                        log_error("User journal of UID %lu is not available, dropped %u entries.",
+                                  (unsigned long) w->uid, w->n_dropped);
+                        w->n_dropped = 0;
+                }
+
+                assert_se(pthread_mutex_unlock(&w->file_mutex) == 0);
+        }
+
+        return NULL;
+}
+
+int writer_new(Server *s, uid_t uid, JournalFile *f, Writer **ret) {
+        Writer *w;
+        int r;
+
+        assert(s);
+        assert(f);
+        assert(ret);
+
+        w = new0(Writer, 1);
+        if (!w)
+                return -ENOMEM;
+
+        w->server = s;
+        w->uid = uid;
+
+        assert_se(pthread_mutex_init(&w->queue_mutex, NULL) == 0);
+        assert_se(pthread_mutex_init(&w->file_mutex, NULL) == 0);
+        assert_se(pthread_cond_init(&w->queue_cond, NULL) == 0);
+        assert_se(pthread_cond_init(&w->drained_cond, NULL) == 0);
+
+        r = pthread_create(&w->thread, NULL, writer_thread, w);
+        if (r != 0) {
+                pthread_cond_destroy(&w->queue_cond);
+                pthread_cond_destroy(&w->drained_cond);
+                pthread_mutex_destroy(&w->queue_mutex);
+                pthread_mutex_destroy(&w->file_mutex);
+                free(w);
+                return -r;
+        }
+
+        /* Only take possession of the file once nothing can fail
+         * anymore */
+        w->file = f;
+
+        *ret = w;
+        return 0;
+}
+
+void writer_free(Writer *w) {
+        if (!w)
+                return;
+
+        /* Let the thread write out what is still queued, then
+         * wait for it to finish */
+        assert_se(pthread_mutex_lock(&w->queue_mutex) == 0);
+        w->quit = true;
+        assert_se(pthread_cond_signal(&w->queue_cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->queue_mutex) == 0);
+
+        assert_se(pthread_join(w->thread, NULL) == 0);
+
+        /* Log what the thread left for us */
+        writer_process(w);
+
+        if (w->file)
+                journal_file_close(w->file);
+
+        pthread_cond_destroy(&w->queue_cond);
+        pthread_cond_destroy(&w->drained_cond);
+        pthread_mutex_destroy(&w->queue_mutex);
+        pthread_mutex_destroy(&w->file_mutex);
+
+        free(w);
+}
+
+int writer_enqueue(Writer *w, const struct iovec *iovec, unsigned n, int priority) {
+        WriterEntry *e;
+        size_t size;
+        uint8_t *p;
+        unsigned i;
+
+        assert(w);
+        assert(iovec);
+        assert(n > 0);
+
+        /* The data is copied after the iovec array, so that the
+         * whole entry is a single allocation */
+        size = offsetof(WriterEntry, iovec) + n * sizeof(struct iovec);
+        for (i = 0; i < n; i++)
+                size += iovec[i].iov_len;
+
+        e = malloc(size);
+        if (!e)
+                return -ENOMEM;
+
+        /* The timestamp is taken when the message is received, not
+         * when it is written, and entries are written in order */
+        dual_timestamp_get(&e->ts);
+        e->priority = priority;
+        e->n_iovec = n;
+
+        p = (uint8_t*) (e->iovec + n);
+        for (i = 0; i < n; i++) {
+                e->iovec[i].iov_base = p;
+                e->iovec[i].iov_len = iovec[i].iov_len;
+                p = mempcpy(p, iovec[i].iov_base, iovec[i].iov_len);
+        }
+
+        assert_se(pthread_mutex_lock(&w->queue_mutex) == 0);
+
+        if (w->failed) {
+                assert_se(pthread_mutex_unlock(&w->queue_mutex) == 0);
+                free(e);
+                return -EIO;
+        }
+
+        /* If the writer cannot keep up, make the producer wait */
+        while (w->n_queued >= WRITER_QUEUE_MAX)
+                assert_se(pthread_cond_wait(&w->drained_cond, &w->queue_mutex) == 0);
+
+        LIST_INSERT_AFTER(entries, w->queue, w->queue_tail, e);
+        w->queue_tail = e;
+        w->n_queued++;
+
+        assert_se(pthread_cond_signal(&w->queue_cond) == 0);
+        assert_se(pthread_mutex_unlock(&w->queue_mutex) == 0);
+
+        return 0;
+}
+
+static void writer_lock_file(Writer *w) {
+        /* The mutex is not recursive, and the writer thread already
+         * holds it when it rotates from writer_write_entry() */
+        if (!pthread_equal(pthread_self(), w->thread))
+                assert_se(pthread_mutex_lock(&w->file_mutex) == 0);
+}
+
+static void writer_unlock_file(Writer *w) {
+        if (!pthread_equal(pthread_self(), w->thread))
+                assert_se(pthread_mutex_unlock(&w->file_mutex) == 0);
+}
+
+void writer_rotate(Writer *w) {
+        int r;
+
+        assert(w);
+
+        writer_lock_file(w);
+
+        if (w->file) {
+                r = journal_file_rotate(&w->file, w->server->compress, w->server->seal);
+                if (r < 0) {
+                        if (w->file)
+                                log_error("Failed to rotate %s: %s", w->file->path, strerror(-r));
+                        else {
+                                log_error("Failed to create user journal: %s", strerror(-r));
+                                writer_file_changed(w);
+                        }
+                } else
+                        writer_file_changed(w);
+        }
+
+        writer_unlock_file(w);
+}
+
+void writer_sync(Writer *w) {
+        int r;
+
+        assert(w);
+
+        writer_lock_file(w);
+
+        if (w->file) {
+                r = journal_file_set_offline(w->file);
+                if (r < 0)
+                        log_error("Failed to sync user journal: %s", strerror(-r));
+        }
+
+        writer_unlock_file(w);
+}
+
+void writer_maybe_append_tag(Writer *w, usec_t n) {
+        assert(w);
+
+#ifdef HAVE_GCRYPT
+        writer_lock_file(w);
+
+        if (w->file)
+                journal_file_maybe_append_tag(w->file, n);
+
+        writer_unlock_file(w);
+#endif
+}
+
+int writer_process(Writer *w) {
+        LIST_HEAD(WriterMessage, messages);
+        WriterMessage *m;
+        bool fix_perms, failed;
+
+        assert(w);
+
+        assert_se(pthread_mutex_lock(&w->queue_mutex) == 0);
+        messages = w->messages;
+        w->messages = w->messages_tail = NULL;
+        fix_perms = w->fix_perms;
+        w->fix_perms = false;
+        failed = w->failed;
+        assert_se(pthread_mutex_unlock(&w->queue_mutex) == 0);
+
+        while ((m = messages)) {
+                LIST_REMOVE(messages, messages, m);
+
+                log_full(m->level, "%s", m->text);
+                free(m->text);
+                free(m);
+        }
+
+        if (fix_perms) {
+                writer_lock_file(w);
+
+                if (w->file)
+                        server_fix_perms(w->server, w->file, w->uid);
+
+                writer_unlock_file(w);
+        }
+
+        return failed ? -EIO : 0;
+}
@@ -0,0 +1,39 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  Copyright 2026 agent <agent@local>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <sys/uio.h>
+
+#include "journald-server.h"
+
+typedef struct Writer Writer;
+
+int writer_new(Server *s, uid_t uid, JournalFile *f, Writer **ret);
+void writer_free(Writer *w);
+
+int writer_enqueue(Writer *w, const struct iovec *iovec, unsigned n, int priority);
+
+void writer_rotate(Writer *w);
+void writer_sync(Writer *w);
+void writer_maybe_append_tag(Writer *w, usec_t n);
+
+int writer_process(Writer *w);
@@ -115,13 +115,17 @@ int main(int argc, char *argv[]) {
                 }
 
                 if (r > 0) {
+                        server_begin_batch(&server);
                         r = process_event(&server, &event);
+                        server_end_batch(&server);
+
                         if (r < 0)
                                 goto finish;
                         else if (r == 0)
                                 break;
                 }
 
+                server_maybe_vacuum(&server);
                 server_maybe_append_tags(&server);
                 server_maybe_warn_forward_syslog_missed(&server);
         }
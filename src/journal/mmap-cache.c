@@ -59,6 +59,13 @@ struct Context {
         unsigned id;
         Window *window;
 
+        /* The last window we created for this context, to detect
+         * sequential access */
+        int last_fd;
+        uint64_t last_offset;
+        uint64_t last_size;
+        uint64_t window_size;
+
         LIST_FIELDS(Context, by_window);
 };
 
@@ -72,8 +79,9 @@ struct MMapCache {
         int n_ref;
         unsigned n_windows;
 
-        unsigned n_hit, n_missed;
+        MMapCachePolicy policy;
 
+        unsigned n_hit, n_missed, n_sequential;
 
         Hashmap *fds;
         Hashmap *contexts;
@@ -85,7 +93,21 @@ struct MMapCache {
 #define WINDOWS_MIN 64
 #define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
 
-MMapCache* mmap_cache_new(void) {
+/* Don't let windows grow too much if address space is scarce */
+#if __SIZEOF_POINTER__ >= 8
+#define WINDOW_SIZE_MAX (128ULL*1024ULL*1024ULL)
+#else
+#define WINDOW_SIZE_MAX WINDOW_SIZE
+#endif
+
+const MMapCachePolicy mmap_cache_policy_default = {
+        .window_size = WINDOW_SIZE,
+        .window_size_max = WINDOW_SIZE_MAX,
+        .windows_min = WINDOWS_MIN,
+        .prefetch = true,
+};
+
+MMapCache* mmap_cache_new(const MMapCachePolicy *policy) {
         MMapCache *m;
 
         m = new0(MMapCache, 1);
@@ -93,6 +115,11 @@ MMapCache* mmap_cache_new(void) {
                 return NULL;
 
         m->n_ref = 1;
+        m->policy = policy ? *policy : mmap_cache_policy_default;
+
+        m->policy.window_size = PAGE_ALIGN(MAX(m->policy.window_size, (uint64_t) page_size()));
+        m->policy.window_size_max = MAX(m->policy.window_size_max, m->policy.window_size);
+
         return m;
 }
 
@@ -154,7 +181,7 @@ static Window *window_add(MMapCache *m) {
 
         assert(m);
 
-        if (!m->last_unused || m->n_windows <= WINDOWS_MIN) {
+        if (!m->last_unused || m->n_windows <= m->policy.windows_min) {
 
                 /* Allocate a new window */
                 w = new0(Window, 1);
@@ -237,6 +264,8 @@ static Context *context_add(MMapCache *m, unsigned id) {
 
         c->cache = m;
         c->id = id;
+        c->last_fd = -1;
+        c->window_size = m->policy.window_size;
 
         r = hashmap_put(m->contexts, UINT_TO_PTR(id + 1), c);
         if (r < 0) {
@@ -444,7 +473,7 @@ static int add_mmap(
         FileDescriptor *f;
         Window *w;
         void *d;
-        int r;
+        int r, direction = 0;
 
         assert(m);
         assert(m->n_ref > 0);
@@ -452,21 +481,47 @@ static int add_mmap(
         assert(size > 0);
         assert(ret);
 
+        c = context_add(m, context);
+        if (!c)
+                return -ENOMEM;
+
+        /* If the range is right after or before the last window of
+         * this context, the context is probably scanning the file,
+         * hence map larger windows in the direction it is moving */
+        if (c->last_fd == fd) {
+                if (offset + size > c->last_offset + c->last_size &&
+                    offset < c->last_offset + 2 * c->last_size)
+                        direction = 1;
+                else if (offset < c->last_offset &&
+                         offset + size + c->last_size > c->last_offset)
+                        direction = -1;
+        }
+
+        if (direction != 0)
+                c->window_size = MIN(c->window_size * 2, m->policy.window_size_max);
+        else
+                c->window_size = m->policy.window_size;
+
         woffset = offset & ~((uint64_t) page_size() - 1ULL);
         wsize = size + (offset - woffset);
         wsize = PAGE_ALIGN(wsize);
 
-        if (wsize < WINDOW_SIZE) {
+        if (wsize < c->window_size) {
                 uint64_t delta;
 
-                delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
+                if (direction > 0)
+                        delta = 0;
+                else if (direction < 0)
+                        delta = c->window_size - wsize;
+                else
+                        delta = PAGE_ALIGN((c->window_size - wsize) / 2);
 
                 if (delta > offset)
                         woffset = 0;
                 else
                         woffset -= delta;
 
-                wsize = WINDOW_SIZE;
+                wsize = c->window_size;
         }
 
         if (st) {
@@ -495,9 +550,18 @@ static int add_mmap(
                         return -ENOMEM;
         }
 
-        c = context_add(m, context);
-        if (!c)
-                return -ENOMEM;
+        if (direction != 0) {
+                m->n_sequential++;
+
+                /* Start reading in the window right-away, the
+                 * context is likely to go through all of it */
+                if (m->policy.prefetch)
+                        (void) madvise(d, wsize, MADV_WILLNEED);
+        }
+
+        c->last_fd = fd;
+        c->last_offset = woffset;
+        c->last_size = wsize;
 
         f = fd_add(m, fd);
         if (!f)
@@ -599,3 +663,9 @@ unsigned mmap_cache_get_missed(MMapCache *m) {
 
         return m->n_missed;
 }
+
+unsigned mmap_cache_get_sequential(MMapCache *m) {
+        assert(m);
+
+        return m->n_sequential;
+}
@@ -27,7 +27,26 @@
 
 typedef struct MMapCache MMapCache;
 
-MMapCache* mmap_cache_new(void);
+typedef struct MMapCachePolicy {
+        /* Size of newly created windows */
+        uint64_t window_size;
+
+        /* Windows for contexts that move sequentially through a
+         * file are doubled in size up to this limit */
+        uint64_t window_size_max;
+
+        /* How many windows to allocate before unused ones are
+         * recycled */
+        unsigned windows_min;
+
+        /* Whether to tell the kernel to read ahead sequentially
+         * accessed windows */
+        bool prefetch;
+} MMapCachePolicy;
+
+extern const MMapCachePolicy mmap_cache_policy_default;
+
+MMapCache* mmap_cache_new(const MMapCachePolicy *policy);
 MMapCache* mmap_cache_ref(MMapCache *m);
 MMapCache* mmap_cache_unref(MMapCache *m);
 
@@ -37,3 +56,4 @@ void mmap_cache_close_context(MMapCache *m, unsigned context);
 
 unsigned mmap_cache_get_hit(MMapCache *m);
 unsigned mmap_cache_get_missed(MMapCache *m);
+unsigned mmap_cache_get_sequential(MMapCache *m);
@@ -74,12 +74,42 @@ static int set_put_error(sd_journal *j, int r) {
         return set_put(j->errors, INT_TO_PTR(r));
 }
 
+typedef struct MergeItem {
+        JournalFile *file;
+        uint64_t offset;
+        Location location;
+        unsigned idx;
+
+        /* The file hasn't been loaded yet, and the location is
+         * merely the bound its header gives us */
+        bool pending;
+} MergeItem;
+
+static void merge_reset(sd_journal *j) {
+        MergeItem *m;
+
+        assert(j);
+
+        /* The files might already be gone at this point, hence don't
+         * look at them */
+        while ((m = prioq_pop(j->merge_queue)))
+                free(m);
+
+        prioq_free(j->merge_queue);
+        j->merge_queue = NULL;
+
+        set_free(j->merge_exhausted);
+        j->merge_exhausted = NULL;
+}
+
 static void detach_location(sd_journal *j) {
         Iterator i;
         JournalFile *f;
 
         assert(j);
 
+        merge_reset(j);
+
         j->current_file = NULL;
         j->current_field = 0;
 
@@ -192,12 +222,58 @@ static Match *match_new(Match *p, MatchType t) {
         return m;
 }
 
+typedef struct MatchCursorItem {
+        uint64_t data_offset;
+        uint64_t offset;
+        unsigned idx;
+} MatchCursorItem;
+
+typedef struct MatchCursor {
+        Prioq *queue;
+        MatchCursorItem *items;
+
+        direction_t direction;
+        uint64_t after_offset;
+        uint64_t n_entries;
+} MatchCursor;
+
+static void match_cursor_free(MatchCursor *c) {
+        if (!c)
+                return;
+
+        prioq_free(c->queue);
+        free(c->items);
+        free(c);
+}
+
+static void match_forget_cursors(Match *m, JournalFile *f) {
+        MatchCursor *c;
+        Match *i;
+
+        assert(m);
+
+        /* Forgets the cursors for the specified file, or all of
+         * them if NULL */
+
+        if (f)
+                match_cursor_free(hashmap_remove(m->cursors, f));
+        else
+                while ((c = hashmap_steal_first(m->cursors)))
+                        match_cursor_free(c);
+
+        LIST_FOREACH(matches, i, m->matches)
+                match_forget_cursors(i, f);
+}
+
 static void match_free(Match *m) {
         assert(m);
 
         while (m->matches)
                 match_free(m->matches);
 
+        match_forget_cursors(m, NULL);
+        hashmap_free(m->cursors);
+
         if (m->parent)
                 LIST_REMOVE(matches, m->parent->matches, m);
 
@@ -295,6 +371,7 @@ _public_ int sd_journal_add_match(sd_journal *j, const void *data, size_t size)
         if (!m->data)
                 goto fail;
 
+        match_forget_cursors(add_here, NULL);
         detach_location(j);
 
         return 0;
@@ -410,50 +487,28 @@ _public_ void sd_journal_flush_matches(sd_journal *j) {
         detach_location(j);
 }
 
-static int compare_entry_order(JournalFile *af, Object *_ao,
-                               JournalFile *bf, uint64_t bp) {
-
-        uint64_t a, b;
-        Object *ao, *bo;
-        int r;
-
-        assert(af);
-        assert(bf);
-        assert(_ao);
+static int compare_locations(const Location *a, const Location *b) {
+        assert(a);
+        assert(b);
+        assert(a->type == LOCATION_DISCRETE);
+        assert(b->type == LOCATION_DISCRETE);
 
-        /* The mmap cache might invalidate the object from the first
-         * file if we look at the one from the second file. Hence
-         * temporarily copy the header of the first one, and look at
-         * that only. */
-        ao = alloca(offsetof(EntryObject, items));
-        memcpy(ao, _ao, offsetof(EntryObject, items));
-
-        r = journal_file_move_to_object(bf, OBJECT_ENTRY, bp, &bo);
-        if (r < 0)
-                return strcmp(af->path, bf->path);
-
-        /* We operate on two different files here, hence we can access
-         * two objects at the same time, which we normally can't.
-         *
-         * If contents and timestamps match, these entries are
+        /* If contents and timestamps match, these entries are
          * identical, even if the seqnum does not match */
 
-        if (sd_id128_equal(ao->entry.boot_id, bo->entry.boot_id) &&
-            ao->entry.monotonic == bo->entry.monotonic &&
-            ao->entry.realtime == bo->entry.realtime &&
-            ao->entry.xor_hash == bo->entry.xor_hash)
+        if (sd_id128_equal(a->boot_id, b->boot_id) &&
+            a->monotonic == b->monotonic &&
+            a->realtime == b->realtime &&
+            a->xor_hash == b->xor_hash)
                 return 0;
 
-        if (sd_id128_equal(af->header->seqnum_id, bf->header->seqnum_id)) {
+        if (sd_id128_equal(a->seqnum_id, b->seqnum_id)) {
 
                 /* If this is from the same seqnum source, compare
                  * seqnums */
-                a = le64toh(ao->entry.seqnum);
-                b = le64toh(bo->entry.seqnum);
-
-                if (a < b)
+                if (a->seqnum < b->seqnum)
                         return -1;
-                if (a > b)
+                if (a->seqnum > b->seqnum)
                         return 1;
 
                 /* Wow! This is weird, different data but the same
@@ -461,34 +516,25 @@ static int compare_entry_order(JournalFile *af, Object *_ao,
                  * best of it and compare by time. */
         }
 
-        if (sd_id128_equal(ao->entry.boot_id, bo->entry.boot_id)) {
+        if (sd_id128_equal(a->boot_id, b->boot_id)) {
 
                 /* If the boot id matches compare monotonic time */
-                a = le64toh(ao->entry.monotonic);
-                b = le64toh(bo->entry.monotonic);
-
-                if (a < b)
+                if (a->monotonic < b->monotonic)
                         return -1;
-                if (a > b)
+                if (a->monotonic > b->monotonic)
                         return 1;
         }
 
         /* Otherwise compare UTC time */
-        a = le64toh(ao->entry.realtime);
-        b = le64toh(bo->entry.realtime);
-
-        if (a < b)
+        if (a->realtime < b->realtime)
                 return -1;
-        if (a > b)
+        if (a->realtime > b->realtime)
                 return 1;
 
         /* Finally, compare by contents */
-        a = le64toh(ao->entry.xor_hash);
-        b = le64toh(bo->entry.xor_hash);
-
-        if (a < b)
+        if (a->xor_hash < b->xor_hash)
                 return -1;
-        if (a > b)
+        if (a->xor_hash > b->xor_hash)
                 return 1;
 
         return 0;
@@ -554,6 +600,174 @@ _pure_ static int compare_with_location(JournalFile *af, Object *ao, Location *l
         return 0;
 }
 
+static int match_cursor_compare_down(const void *a, const void *b) {
+        const MatchCursorItem *x = a, *y = b;
+
+        return x->offset < y->offset ? -1 : (x->offset > y->offset ? 1 : 0);
+}
+
+static int match_cursor_compare_up(const void *a, const void *b) {
+        const MatchCursorItem *x = a, *y = b;
+
+        return x->offset > y->offset ? -1 : (x->offset < y->offset ? 1 : 0);
+}
+
+static int match_cursor_new(
+                Match *m,
+                JournalFile *f,
+                uint64_t after_offset,
+                direction_t direction,
+                MatchCursor **ret) {
+
+        MatchCursor *c;
+        MatchCursorItem *item;
+        Match *i;
+        unsigned n = 0;
+        int r;
+
+        assert(m);
+        assert(f);
+        assert(ret);
+
+        c = new0(MatchCursor, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->direction = direction;
+        c->after_offset = after_offset;
+        c->n_entries = le64toh(f->header->n_entries);
+
+        LIST_FOREACH(matches, i, m->matches)
+                n++;
+
+        c->queue = prioq_new(direction == DIRECTION_DOWN ? match_cursor_compare_down : match_cursor_compare_up);
+        c->items = new0(MatchCursorItem, n);
+        if (!c->queue || !c->items) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        item = c->items;
+        LIST_FOREACH(matches, i, m->matches) {
+                assert(i->type == MATCH_DISCRETE);
+
+                r = journal_file_find_data_object_with_hash(f, i->data, i->size, le64toh(i->le_hash), NULL, &item->data_offset);
+                if (r < 0)
+                        goto fail;
+                if (r == 0)
+                        continue;
+
+                r = journal_file_move_to_entry_by_offset_for_data(f, item->data_offset, after_offset, direction, NULL, &item->offset);
+                if (r < 0)
+                        goto fail;
+                if (r == 0)
+                        continue;
+
+                item->idx = PRIOQ_IDX_NULL;
+                r = prioq_put(c->queue, item, &item->idx);
+                if (r < 0)
+                        goto fail;
+
+                item++;
+        }
+
+        *ret = c;
+        return 0;
+
+fail:
+        match_cursor_free(c);
+        return r;
+}
+
+static int next_for_or_match(
+                Match *m,
+                JournalFile *f,
+                uint64_t after_offset,
+                direction_t direction,
+                uint64_t *ret) {
+
+        MatchCursor *c;
+        MatchCursorItem *item;
+        int r;
+
+        assert(m);
+        assert(m->type == MATCH_OR_TERM);
+        assert(f);
+        assert(ret);
+
+        /* Rather than looking for the next entry of each concrete
+         * match on every call, we remember them in a priority
+         * queue, and only look again for those we moved beyond. As
+         * long as we keep moving in the same direction through a
+         * file that didn't change, this costs as much as a single
+         * match would. */
+
+        c = hashmap_get(m->cursors, f);
+        if (c &&
+            (c->direction != direction ||
+             c->n_entries != le64toh(f->header->n_entries) ||
+             (direction == DIRECTION_DOWN ? after_offset < c->after_offset : after_offset > c->after_offset))) {
+                hashmap_remove(m->cursors, f);
+                match_cursor_free(c);
+                c = NULL;
+        }
+
+        if (!c) {
+                r = hashmap_ensure_allocated(&m->cursors, trivial_hash_func, trivial_compare_func);
+                if (r < 0)
+                        return r;
+
+                r = match_cursor_new(m, f, after_offset, direction, &c);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_put(m->cursors, f, c);
+                if (r < 0) {
+                        match_cursor_free(c);
+                        return r;
+                }
+        }
+
+        while ((item = prioq_peek(c->queue)) &&
+               (direction == DIRECTION_DOWN ? item->offset < after_offset : item->offset > after_offset)) {
+
+                r = journal_file_move_to_entry_by_offset_for_data(f, item->data_offset, after_offset, direction, NULL, &item->offset);
+                if (r < 0) {
+                        hashmap_remove(m->cursors, f);
+                        match_cursor_free(c);
+                        return r;
+                }
+
+                if (r == 0)
+                        prioq_remove(c->queue, item, &item->idx);
+                else
+                        prioq_reshuffle(c->queue, item, &item->idx);
+        }
+
+        c->after_offset = after_offset;
+
+        if (!item)
+                return 0;
+
+        *ret = item->offset;
+        return 1;
+}
+
+static bool match_is_discrete_or(Match *m) {
+        Match *i;
+
+        assert(m);
+
+        if (m->type != MATCH_OR_TERM || !m->matches)
+                return false;
+
+        LIST_FOREACH(matches, i, m->matches)
+                if (i->type != MATCH_DISCRETE)
+                        return false;
+
+        return true;
+}
+
 static int next_for_match(
                 sd_journal *j,
                 Match *m,
@@ -580,6 +794,12 @@ static int next_for_match(
 
                 return journal_file_move_to_entry_by_offset_for_data(f, dp, after_offset, direction, ret, offset);
 
+        } else if (match_is_discrete_or(m)) {
+
+                r = next_for_or_match(m, f, after_offset, direction, &np);
+                if (r <= 0)
+                        return r;
+
         } else if (m->type == MATCH_OR_TERM) {
                 Match *i;
 
@@ -745,6 +965,26 @@ static int find_location_for_match(
         }
 }
 
+static int compare_file_with_realtime(JournalFile *f, uint64_t realtime) {
+        usec_t from, to;
+
+        assert(f);
+
+        /* Returns < 0 if all entries of the file are older than the
+         * specified time, > 0 if they are all newer, and 0
+         * otherwise. Only looks at the header. */
+
+        if (journal_file_get_cutoff_realtime_usec(f, &from, &to) <= 0)
+                return 0;
+
+        if (to < realtime)
+                return -1;
+        if (from > realtime)
+                return 1;
+
+        return 0;
+}
+
 static int find_location_with_matches(
                 sd_journal *j,
                 JournalFile *f,
@@ -773,8 +1013,17 @@ static int find_location_with_matches(
                         if (r != -ENOENT)
                                 return r;
                 }
-                if (j->current_location.realtime_set)
+                if (j->current_location.realtime_set) {
+                        int k;
+
+                        /* If the whole file lies beyond the
+                         * location, there's nothing to bisect */
+                        k = compare_file_with_realtime(f, j->current_location.realtime);
+                        if (direction == DIRECTION_DOWN ? k > 0 : k < 0)
+                                return journal_file_next_entry(f, NULL, 0, direction, ret, offset);
+
                         return journal_file_move_to_entry_by_realtime(f, j->current_location.realtime, direction, ret, offset);
+                }
 
                 return journal_file_next_entry(f, NULL, 0, direction, ret, offset);
         } else
@@ -809,29 +1058,17 @@ static int next_with_matches(
         return next_for_match(j, j->level0, f, direction == DIRECTION_DOWN ? cp+1 : cp-1, direction, ret, offset);
 }
 
-static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direction, Object **ret, uint64_t *offset) {
-        Object *c;
-        uint64_t cp;
-        int r;
-
-        assert(j);
-        assert(f);
-
-        if (f->last_direction == direction && f->current_offset > 0) {
-                cp = f->current_offset;
-
-                r = journal_file_move_to_object(f, OBJECT_ENTRY, cp, &c);
-                if (r < 0)
-                        return r;
+static int advance_beyond_location(
+                sd_journal *j,
+                JournalFile *f,
+                direction_t direction,
+                Location *l,
+                Object *c,
+                uint64_t cp,
+                Object **ret,
+                uint64_t *offset) {
 
-                r = next_with_matches(j, f, direction, &c, &cp);
-                if (r <= 0)
-                        return r;
-        } else {
-                r = find_location_with_matches(j, f, direction, &c, &cp);
-                if (r <= 0)
-                        return r;
-        }
+        int r;
 
         /* OK, we found the spot, now let's advance until an entry
          * that is actually different from what we were previously
@@ -842,10 +1079,10 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         for (;;) {
                 bool found;
 
-                if (j->current_location.type == LOCATION_DISCRETE) {
+                if (l->type == LOCATION_DISCRETE) {
                         int k;
 
-                        k = compare_with_location(f, c, &j->current_location);
+                        k = compare_with_location(f, c, l);
                         if (direction == DIRECTION_DOWN)
                                 found = k > 0;
                         else
@@ -867,53 +1104,351 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *f, *new_file = NULL;
-        uint64_t new_offset = 0;
+static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direction, Object **ret, uint64_t *offset) {
+        Object *c;
+        uint64_t cp;
+        int r;
+
+        assert(j);
+        assert(f);
+
+        if (f->last_direction == direction && f->current_offset > 0) {
+                cp = f->current_offset;
+
+                r = journal_file_move_to_object(f, OBJECT_ENTRY, cp, &c);
+                if (r < 0)
+                        return r;
+
+                r = next_with_matches(j, f, direction, &c, &cp);
+                if (r <= 0)
+                        return r;
+        } else {
+                r = find_location_with_matches(j, f, direction, &c, &cp);
+                if (r <= 0)
+                        return r;
+        }
+
+        return advance_beyond_location(j, f, direction, &j->current_location, c, cp, ret, offset);
+}
+
+static int first_beyond_location(sd_journal *j, JournalFile *f, direction_t direction, Object **ret, uint64_t *offset) {
+        Location l, saved;
+        Object *c;
+        uint64_t cp;
+        int r;
+
+        assert(j);
+        assert(f);
+
+        /* Like next_beyond_location(), but for a file we haven't
+         * looked at so far. Its header carries no boot ID and
+         * monotonic time, hence it got its place among the other
+         * files by its sequence number or wallclock time only, see
+         * init_location_from_header(). Look for its entries the same
+         * way, or we'd skip those the monotonic clock puts before
+         * entries we returned while the file was waiting. Wallclock
+         * time is not monotonic within a file, hence start at its
+         * first (or last) entry rather than bisecting. */
+
+        l = j->current_location;
+        if (l.type != LOCATION_DISCRETE)
+                return next_beyond_location(j, f, direction, ret, offset);
+
+        l.monotonic_set = false;
+
+        saved = j->current_location;
+        j->current_location.type = direction == DIRECTION_DOWN ? LOCATION_HEAD : LOCATION_TAIL;
+        r = find_location_with_matches(j, f, direction, &c, &cp);
+        j->current_location = saved;
+        if (r <= 0)
+                return r;
+
+        return advance_beyond_location(j, f, direction, &l, c, cp, ret, offset);
+}
+
+static int merge_compare_down(const void *a, const void *b) {
+        const MergeItem *x = a, *y = b;
+
+        return compare_locations(&x->location, &y->location);
+}
+
+static int merge_compare_up(const void *a, const void *b) {
+        const MergeItem *x = a, *y = b;
+
+        return compare_locations(&y->location, &x->location);
+}
+
+static bool file_outside_location(sd_journal *j, JournalFile *f, direction_t direction) {
+        const Location *l;
+        uint64_t seqnum, realtime;
+
+        assert(j);
+        assert(f);
+
+        /* Finds out from the header whether all entries of the file
+         * lie before the location (or after it, when going
+         * backwards), in which case the file has nothing to offer.
+         * For files we loaded already this is only worth it when
+         * seeking to a point in time, which would otherwise bisect
+         * every file. Files we haven't loaded yet we'd rather not
+         * load at all. */
+
+        l = &j->current_location;
+
+        if (l->type != LOCATION_SEEK && l->type != LOCATION_DISCRETE)
+                return false;
+
+        if (!f->lazy &&
+            (l->type != LOCATION_SEEK || !l->realtime_set || l->seqnum_set || l->monotonic_set))
+                return false;
+
+        if (le64toh(f->header->n_entries) <= 0)
+                return false;
+
+        if (direction == DIRECTION_DOWN) {
+                seqnum = le64toh(f->header->tail_entry_seqnum);
+                realtime = le64toh(f->header->tail_entry_realtime);
+        } else {
+                seqnum = le64toh(f->header->head_entry_seqnum);
+                realtime = le64toh(f->header->head_entry_realtime);
+        }
+
+        if (l->seqnum_set && sd_id128_equal(l->seqnum_id, f->header->seqnum_id))
+                return direction == DIRECTION_DOWN ? seqnum < l->seqnum : seqnum > l->seqnum;
+
+        if (l->realtime_set)
+                return direction == DIRECTION_DOWN ? realtime < l->realtime : realtime > l->realtime;
+
+        return false;
+}
+
+static void init_location_from_header(Location *l, JournalFile *f, direction_t direction) {
+        assert(l);
+        assert(f);
+
+        zero(*l);
+        l->type = LOCATION_DISCRETE;
+
+        l->seqnum_id = f->header->seqnum_id;
+        l->seqnum = le64toh(direction == DIRECTION_DOWN ? f->header->head_entry_seqnum : f->header->tail_entry_seqnum);
+        l->seqnum_set = true;
+
+        l->realtime = le64toh(direction == DIRECTION_DOWN ? f->header->head_entry_realtime : f->header->tail_entry_realtime);
+        l->realtime_set = true;
+}
+
+static int merge_queue_file(sd_journal *j, JournalFile *f, MergeItem *m, bool loaded) {
+        bool pending = false;
         Object *o;
         uint64_t p;
-        Iterator i;
         int r;
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert(j);
+        assert(f);
 
-        HASHMAP_FOREACH(f, j->files, i) {
-                bool found;
+        /* Looks for the next entry of the file beyond the current
+         * location, and queues the file with it. Takes possession
+         * of m, if it is passed. Returns 0 if there is no such
+         * entry. loaded is true when the file was queued by its
+         * header so far. */
+
+        if (file_outside_location(j, f, j->merge_direction))
+                r = 0;
+        else if (f->lazy) {
+                /* Don't load the file before we need to. Until
+                 * then its first (or last) entry is as far as its
+                 * next entry can be. */
+                r = le64toh(f->header->n_entries) > 0;
+                pending = true;
+        } else if (loaded)
+                r = first_beyond_location(j, f, j->merge_direction, &o, &p);
+        else
+                r = next_beyond_location(j, f, j->merge_direction, &o, &p);
+        if (r <= 0) {
+                free(m);
 
-                r = next_beyond_location(j, f, direction, &o, &p);
-                if (r < 0) {
+                if (r < 0)
                         log_debug("Can't iterate through %s, ignoring: %s", f->path, strerror(-r));
-                        continue;
-                } else if (r == 0)
-                        continue;
 
-                if (!new_file)
-                        found = true;
-                else {
-                        int k;
+                /* Archived files won't grow anymore, hence there is
+                 * no need to look at them again */
+                if (f->header->state == STATE_ARCHIVED)
+                        return 0;
 
-                        k = compare_entry_order(f, o, new_file, new_offset);
+                r = set_put(j->merge_exhausted, f);
+                return r < 0 ? r : 0;
+        }
 
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
-                }
+        if (!m) {
+                m = new0(MergeItem, 1);
+                if (!m)
+                        return -ENOMEM;
 
-                if (found) {
-                        new_file = f;
-                        new_offset = p;
+                m->file = f;
+                m->idx = PRIOQ_IDX_NULL;
+        }
+
+        m->pending = pending;
+        if (pending) {
+                m->offset = 0;
+                init_location_from_header(&m->location, f, j->merge_direction);
+        } else {
+                m->offset = p;
+                init_location(&m->location, LOCATION_DISCRETE, f, o);
+        }
+
+        r = prioq_put(j->merge_queue, m, &m->idx);
+        if (r < 0) {
+                free(m);
+                return r;
+        }
+
+        return 1;
+}
+
+static int merge_peek(sd_journal *j, MergeItem **ret) {
+        MergeItem *m;
+        int r;
+
+        assert(j);
+        assert(ret);
+
+        /* Returns the top of the queue. Files that were queued by
+         * their header are loaded once they get there, and queued
+         * again with their actual next entry. */
+
+        while ((m = prioq_peek(j->merge_queue)) && m->pending) {
+                assert_se(prioq_pop(j->merge_queue) == m);
+
+                r = journal_file_load(m->file);
+                if (r < 0) {
+                        log_debug("Can't load %s, ignoring: %s", m->file->path, strerror(-r));
+                        free(m);
+                        continue;
                 }
+
+                r = merge_queue_file(j, m->file, m, true);
+                if (r < 0)
+                        return r;
         }
 
-        if (!new_file)
+        *ret = m;
+        return 0;
+}
+
+static int merge_setup(sd_journal *j, direction_t direction) {
+        JournalFile *f;
+        Iterator i;
+        int r;
+
+        assert(j);
+
+        if (j->merge_queue && j->merge_direction == direction)
                 return 0;
 
-        r = journal_file_move_to_object(new_file, OBJECT_ENTRY, new_offset, &o);
+        merge_reset(j);
+
+        j->merge_queue = prioq_new(direction == DIRECTION_DOWN ? merge_compare_down : merge_compare_up);
+        j->merge_exhausted = set_new(trivial_hash_func, trivial_compare_func);
+        if (!j->merge_queue || !j->merge_exhausted) {
+                merge_reset(j);
+                return -ENOMEM;
+        }
+
+        j->merge_direction = direction;
+
+        HASHMAP_FOREACH(f, j->files, i) {
+                r = merge_queue_file(j, f, NULL, false);
+                if (r < 0) {
+                        merge_reset(j);
+                        return r;
+                }
+        }
+
+        return 0;
+}
+
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        JournalFile *f;
+        MergeItem *m;
+        Object *o;
+        Iterator i;
+        int r;
+
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+
+        /* Instead of looking at every file for every entry, we keep
+         * the files in a priority queue ordered by the next entry
+         * each of them has to offer, and only advance the one we
+         * took an entry from. */
+
+        r = merge_setup(j, direction);
         if (r < 0)
                 return r;
 
-        set_location(j, LOCATION_DISCRETE, new_file, o, direction, new_offset);
+        /* Files that had nothing to offer might have gotten new
+         * entries in the meantime */
+        SET_FOREACH(f, j->merge_exhausted, i) {
+                r = merge_queue_file(j, f, NULL, false);
+                if (r < 0)
+                        goto fail;
+                if (r > 0)
+                        set_remove(j->merge_exhausted, f);
+        }
+
+        r = merge_peek(j, &m);
+        if (r < 0)
+                goto fail;
+        if (!m)
+                return 0;
+
+        assert_se(prioq_pop(j->merge_queue) == m);
+
+        r = journal_file_move_to_object(m->file, OBJECT_ENTRY, m->offset, &o);
+        if (r < 0) {
+                free(m);
+                goto fail;
+        }
+
+        set_location(j, LOCATION_DISCRETE, m->file, o, direction, m->offset);
+
+        r = merge_queue_file(j, m->file, m, false);
+        if (r < 0)
+                goto fail;
+
+        /* Other files might offer the very same entry, which we
+         * suppress. Entries that only the monotonic clock puts
+         * before the new location are not: these come from files
+         * that were loaded late, see merge_peek(). */
+        for (;;) {
+                int k;
+
+                r = merge_peek(j, &m);
+                if (r < 0)
+                        goto fail;
+                if (!m)
+                        break;
+
+                r = journal_file_move_to_object(m->file, OBJECT_ENTRY, m->offset, &o);
+                if (r >= 0) {
+                        k = compare_with_location(m->file, o, &j->current_location);
+                        if (k != 0)
+                                break;
+                }
+
+                assert_se(prioq_pop(j->merge_queue) == m);
+
+                r = merge_queue_file(j, m->file, m, false);
+                if (r < 0)
+                        goto fail;
+        }
 
         return 1;
+
+fail:
+        merge_reset(j);
+        return r;
 }
 
 _public_ int sd_journal_next(sd_journal *j) {
@@ -1224,15 +1759,17 @@ _public_ int sd_journal_seek_tail(sd_journal *j) {
         return 0;
 }
 
-static void check_network(sd_journal *j, int fd) {
+static void check_network(sd_journal *j, int fd, const char *path) {
         struct statfs sfs;
 
         assert(j);
+        assert(fd >= 0 || path);
 
         if (j->on_network)
                 return;
 
-        if (fstatfs(fd, &sfs) < 0)
+        /* Files opened lazily have no fd yet */
+        if ((fd >= 0 ? fstatfs(fd, &sfs) : statfs(path, &sfs)) < 0)
                 return;
 
         j->on_network =
@@ -1294,7 +1831,7 @@ static int add_any_file(sd_journal *j, const char *path) {
                 return set_put_error(j, -ETOOMANYREFS);
         }
 
-        r = journal_file_open(path, O_RDONLY, 0, false, false, NULL, j->mmap, NULL, &f);
+        r = journal_file_open_lazy(path, j->mmap, &f);
         if (r < 0)
                 return r;
 
@@ -1306,9 +1843,11 @@ static int add_any_file(sd_journal *j, const char *path) {
                 return r;
         }
 
+        merge_reset(j);
+
         log_debug("File %s added.", f->path);
 
-        check_network(j, f->fd);
+        check_network(j, f->fd, f->path);
 
         j->current_invalidate_counter ++;
 
@@ -1355,6 +1894,10 @@ static int remove_file(sd_journal *j, const char *prefix, const char *filename)
                 return 0;
 
         hashmap_remove(j->files, f->path);
+        merge_reset(j);
+
+        if (j->level0)
+                match_forget_cursors(j->level0, f);
 
         log_debug("File %s removed.", f->path);
 
@@ -1460,7 +2003,7 @@ static int add_directory(sd_journal *j, const char *prefix, const char *dirname)
                 }
         }
 
-        check_network(j, dirfd(d));
+        check_network(j, dirfd(d), NULL);
 
         return 0;
 }
@@ -1548,7 +2091,7 @@ static int add_root_directory(sd_journal *j, const char *p) {
                 }
         }
 
-        check_network(j, dirfd(d));
+        check_network(j, dirfd(d), NULL);
 
         return 0;
 }
@@ -1668,7 +2211,7 @@ static sd_journal *journal_new(int flags, const char *path) {
 
         j->files = hashmap_new(string_hash_func, string_compare_func);
         j->directories_by_path = hashmap_new(string_hash_func, string_compare_func);
-        j->mmap = mmap_cache_new();
+        j->mmap = mmap_cache_new(NULL);
         if (!j->files || !j->directories_by_path || !j->mmap)
                 goto fail;
 
@@ -1793,12 +2336,14 @@ _public_ void sd_journal_close(sd_journal *j) {
                 close_nointr_nofail(j->inotify_fd);
 
         if (j->mmap) {
-                log_debug("mmap cache statistics: %u hit, %u miss", mmap_cache_get_hit(j->mmap), mmap_cache_get_missed(j->mmap));
+                log_debug("mmap cache statistics: %u hit, %u miss, %u sequential",
+                          mmap_cache_get_hit(j->mmap), mmap_cache_get_missed(j->mmap), mmap_cache_get_sequential(j->mmap));
                 mmap_cache_unref(j->mmap);
         }
 
         free(j->path);
         free(j->unique_field);
+        set_free_free(j->unique_values);
         set_free(j->errors);
         free(j);
 }
@@ -1936,16 +2481,21 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                 l = le64toh(o->object.size) - offsetof(Object, data.payload);
 
-                if (o->object.flags & OBJECT_COMPRESSED) {
+                if (o->object.flags & OBJECT_COMPRESSION_MASK) {
+                        int compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+
+                        if (!compression_supported(compression))
+                                return -EPROTONOSUPPORT;
 
-#ifdef HAVE_XZ
-                        if (uncompress_startswith(o->data.payload, l,
+                        if (uncompress_startswith(compression,
+                                                  o->data.payload, l,
                                                   &f->compress_buffer, &f->compress_buffer_size,
                                                   field, field_length, '=')) {
 
                                 uint64_t rsize;
 
-                                if (!uncompress_blob(o->data.payload, l,
+                                if (!uncompress_blob(compression,
+                                                     o->data.payload, l,
                                                      &f->compress_buffer, &f->compress_buffer_size, &rsize,
                                                      j->data_threshold))
                                         return -EBADMSG;
@@ -1955,9 +2505,6 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
 
                                 return 0;
                         }
-#else
-                        return -EPROTONOSUPPORT;
-#endif
 
                 } else if (l >= field_length+1 &&
                            memcmp(o->data.payload, field, field_length) == 0 &&
@@ -1993,18 +2540,18 @@ static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **da
         if ((uint64_t) t != l)
                 return -E2BIG;
 
-        if (o->object.flags & OBJECT_COMPRESSED) {
-#ifdef HAVE_XZ
+        if (o->object.flags & OBJECT_COMPRESSION_MASK) {
+                int compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 uint64_t rsize;
 
-                if (!uncompress_blob(o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, j->data_threshold))
+                if (!compression_supported(compression))
+                        return -EPROTONOSUPPORT;
+
+                if (!uncompress_blob(compression, o->data.payload, l, &f->compress_buffer, &f->compress_buffer_size, &rsize, j->data_threshold))
                         return -EBADMSG;
 
                 *data = f->compress_buffer;
                 *size = (size_t) rsize;
-#else
-                return -EPROTONOSUPPORT;
-#endif
         } else {
                 *data = o->data.payload;
                 *size = t;
@@ -2384,6 +2931,21 @@ void journal_print_header(sd_journal *j) {
         }
 }
 
+_public_ int sd_journal_get_mmap_cache_statistics(sd_journal *j, uint64_t *hit, uint64_t *missed, uint64_t *sequential) {
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(hit || missed || sequential, -EINVAL);
+
+        if (hit)
+                *hit = mmap_cache_get_hit(j->mmap);
+        if (missed)
+                *missed = mmap_cache_get_missed(j->mmap);
+        if (sequential)
+                *sequential = mmap_cache_get_sequential(j->mmap);
+
+        return 0;
+}
+
 _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         Iterator i;
         JournalFile *f;
@@ -2396,7 +2958,11 @@ _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         HASHMAP_FOREACH(f, j->files, i) {
                 struct stat st;
 
-                if (fstat(f->fd, &st) < 0)
+                /* Files that weren't loaded yet are archived, and
+                 * we know their size already */
+                if (f->lazy)
+                        st = f->last_stat;
+                else if (fstat(f->fd, &st) < 0)
                         return -errno;
 
                 sum += (uint64_t) st.st_blocks * 512ULL;
@@ -2422,10 +2988,35 @@ _public_ int sd_journal_query_unique(sd_journal *j, const char *field) {
         j->unique_field = f;
         j->unique_file = NULL;
         j->unique_offset = 0;
+        set_clear_free(j->unique_values);
 
         return 0;
 }
 
+typedef struct UniqueValue {
+        uint64_t hash;
+        size_t size;
+        const void *data;
+} UniqueValue;
+
+static unsigned unique_value_hash_func(const void *p) {
+        const UniqueValue *v = p;
+
+        return (unsigned) v->hash;
+}
+
+static int unique_value_compare_func(const void *a, const void *b) {
+        const UniqueValue *x = a, *y = b;
+
+        if (x->hash != y->hash)
+                return x->hash < y->hash ? -1 : 1;
+
+        if (x->size != y->size)
+                return x->size < y->size ? -1 : 1;
+
+        return memcmp(x->data, y->data, x->size);
+}
+
 _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_t *l) {
         Object *o;
         size_t k;
@@ -2446,12 +3037,12 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                 j->unique_offset = 0;
         }
 
+        r = set_ensure_allocated(&j->unique_values, unique_value_hash_func, unique_value_compare_func);
+        if (r < 0)
+                return r;
+
         for (;;) {
-                JournalFile *of;
-                Iterator i;
-                const void *odata;
-                size_t ol;
-                bool found;
+                UniqueValue key, *v;
 
                 /* Proceed to next data object in the field's linked list */
                 if (j->unique_offset == 0) {
@@ -2491,42 +3082,34 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                 if (o->object.type != OBJECT_DATA)
                         return -EBADMSG;
 
-                r = return_data(j, j->unique_file, o, &odata, &ol);
+                r = return_data(j, j->unique_file, o, &key.data, &key.size);
                 if (r < 0)
                         return r;
 
                 /* OK, now let's see if we already returned this data
-                 * object by checking if it exists in the earlier
-                 * traversed files. */
-                found = false;
-                HASHMAP_FOREACH(of, j->files, i) {
-                        Object *oo;
-                        uint64_t op;
-
-                        if (of == j->unique_file)
-                                break;
-
-                        /* Skip this file it didn't have any fields
-                         * indexed */
-                        if (JOURNAL_HEADER_CONTAINS(of->header, n_fields) &&
-                            le64toh(of->header->n_fields) <= 0)
-                                continue;
-
-                        r = journal_file_find_data_object_with_hash(of, odata, ol, le64toh(o->data.hash), &oo, &op);
-                        if (r < 0)
-                                return r;
+                 * object, from this or an earlier traversed file. The
+                 * hash stored in the object is the one of the full
+                 * payload, hence it distinguishes values that are
+                 * truncated the same way, and is compared first. */
+                key.hash = le64toh(o->data.hash);
+                if (set_contains(j->unique_values, &key))
+                        continue;
 
-                        if (r > 0)
-                                found = true;
-                }
+                v = malloc(sizeof(UniqueValue) + key.size);
+                if (!v)
+                        return -ENOMEM;
 
-                if (found)
-                        continue;
+                v->hash = key.hash;
+                v->size = key.size;
+                v->data = memcpy(v + 1, key.data, key.size);
 
-                r = return_data(j, j->unique_file, o, data, l);
+                r = set_consume(j->unique_values, v);
                 if (r < 0)
                         return r;
 
+                *data = v->data;
+                *l = v->size;
+
                 return 1;
         }
 }
@@ -2537,6 +3120,152 @@ _public_ void sd_journal_restart_unique(sd_journal *j) {
 
         j->unique_file = NULL;
         j->unique_offset = 0;
+        set_clear_free(j->unique_values);
+}
+
+static int boot_id_compare_id(const void *a, const void *b) {
+        const BootId *x = a, *y = b;
+
+        return memcmp(&x->id, &y->id, sizeof(x->id));
+}
+
+static int boot_id_compare_first(const void *a, const void *b) {
+        const BootId *x = a, *y = b;
+
+        return x->first < y->first ? -1 : (x->first > y->first ? 1 : 0);
+}
+
+static int boot_from_data_object(sd_journal *j, JournalFile *f, uint64_t p, BootId *b, uint64_t *next) {
+        char t[SD_ID128_STRING_MAX];
+        const void *data;
+        size_t l;
+        Object *o;
+        int r;
+
+        assert(j);
+        assert(f);
+        assert(b);
+        assert(next);
+
+        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+        if (r < 0)
+                return r;
+
+        *next = le64toh(o->data.next_field_offset);
+
+        r = return_data(j, f, o, &data, &l);
+        if (r < 0)
+                return r;
+
+        if (l != strlen("_BOOT_ID=") + SD_ID128_STRING_MAX - 1 ||
+            memcmp(data, "_BOOT_ID=", strlen("_BOOT_ID=")) != 0)
+                return 0;
+
+        memcpy(t, (const char*) data + strlen("_BOOT_ID="), sizeof(t) - 1);
+        t[sizeof(t) - 1] = 0;
+
+        if (sd_id128_from_string(t, &b->id) < 0)
+                return 0;
+
+        /* The entry list of the data object is ordered, hence its
+         * ends are the first and last entry of the boot in this
+         * file */
+        r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_DOWN, &o, NULL);
+        if (r <= 0)
+                return r;
+
+        b->first = le64toh(o->entry.realtime);
+
+        r = journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_UP, &o, NULL);
+        if (r <= 0)
+                return r;
+
+        b->last = le64toh(o->entry.realtime);
+
+        return 1;
+}
+
+static int boots_from_file(sd_journal *j, JournalFile *f, BootId **boots, size_t *allocated, unsigned *n) {
+        Object *o;
+        uint64_t p;
+        int r;
+
+        assert(j);
+        assert(f);
+        assert(boots);
+        assert(allocated);
+        assert(n);
+
+        r = journal_file_find_field_object(f, "_BOOT_ID", strlen("_BOOT_ID"), &o, NULL);
+        if (r <= 0)
+                return r;
+
+        p = le64toh(o->field.head_data_offset);
+        while (p > 0) {
+                uint64_t next;
+
+                if (!GREEDY_REALLOC(*boots, *allocated, *n + 1))
+                        return -ENOMEM;
+
+                r = boot_from_data_object(j, f, p, *boots + *n, &next);
+                if (r < 0)
+                        return r;
+                if (r > 0)
+                        (*n)++;
+
+                p = next;
+        }
+
+        return 0;
+}
+
+int journal_get_boots(sd_journal *j, BootId **ret, unsigned *ret_n) {
+        _cleanup_free_ BootId *boots = NULL;
+        size_t allocated = 0;
+        unsigned n = 0, i, k;
+        JournalFile *f;
+        Iterator it;
+        int r;
+
+        assert(j);
+        assert(ret);
+        assert(ret_n);
+
+        /* Rather than seeking to the head and tail of each boot
+         * through the interleaved view of all files, look up the
+         * _BOOT_ID data objects of each file directly, and merge
+         * what we find. This is linear in the number of boots per
+         * file, and never needs to bisect the entry arrays. */
+
+        HASHMAP_FOREACH(f, j->files, it) {
+                /* A broken file shouldn't hide the boots of all
+                 * the others, hence skip it, like
+                 * real_journal_next() does */
+                r = boots_from_file(j, f, &boots, &allocated, &n);
+                if (r == -ENOMEM)
+                        return r;
+                if (r < 0)
+                        log_debug("Can't read boots from %s, ignoring: %s", f->path, strerror(-r));
+        }
+
+        /* Fold the per-file ranges of each boot into one */
+        qsort_safe(boots, n, sizeof(BootId), boot_id_compare_id);
+
+        for (i = 0, k = 0; i < n; i++) {
+                if (k > 0 && sd_id128_equal(boots[k-1].id, boots[i].id)) {
+                        boots[k-1].first = MIN(boots[k-1].first, boots[i].first);
+                        boots[k-1].last = MAX(boots[k-1].last, boots[i].last);
+                } else
+                        boots[k++] = boots[i];
+        }
+
+        qsort_safe(boots, k, sizeof(BootId), boot_id_compare_first);
+
+        *ret = boots;
+        *ret_n = k;
+        boots = NULL;
+
+        return 0;
 }
 
 _public_ int sd_journal_reliable_fd(sd_journal *j) {
@@ -0,0 +1,113 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2026 agent <agent@local>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "compress.h"
+#include "util.h"
+#include "macro.h"
+
+/* Compares XZ and LZ4 on data shaped like typical journal payloads,
+ * i.e. log lines that repeat with small variations */
+
+#define MAX_SIZE (1024*1024LU)
+#define TOTAL_SIZE (2*1024*1024LU)
+
+static char* make_buf(size_t count) {
+        static const char *words[] = {
+                "systemd", "Started", "Stopping", "session", "user", "of",
+                "service", "failed", "with", "result", "exit-code", "=",
+                "MESSAGE", "/usr/lib/systemd/systemd", "0x7f", "\n",
+        };
+        char *buf;
+        size_t i;
+
+        buf = malloc(count);
+        assert_se(buf);
+
+        for (i = 0; i < count; ) {
+                const char *w = words[random() % ELEMENTSOF(words)];
+                size_t l = MIN(strlen(w), count - i);
+
+                memcpy(buf + i, w, l);
+                i += l;
+
+                if (i < count)
+                        buf[i++] = ' ';
+        }
+
+        return buf;
+}
+
+static void test_compress_decompress(int compression, const char *data) {
+        size_t size;
+
+        for (size = 512; size <= MAX_SIZE; size *= 4) {
+                _cleanup_free_ char *compressed = NULL;
+                _cleanup_free_ void *buf = NULL;
+                uint64_t csize = 0, bufsize = 0, usize = 0;
+                usec_t n, c_usec, d_usec;
+                unsigned i, iterations;
+
+                compressed = malloc(size);
+                assert_se(compressed);
+
+                iterations = MAX(TOTAL_SIZE / size, 1u);
+
+                n = now(CLOCK_MONOTONIC);
+                for (i = 0; i < iterations; i++)
+                        assert_se(compress_blob(compression, data, size, compressed, &csize));
+                c_usec = MAX(now(CLOCK_MONOTONIC) - n, 1u);
+
+                n = now(CLOCK_MONOTONIC);
+                for (i = 0; i < iterations; i++) {
+                        assert_se(uncompress_blob(compression, compressed, csize, &buf, &bufsize, &usize, 0));
+                        assert_se(usize == size);
+                }
+                d_usec = MAX(now(CLOCK_MONOTONIC) - n, 1u);
+
+                assert_se(memcmp(buf, data, size) == 0);
+
+                log_info("%s: %8zu bytes -> %8"PRIu64" (%5.1f%%), compression %8.1f MiB/s, decompression %8.1f MiB/s",
+                         object_compressed_to_string(compression),
+                         size, csize, 100.0 * csize / size,
+                         (double) size * iterations / c_usec * USEC_PER_SEC / 1024 / 1024,
+                         (double) size * iterations / d_usec * USEC_PER_SEC / 1024 / 1024);
+        }
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_free_ char *data = NULL;
+        unsigned i;
+
+        log_set_max_level(LOG_DEBUG);
+
+        data = make_buf(MAX_SIZE);
+
+        for (i = 1; i < _OBJECT_COMPRESSED_MAX; i++) {
+                if (!compression_supported(i)) {
+                        log_info("Skipping %s, not supported.", object_compressed_to_string(i));
+                        continue;
+                }
+
+                test_compress_decompress(i, data);
+        }
+
+        return 0;
+}
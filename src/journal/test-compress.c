@@ -0,0 +1,89 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2026 agent <agent@local>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "compress.h"
+#include "util.h"
+#include "macro.h"
+
+#define TEXT "foofoofoofoo AAAA aaaaaaaaa ghost busters barbarbar FFF"
+
+static void fill_text(char *text, size_t size) {
+        size_t i;
+
+        for (i = 0; i < size; i++)
+                text[i] = TEXT[i % (sizeof(TEXT) - 1)];
+}
+
+static void test_compress_uncompress(int compression) {
+        char text[1024], compressed[1024];
+        uint64_t csize = 0, usize = 0;
+        _cleanup_free_ char *decompressed = NULL;
+        uint64_t dsize = 0;
+
+        fill_text(text, sizeof(text));
+
+        assert_se(compress_blob(compression, text, sizeof(text), compressed, &csize));
+        assert_se(csize > 0 && csize < sizeof(text));
+
+        assert_se(uncompress_blob(compression, compressed, csize, (void**) &decompressed, &dsize, &usize, 0));
+        assert_se(usize == sizeof(text));
+        assert_se(memcmp(decompressed, text, sizeof(text)) == 0);
+
+        /* Random data cannot be decoded */
+        memzero(compressed, sizeof(compressed));
+        memcpy(compressed, "random data", 11);
+        assert_se(!uncompress_blob(compression, compressed, sizeof(compressed), (void**) &decompressed, &dsize, &usize, 0));
+}
+
+static void test_uncompress_startswith(int compression) {
+        char text[1024], compressed[1024];
+        uint64_t csize = 0;
+        _cleanup_free_ char *decompressed = NULL;
+        uint64_t dsize = 0;
+
+        fill_text(text, sizeof(text));
+
+        assert_se(compress_blob(compression, text, sizeof(text), compressed, &csize));
+
+        assert_se(uncompress_startswith(compression, compressed, csize, (void**) &decompressed, &dsize, "foofoofoofoo", 12, ' '));
+        assert_se(!uncompress_startswith(compression, compressed, csize, (void**) &decompressed, &dsize, "foofoofoofoo", 12, 'w'));
+        assert_se(!uncompress_startswith(compression, compressed, csize, (void**) &decompressed, &dsize, "barbarbar", 9, ' '));
+}
+
+int main(int argc, char *argv[]) {
+        unsigned i;
+
+        for (i = 1; i < _OBJECT_COMPRESSED_MAX; i++) {
+                if (!compression_supported(i)) {
+                        log_info("Skipping %s, not supported.", object_compressed_to_string(i));
+                        continue;
+                }
+
+                test_compress_uncompress(i);
+                test_uncompress_startswith(i);
+        }
+
+        assert_se(object_compressed_from_string("lz4") == OBJECT_COMPRESSED_LZ4);
+        assert_se(object_compressed_from_string("xz") == OBJECT_COMPRESSED_XZ);
+        assert_se(object_compressed_from_string("gzip") < 0);
+
+        return 0;
+}
@@ -26,6 +26,7 @@
 #include <systemd/sd-journal.h>
 
 #include "journal-file.h"
+#include "compress.h"
 #include "journal-internal.h"
 #include "journal-vacuum.h"
 #include "util.h"
@@ -52,7 +53,7 @@ _noreturn_ static void log_assert_errno(const char *text, int eno, const char *f
 
 static JournalFile *test_open(const char *name) {
         JournalFile *f;
-        assert_ret(journal_file_open(name, O_RDWR|O_CREAT, 0644, true, false, NULL, NULL, NULL, &f));
+        assert_ret(journal_file_open(name, O_RDWR|O_CREAT, 0644, DEFAULT_COMPRESSION, false, NULL, NULL, NULL, &f));
         return f;
 }
 
@@ -60,6 +61,11 @@ static void test_close(JournalFile *f) {
         journal_file_close (f);
 }
 
+static void test_close_archived(JournalFile *f) {
+        f->header->state = STATE_ARCHIVED;
+        journal_file_close (f);
+}
+
 static void append_number(JournalFile *f, int n, uint64_t *seqnum) {
         char *p;
         dual_timestamp ts;
@@ -74,6 +80,21 @@ static void append_number(JournalFile *f, int n, uint64_t *seqnum) {
         free(p);
 }
 
+static void append_number_at(JournalFile *f, int n, usec_t realtime, usec_t monotonic) {
+        char *p;
+        dual_timestamp ts = {
+                .realtime = realtime,
+                .monotonic = monotonic,
+        };
+        struct iovec iovec[1];
+
+        assert_se(asprintf(&p, "NUMBER=%d", n) >= 0);
+        iovec[0].iov_base = p;
+        iovec[0].iov_len = strlen(p);
+        assert_ret(journal_file_append_entry(f, &ts, iovec, 1, NULL, NULL, NULL));
+        free(p);
+}
+
 static void test_check_number (sd_journal *j, int n) {
         const void *d;
         _cleanup_free_ char *k;
@@ -140,9 +161,24 @@ static void setup_interleaved(void) {
         test_close(two);
 }
 
+static void setup_archived(void) {
+        JournalFile *one, *two, *three;
+        one = test_open("one.journal");
+        two = test_open("two.journal");
+        three = test_open("three.journal");
+        append_number(one, 1, NULL);
+        append_number(two, 2, NULL);
+        append_number(one, 3, NULL);
+        append_number(three, 4, NULL);
+        test_close_archived(one);
+        test_close_archived(two);
+        test_close(three);
+}
+
 static void test_skip(void (*setup)(void)) {
         char t[] = "/tmp/journal-skip-XXXXXX";
         sd_journal *j;
+        uint64_t realtime;
         int r;
 
         assert_se(mkdtemp(t));
@@ -184,6 +220,101 @@ static void test_skip(void (*setup)(void)) {
         test_check_numbers_up(j, 4);
         sd_journal_close(j);
 
+        /* Seek to the time of an entry, iterate down and up.
+         */
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        assert_ret(r = sd_journal_next_skip(j, 3));
+        assert_se(r == 3);
+        assert_ret(sd_journal_get_realtime_usec(j, &realtime));
+        assert_ret(sd_journal_seek_realtime_usec(j, realtime));
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 1);
+        test_check_number(j, 3);
+        assert_ret(r = sd_journal_next(j));
+        assert_se(r == 1);
+        test_check_number(j, 4);
+        assert_ret(sd_journal_seek_realtime_usec(j, realtime - 1));
+        assert_ret(r = sd_journal_previous(j));
+        assert_se(r == 1);
+        test_check_numbers_up(j, 2);
+        sd_journal_close(j);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else {
+                journal_directory_vacuum(".", 3000000, 0, 0, NULL);
+
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+        }
+
+        puts("------------------------------------------------------------");
+}
+
+static unsigned test_collect_numbers(sd_journal *j, direction_t direction) {
+        unsigned seen = 0;
+        int r;
+
+        for (;;) {
+                const void *d;
+                size_t l;
+                int x;
+                _cleanup_free_ char *k = NULL;
+
+                assert_ret(r = direction == DIRECTION_DOWN ? sd_journal_next(j) : sd_journal_previous(j));
+                if (r == 0)
+                        break;
+
+                assert_ret(sd_journal_get_data(j, "NUMBER", &d, &l));
+                assert_se(k = strndup(d, l));
+                printf("%s\n", k);
+
+                assert_se(safe_atoi(k + 7, &x) >= 0);
+                assert_se(x >= 1 && x <= 4);
+                assert_se(!(seen & (1U << x)));
+                seen |= 1U << x;
+        }
+
+        return seen;
+}
+
+static void test_clock_jump(void) {
+        char t[] = "/tmp/journal-jump-XXXXXX";
+        JournalFile *one, *two;
+        sd_journal *j;
+        usec_t n;
+
+        /* The wallclock was stepped back after the first entry. The
+         * archived file is only loaded once the merge gets to it,
+         * which must not lose the entries the monotonic clock puts
+         * before those we returned already. */
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        n = now(CLOCK_REALTIME);
+
+        one = test_open("one.journal");
+        two = test_open("two.journal");
+        append_number_at(two, 1, n + 100 * USEC_PER_SEC, 1 * USEC_PER_SEC);
+        append_number_at(one, 2, n + 1 * USEC_PER_SEC, 2 * USEC_PER_SEC);
+        append_number_at(two, 3, n + 2 * USEC_PER_SEC, 3 * USEC_PER_SEC);
+        append_number_at(one, 4, n + 3 * USEC_PER_SEC, 4 * USEC_PER_SEC);
+        test_close(one);
+        test_close_archived(two);
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_head(j));
+        assert_se(test_collect_numbers(j, DIRECTION_DOWN) == 0x1e);
+        sd_journal_close(j);
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_seek_tail(j));
+        assert_se(test_collect_numbers(j, DIRECTION_UP) == 0x1e);
+        sd_journal_close(j);
+
         log_info("Done...");
 
         if (arg_keep)
@@ -208,7 +339,7 @@ static void test_sequence_numbers(void) {
         assert_se(chdir(t) >= 0);
 
         assert_se(journal_file_open("one.journal", O_RDWR|O_CREAT, 0644,
-                                    true, false, NULL, NULL, NULL, &one) == 0);
+                                    DEFAULT_COMPRESSION, false, NULL, NULL, NULL, &one) == 0);
 
         append_number(one, 1, &seqnum);
         printf("seqnum=%"PRIu64"\n", seqnum);
@@ -225,7 +356,7 @@ static void test_sequence_numbers(void) {
         memcpy(&seqnum_id, &one->header->seqnum_id, sizeof(sd_id128_t));
 
         assert_se(journal_file_open("two.journal", O_RDWR|O_CREAT, 0644,
-                                    true, false, NULL, NULL, one, &two) == 0);
+                                    DEFAULT_COMPRESSION, false, NULL, NULL, one, &two) == 0);
 
         assert(two->header->state == STATE_ONLINE);
         assert(!sd_id128_equal(two->header->file_id, one->header->file_id));
@@ -256,7 +387,7 @@ static void test_sequence_numbers(void) {
         seqnum = 0;
 
         assert_se(journal_file_open("two.journal", O_RDWR, 0,
-                                    true, false, NULL, NULL, NULL, &two) == 0);
+                                    DEFAULT_COMPRESSION, false, NULL, NULL, NULL, &two) == 0);
 
         assert(sd_id128_equal(two->header->seqnum_id, seqnum_id));
 
@@ -291,6 +422,9 @@ int main(int argc, char *argv[]) {
 
         test_skip(setup_sequential);
         test_skip(setup_interleaved);
+        test_skip(setup_archived);
+
+        test_clock_jump();
 
         test_sequence_numbers();
 
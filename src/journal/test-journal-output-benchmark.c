@@ -0,0 +1,147 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/***
+  This file is part of systemd.
+
+  Copyright 2026 agent <agent@local>
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <systemd/sd-journal.h>
+
+#include "journal-file.h"
+#include "journal-internal.h"
+#include "compress.h"
+#include "logs-show.h"
+#include "util.h"
+#include "log.h"
+
+/* Reports how many entries per second the export and JSON output
+ * modes format, directly and through the output pipeline. Pass a
+ * journal directory to measure on real data, otherwise a journal with
+ * N_ENTRIES made-up entries is generated. */
+
+#define N_ENTRIES 100000
+
+static void make_journal(const char *path) {
+        JournalFile *f;
+        unsigned i;
+
+        assert_se(journal_file_open(path, O_RDWR|O_CREAT, 0644, DEFAULT_COMPRESSION, false, NULL, NULL, NULL, &f) == 0);
+
+        for (i = 0; i < N_ENTRIES; i++) {
+                _cleanup_free_ char *message = NULL, *pid = NULL, *unit = NULL;
+                struct iovec iovec[5];
+                dual_timestamp ts;
+
+                dual_timestamp_get(&ts);
+
+                assert_se(asprintf(&message, "MESSAGE=Request %u finished with \"status\" %u", i, i % 7) >= 0);
+                assert_se(asprintf(&pid, "_PID=%u", 100 + i % 5000) >= 0);
+                assert_se(asprintf(&unit, "_SYSTEMD_UNIT=daemon%u.service", i % 50) >= 0);
+
+                IOVEC_SET_STRING(iovec[0], message);
+                IOVEC_SET_STRING(iovec[1], pid);
+                IOVEC_SET_STRING(iovec[2], unit);
+                IOVEC_SET_STRING(iovec[3], "PRIORITY=6");
+                IOVEC_SET_STRING(iovec[4], "_TRANSPORT=journal");
+
+                assert_se(journal_file_append_entry(f, &ts, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+
+        journal_file_close(f);
+}
+
+static void benchmark(sd_journal *j, FILE *f, OutputMode mode, int n_threads) {
+        OutputPipeline *p = NULL;
+        unsigned n = 0;
+        usec_t t;
+
+        if (n_threads >= 0)
+                assert_se(output_pipeline_new(&p, f, mode, 0, n_threads) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+
+        SD_JOURNAL_FOREACH(j) {
+                if (p)
+                        assert_se(output_pipeline_add(p, j) >= 0);
+                else
+                        assert_se(output_journal(f, j, mode, 0, 0, NULL) >= 0);
+                n++;
+        }
+
+        if (p) {
+                assert_se(output_pipeline_flush(p) >= 0);
+                output_pipeline_free(p);
+        } else
+                fflush(f);
+
+        t = MAX(now(CLOCK_MONOTONIC) - t, 1u);
+
+        if (n_threads >= 0)
+                log_info("%-6s pipelined, %2i threads: %8.0f entries/s",
+                         output_mode_to_string(mode), n_threads, (double) n * USEC_PER_SEC / t);
+        else
+                log_info("%-6s direct:                %8.0f entries/s",
+                         output_mode_to_string(mode), (double) n * USEC_PER_SEC / t);
+}
+
+int main(int argc, char *argv[]) {
+        static const OutputMode modes[] = { OUTPUT_EXPORT, OUTPUT_JSON };
+        char t[] = "/tmp/journal-output-XXXXXX";
+        _cleanup_journal_close_ sd_journal *j = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        long ncpus;
+        unsigned i;
+
+        log_set_max_level(LOG_DEBUG);
+
+        if (argc > 1)
+                assert_se(sd_journal_open_directory(&j, argv[1], 0) >= 0);
+        else {
+                /* journal_file_open requires a valid machine id */
+                if (access("/etc/machine-id", F_OK) != 0)
+                        return EXIT_TEST_SKIP;
+
+                assert_se(mkdtemp(t));
+                assert_se(chdir(t) >= 0);
+
+                make_journal("test.journal");
+
+                assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        }
+
+        f = fopen("/dev/null", "we");
+        assert_se(f);
+
+        ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        for (i = 0; i < ELEMENTSOF(modes); i++) {
+                benchmark(j, f, modes[i], -1);
+                benchmark(j, f, modes[i], 0);
+
+                if (ncpus > 1)
+                        benchmark(j, f, modes[i], (int) ncpus);
+        }
+
+        if (argc <= 1)
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        return 0;
+}
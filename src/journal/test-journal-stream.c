@@ -25,6 +25,7 @@
 #include <systemd/sd-journal.h>
 
 #include "journal-file.h"
+#include "compress.h"
 #include "journal-internal.h"
 #include "util.h"
 #include "log.h"
@@ -89,9 +90,9 @@ int main(int argc, char *argv[]) {
         assert_se(mkdtemp(t));
         assert_se(chdir(t) >= 0);
 
-        assert_se(journal_file_open("one.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &one) == 0);
-        assert_se(journal_file_open("two.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &two) == 0);
-        assert_se(journal_file_open("three.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &three) == 0);
+        assert_se(journal_file_open("one.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, false, NULL, NULL, NULL, &one) == 0);
+        assert_se(journal_file_open("two.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, false, NULL, NULL, NULL, &two) == 0);
+        assert_se(journal_file_open("three.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, false, NULL, NULL, NULL, &three) == 0);
 
         for (i = 0; i < N_ENTRIES; i++) {
                 char *p, *q;
@@ -176,8 +177,24 @@ int main(int argc, char *argv[]) {
         verify_contents(j, 0);
 
         assert_se(sd_journal_query_unique(j, "NUMBER") >= 0);
-        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+        i = 0;
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l) {
                 printf("%.*s\n", (int) l, (const char*) data);
+                i++;
+        }
+        assert_se(i == N_ENTRIES);
+
+        /* MAGIC values show up in all three files, but must only be
+         * returned once, also when enumerating a second time */
+        assert_se(sd_journal_query_unique(j, "MAGIC") >= 0);
+        i = 0;
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+                i++;
+        assert_se(i == 2);
+        i = 0;
+        SD_JOURNAL_FOREACH_UNIQUE(j, data, l)
+                i++;
+        assert_se(i == 2);
 
         assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
 
@@ -26,6 +26,7 @@
 
 #include "log.h"
 #include "journal-file.h"
+#include "compress.h"
 #include "journal-authenticate.h"
 #include "journal-vacuum.h"
 
@@ -45,7 +46,7 @@ static void test_non_empty(void) {
         assert_se(mkdtemp(t));
         assert_se(chdir(t) >= 0);
 
-        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, true, true, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, true, NULL, NULL, NULL, &f) == 0);
 
         dual_timestamp_get(&ts);
 
@@ -116,8 +117,8 @@ static void test_non_empty(void) {
 
         assert(journal_file_move_to_entry_by_seqnum(f, 10, DIRECTION_DOWN, &o, NULL) == 0);
 
-        journal_file_rotate(&f, true, true);
-        journal_file_rotate(&f, true, true);
+        journal_file_rotate(&f, DEFAULT_COMPRESSION, true);
+        journal_file_rotate(&f, DEFAULT_COMPRESSION, true);
 
         journal_file_close(f);
 
@@ -134,6 +135,56 @@ static void test_non_empty(void) {
         puts("------------------------------------------------------------");
 }
 
+static void test_batch(void) {
+        dual_timestamp ts;
+        JournalFile *f;
+        struct iovec iovec;
+        static const char test[] = "TEST1=1";
+        Object *o;
+        uint64_t p;
+        unsigned i;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, &f) == 0);
+
+        iovec.iov_base = (void*) test;
+        iovec.iov_len = strlen(test);
+
+        journal_file_begin_batch(f);
+
+        for (i = 0; i < 1000; i++) {
+                dual_timestamp_get(&ts);
+                assert_se(journal_file_append_entry(f, &ts, &iovec, 1, NULL, NULL, NULL) == 0);
+                assert_se(i > 0 || f->n_batched == 1);
+        }
+
+        journal_file_end_batch(f);
+        assert_se(f->n_batched == 0);
+
+        assert_se(journal_file_find_data_object(f, test, strlen(test), &o, &p) == 1);
+        assert_se(le64toh(o->data.n_entries) == 1000);
+
+        assert_se(journal_file_move_to_entry_by_seqnum(f, 777, DIRECTION_DOWN, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 777);
+
+        assert_se(journal_file_next_entry_for_data(f, NULL, 0, p, DIRECTION_UP, &o, NULL) == 1);
+        assert_se(le64toh(o->entry.seqnum) == 1000);
+
+        journal_file_close(f);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf_dangerous(t, false, true, false) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+
 static void test_empty(void) {
         JournalFile *f1, *f2, *f3, *f4;
         char t[] = "/tmp/journal-XXXXXX";
@@ -145,11 +196,11 @@ static void test_empty(void) {
 
         assert_se(journal_file_open("test.journal", O_RDWR|O_CREAT, 0666, false, false, NULL, NULL, NULL, &f1) == 0);
 
-        assert_se(journal_file_open("test-compress.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, &f2) == 0);
+        assert_se(journal_file_open("test-compress.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, false, NULL, NULL, NULL, &f2) == 0);
 
         assert_se(journal_file_open("test-seal.journal", O_RDWR|O_CREAT, 0666, false, true, NULL, NULL, NULL, &f3) == 0);
 
-        assert_se(journal_file_open("test-seal-compress.journal", O_RDWR|O_CREAT, 0666, true, true, NULL, NULL, NULL, &f4) == 0);
+        assert_se(journal_file_open("test-seal-compress.journal", O_RDWR|O_CREAT, 0666, DEFAULT_COMPRESSION, true, NULL, NULL, NULL, &f4) == 0);
 
         journal_file_print_header(f1);
         puts("");
@@ -184,6 +235,7 @@ int main(int argc, char *argv[]) {
                 return EXIT_TEST_SKIP;
 
         test_non_empty();
+        test_batch();
         test_empty();
 
         return 0;
@@ -28,13 +28,84 @@
 #include "util.h"
 #include "mmap-cache.h"
 
+static void test_sequential(int fd) {
+        /* Use an explicit policy, so that the window sizes, and
+         * hence the number of misses below, do not depend on the
+         * defaults of the architecture */
+        MMapCachePolicy policy = {
+                .window_size = 1024ULL*1024ULL,
+                .window_size_max = 4ULL*1024ULL*1024ULL,
+                .windows_min = 4,
+                .prefetch = true,
+        };
+        MMapCache *m;
+        struct stat st;
+        uint64_t offset;
+        unsigned n, hit, missed, sequential;
+        void *p;
+        int r;
+
+        assert_se(ftruncate(fd, 32ULL*1024ULL*1024ULL) >= 0);
+        assert_se(fstat(fd, &st) >= 0);
+
+        assert_se(m = mmap_cache_new(&policy));
+
+        /* Scanning forward should make the windows grow to the
+         * maximum size: [0,1M), [1M,3M), [3M,7M), [7M,11M),
+         * [11M,15M), [15M,19M) */
+        for (offset = 0, n = 0; offset < 16ULL*1024ULL*1024ULL; offset += 4096, n++) {
+                r = mmap_cache_get(m, fd, PROT_READ, 0, false, offset, 16, &st, &p);
+                assert_se(r >= 0);
+        }
+
+        hit = mmap_cache_get_hit(m);
+        missed = mmap_cache_get_missed(m);
+        sequential = mmap_cache_get_sequential(m);
+        assert_se(missed == 6);
+        assert_se(sequential == 5);
+        assert_se(hit == n - missed);
+
+        /* And the same backwards. The first window is centered
+         * around the offset and clamped to the end of the file,
+         * i.e. it is [32M-516K,32M). The following ones grow
+         * downwards from there: [30M-516K,32M-516K),
+         * [26M-516K,30M-516K), [22M-516K,26M-516K),
+         * [18M-516K,22M-516K) */
+        for (offset = 32ULL*1024ULL*1024ULL - 4096, n = 0; offset >= 20ULL*1024ULL*1024ULL; offset -= 4096, n++) {
+                r = mmap_cache_get(m, fd, PROT_READ, 1, false, offset, 16, &st, &p);
+                assert_se(r >= 0);
+        }
+
+        assert_se(mmap_cache_get_missed(m) - missed == 5);
+        assert_se(mmap_cache_get_sequential(m) - sequential == 4);
+        assert_se(mmap_cache_get_hit(m) - hit == n - 5);
+
+        mmap_cache_unref(m);
+
+        /* Jumping around doesn't count as sequential access */
+        assert_se(m = mmap_cache_new(&policy));
+
+        r = mmap_cache_get(m, fd, PROT_READ, 0, false, 24ULL*1024ULL*1024ULL, 16, &st, &p);
+        assert_se(r >= 0);
+        r = mmap_cache_get(m, fd, PROT_READ, 0, false, 4096, 16, &st, &p);
+        assert_se(r >= 0);
+        r = mmap_cache_get(m, fd, PROT_READ, 0, false, 16ULL*1024ULL*1024ULL, 16, &st, &p);
+        assert_se(r >= 0);
+
+        assert_se(mmap_cache_get_hit(m) == 0);
+        assert_se(mmap_cache_get_missed(m) == 3);
+        assert_se(mmap_cache_get_sequential(m) == 0);
+
+        mmap_cache_unref(m);
+}
+
 int main(int argc, char *argv[]) {
         int x, y, z, r;
         char px[] = "/tmp/testmmapXXXXXXX", py[] = "/tmp/testmmapYXXXXXX", pz[] = "/tmp/testmmapZXXXXXX";
         MMapCache *m;
         void *p, *q;
 
-        assert_se(m = mmap_cache_new());
+        assert_se(m = mmap_cache_new(NULL));
 
         x = mkstemp(px);
         assert(x >= 0);
@@ -71,6 +142,8 @@ int main(int argc, char *argv[]) {
 
         mmap_cache_unref(m);
 
+        test_sequential(y);
+
         close_nointr_nofail(x);
         close_nointr_nofail(y);
         close_nointr_nofail(z);
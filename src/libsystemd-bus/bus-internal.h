@@ -133,6 +133,21 @@ enum bus_auth {
         BUS_AUTH_ANONYMOUS
 };
 
+#define MESSAGE_CACHE_MAX 16
+
+/* Header and body buffers larger than this are not kept for reuse */
+#define MESSAGE_CACHE_BUFFER_SIZE_MAX (4*1024)
+
+/* The memory of a freed message, together with its header and body
+ * buffers, kept around for the next message on the bus */
+struct message_cache {
+        void *message;
+        void *header;
+        size_t header_allocated;
+        void *body;
+        size_t body_allocated;
+};
+
 struct sd_bus {
         /* We use atomic ref counting here since sd_bus_message
            objects retain references to their originating sd_bus but
@@ -168,8 +183,9 @@ struct sd_bus {
         sd_bus_message **rqueue;
         unsigned rqueue_size, rqueue_allocated;
 
+        /* Ring buffer, wqueue_size entries starting at wqueue_head */
         sd_bus_message **wqueue;
-        unsigned wqueue_size;
+        unsigned wqueue_head, wqueue_size, wqueue_allocated;
         size_t windex;
 
         uint64_t serial;
@@ -237,6 +253,11 @@ struct sd_bus {
         struct memfd_cache memfd_cache[MEMFD_CACHE_MAX];
         unsigned n_memfd_cache;
 
+        /* The same applies to the cache of freed messages */
+        pthread_mutex_t message_cache_mutex;
+        struct message_cache message_cache[MESSAGE_CACHE_MAX];
+        unsigned n_message_cache;
+
         pid_t original_pid;
 
         uint64_t hello_flags;
@@ -261,6 +282,10 @@ struct sd_bus {
 #define BUS_WQUEUE_MAX 1024
 #define BUS_RQUEUE_MAX 64*1024
 
+/* How much to read from a socket at once, if the message we are
+ * waiting for isn't larger than that */
+#define BUS_READ_AHEAD_SIZE (64*1024)
+
 #define BUS_MESSAGE_SIZE_MAX (64*1024*1024)
 #define BUS_AUTH_SIZE_MAX (64*1024)
 
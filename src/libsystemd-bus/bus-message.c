@@ -34,6 +34,7 @@
 #include "bus-internal.h"
 #include "bus-type.h"
 #include "bus-signature.h"
+#include "bus-util.h"
 
 static int message_append_basic(sd_bus_message *m, char type, const void *p, const void **stored);
 
@@ -114,13 +115,96 @@ static void message_reset_containers(sd_bus_message *m) {
         m->root_container.index = 0;
 }
 
+static bool message_cache_pop(sd_bus *bus, struct message_cache *c) {
+        assert(c);
+
+        if (!bus)
+                return false;
+
+        assert_se(pthread_mutex_lock(&bus->message_cache_mutex) >= 0);
+
+        if (bus->n_message_cache <= 0) {
+                assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) >= 0);
+                return false;
+        }
+
+        *c = bus->message_cache[--bus->n_message_cache];
+
+        assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) >= 0);
+
+        return true;
+}
+
+static bool message_cache_push(sd_bus *bus, const struct message_cache *c) {
+        assert(c);
+
+        if (!bus || !c->message)
+                return false;
+
+        assert_se(pthread_mutex_lock(&bus->message_cache_mutex) >= 0);
+
+        if (bus->n_message_cache >= ELEMENTSOF(bus->message_cache)) {
+                assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) >= 0);
+                return false;
+        }
+
+        bus->message_cache[bus->n_message_cache++] = *c;
+
+        assert_se(pthread_mutex_unlock(&bus->message_cache_mutex) >= 0);
+
+        return true;
+}
+
+void bus_message_flush_cache(sd_bus *bus) {
+        unsigned i;
+
+        assert(bus);
+
+        for (i = 0; i < bus->n_message_cache; i++) {
+                free(bus->message_cache[i].message);
+                free(bus->message_cache[i].header);
+                free(bus->message_cache[i].body);
+        }
+
+        bus->n_message_cache = 0;
+}
+
 static void message_free(sd_bus_message *m) {
+        struct message_cache c = {};
+        sd_bus *bus;
+
         assert(m);
 
+        bus = m->bus;
+
+        /* Messages we allocated ourselves go back to the cache of
+         * the bus, along with their header and body buffers, if
+         * those aren't too large */
+        if (m->recycle && bus) {
+                c.message = m;
+
+                if (m->free_header && m->header_allocated <= MESSAGE_CACHE_BUFFER_SIZE_MAX) {
+                        c.header = m->header;
+                        c.header_allocated = m->header_allocated;
+                        m->free_header = false;
+                }
+
+                if (m->n_body_parts > 0 && m->body.free_this && m->body.allocated <= MESSAGE_CACHE_BUFFER_SIZE_MAX) {
+                        c.body = m->body.data;
+                        c.body_allocated = m->body.allocated;
+                        m->body.free_this = false;
+                } else if (m->spare_body) {
+                        c.body = m->spare_body;
+                        c.body_allocated = m->spare_body_allocated;
+                        m->spare_body = NULL;
+                }
+        }
+
         if (m->free_header)
                 free(m->header);
 
         message_reset_parts(m);
+        free(m->spare_body);
 
         if (m->free_kdbus)
                 free(m->kdbus);
@@ -132,9 +216,6 @@ static void message_free(sd_bus_message *m) {
                 ioctl(m->bus->input_fd, KDBUS_CMD_FREE, &off);
         }
 
-        if (m->bus)
-                sd_bus_unref(m->bus);
-
         if (m->free_fds) {
                 close_many(m->fds, m->n_fds);
                 free(m->fds);
@@ -149,7 +230,15 @@ static void message_free(sd_bus_message *m) {
         free(m->peeked_signature);
 
         bus_creds_done(&m->creds);
-        free(m);
+
+        if (!message_cache_push(bus, &c)) {
+                free(c.header);
+                free(c.body);
+                free(m);
+        }
+
+        if (bus)
+                sd_bus_unref(bus);
 }
 
 static void *message_extend_fields(sd_bus_message *m, size_t align, size_t sz) {
@@ -171,10 +260,20 @@ static void *message_extend_fields(sd_bus_message *m, size_t align, size_t sz) {
         if (new_size > (size_t) ((uint32_t) -1))
                 goto poison;
 
-        if (m->free_header) {
-                np = realloc(m->header, ALIGN8(new_size));
+        if (m->free_header && ALIGN8(new_size) <= m->header_allocated)
+                np = m->header;
+        else if (m->free_header) {
+                size_t a;
+
+                /* Grow exponentially, fields are appended one by
+                 * one */
+                a = MAX(ALIGN8(new_size), m->header_allocated * 2);
+
+                np = realloc(m->header, a);
                 if (!np)
                         goto poison;
+
+                m->header_allocated = a;
         } else {
                 /* Initially, the header is allocated as part of of
                  * the sd_bus_message itself, let's replace it by
@@ -185,6 +284,7 @@ static void *message_extend_fields(sd_bus_message *m, size_t align, size_t sz) {
                         goto poison;
 
                 memcpy(np, m->header, sizeof(struct bus_header));
+                m->header_allocated = ALIGN8(new_size);
         }
 
         /* Zero out padding */
@@ -428,14 +528,34 @@ fail:
 }
 
 static sd_bus_message *message_new(sd_bus *bus, uint8_t type) {
+        struct message_cache c;
         sd_bus_message *m;
 
-        m = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
-        if (!m)
-                return NULL;
+        if (message_cache_pop(bus, &c)) {
+                m = c.message;
+                memzero(m, ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+        } else {
+                zero(c);
+
+                m = malloc0(ALIGN(sizeof(sd_bus_message)) + sizeof(struct bus_header));
+                if (!m)
+                        return NULL;
+        }
 
         m->n_ref = 1;
-        m->header = (struct bus_header*) ((uint8_t*) m + ALIGN(sizeof(struct sd_bus_message)));
+        m->recycle = true;
+
+        if (c.header) {
+                m->header = c.header;
+                m->header_allocated = c.header_allocated;
+                m->free_header = true;
+                zero(*m->header);
+        } else
+                m->header = (struct bus_header*) ((uint8_t*) m + ALIGN(sizeof(struct sd_bus_message)));
+
+        m->spare_body = c.body;
+        m->spare_body_allocated = c.body_allocated;
+
         m->header->endian = BUS_NATIVE_ENDIAN;
         m->header->type = type;
         m->header->version = bus ? bus->message_version : 1;
@@ -627,7 +747,7 @@ _public_ int sd_bus_message_new_method_errorf(
                 const char *format,
                 ...) {
 
-        _cleanup_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
         va_list ap;
 
         assert_return(name, -EINVAL);
@@ -646,7 +766,7 @@ _public_ int sd_bus_message_new_method_errno(
                 const sd_bus_error *p,
                 sd_bus_message **m) {
 
-        _cleanup_free_ sd_bus_error berror = SD_BUS_ERROR_NULL;
+        _cleanup_bus_error_free_ sd_bus_error berror = SD_BUS_ERROR_NULL;
 
         if (sd_bus_error_is_set(p))
                 return sd_bus_message_new_method_error(call, p, m);
@@ -663,7 +783,7 @@ _public_ int sd_bus_message_new_method_errnof(
                 const char *format,
                 ...) {
 
-        _cleanup_free_ sd_bus_error berror = SD_BUS_ERROR_NULL;
+        _cleanup_bus_error_free_ sd_bus_error berror = SD_BUS_ERROR_NULL;
         va_list ap;
 
         va_start(ap, format);
@@ -1017,13 +1137,30 @@ static int part_make_space(
 
                 part->munmap_this = true;
         } else {
-                n = realloc(part->data, MAX(sz, 1u));
-                if (!n) {
-                        m->poisoned = true;
-                        return -ENOMEM;
+                if (!part->data && m->spare_body) {
+                        part->data = m->spare_body;
+                        part->allocated = m->spare_body_allocated;
+                        m->spare_body = NULL;
+                }
+
+                if (!part->data || sz > part->allocated) {
+                        size_t a;
+
+                        /* Grow exponentially, the body is usually
+                         * built by appending one value after the
+                         * other */
+                        a = MAX3(sz, part->allocated * 2, 1u);
+
+                        n = realloc(part->data, a);
+                        if (!n) {
+                                m->poisoned = true;
+                                return -ENOMEM;
+                        }
+
+                        part->data = n;
+                        part->allocated = a;
                 }
 
-                part->data = n;
                 part->free_this = true;
         }
 
@@ -1278,7 +1415,7 @@ int message_append_basic(sd_bus_message *m, char type, const void *p, const void
                         *stored = (const uint8_t*) a + 4;
 
         } else if (type == SD_BUS_TYPE_SIGNATURE) {
-                *(uint8_t*) a = sz - 1;
+                *(uint8_t*) a = sz - 2;
                 memcpy((uint8_t*) a + 1, p, sz - 1);
 
                 if (stored)
@@ -1314,6 +1451,168 @@ _public_ int sd_bus_message_append_basic(sd_bus_message *m, char type, const voi
         return message_append_basic(m, type, p, NULL);
 }
 
+int bus_struct_layout_compile(BusStructLayout *l, const char *signature, const size_t offsets[]) {
+        size_t n;
+        unsigned i;
+
+        assert(l);
+        assert(signature);
+        assert(offsets);
+
+        n = strlen(signature);
+        if (n < 3 || signature[0] != SD_BUS_TYPE_STRUCT_BEGIN || signature[n-1] != SD_BUS_TYPE_STRUCT_END)
+                return -EINVAL;
+
+        if (n - 2 > BUS_STRUCT_LAYOUT_FIELDS_MAX)
+                return -EINVAL;
+
+        for (i = 0; i < n - 2; i++) {
+                char t = signature[i + 1];
+
+                /* File descriptors need to be duplicated and
+                 * attached to the message, leave them to the
+                 * generic code */
+                if (!bus_type_is_basic(t) || t == SD_BUS_TYPE_UNIX_FD)
+                        return -EINVAL;
+
+                l->fields[i].type = t;
+                l->fields[i].offset = offsets[i];
+                l->fields[i].align = bus_type_get_alignment(t);
+                l->fields[i].size = bus_type_is_trivial(t) ? bus_type_get_size(t) : 0;
+        }
+
+        l->signature = signature;
+        l->signature_length = n;
+        l->n_fields = n - 2;
+
+        return 0;
+}
+
+int bus_message_append_struct(sd_bus_message *m, const BusStructLayout *l, const void *p) {
+        const char *strings[BUS_STRUCT_LAYOUT_FIELDS_MAX];
+        size_t lengths[BUS_STRUCT_LAYOUT_FIELDS_MAX];
+        struct bus_container *c;
+        size_t sz = 0, k = 0;
+        unsigned i;
+        uint8_t *a;
+
+        assert_return(m, -EINVAL);
+        assert_return(l, -EINVAL);
+        assert_return(p, -EINVAL);
+        assert_return(!m->sealed, -EPERM);
+        assert_return(!m->poisoned, -ESTALE);
+
+        /* First pass: validate the strings and calculate the
+         * serialized size of the struct, relative to its 8 byte
+         * aligned beginning */
+        for (i = 0; i < l->n_fields; i++) {
+                const void *f = (const uint8_t*) p + l->fields[i].offset;
+
+                sz = ALIGN_TO(sz, l->fields[i].align);
+
+                switch (l->fields[i].type) {
+
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_OBJECT_PATH:
+                        strings[i] = *(const char**) f;
+
+                        /* Like message_append_basic() we serialize
+                         * a NULL string into the empty string */
+                        if (l->fields[i].type == SD_BUS_TYPE_STRING)
+                                strings[i] = strempty(strings[i]);
+                        else if (!strings[i])
+                                return -EINVAL;
+
+                        lengths[i] = strlen(strings[i]);
+                        sz += 4 + lengths[i] + 1;
+                        break;
+
+                case SD_BUS_TYPE_SIGNATURE:
+                        strings[i] = *(const char**) f;
+                        if (!strings[i])
+                                return -EINVAL;
+
+                        lengths[i] = strlen(strings[i]);
+                        if (lengths[i] > 255)
+                                return -EINVAL;
+
+                        sz += 1 + lengths[i] + 1;
+                        break;
+
+                default:
+                        sz += l->fields[i].size;
+                        break;
+                }
+        }
+
+        c = message_get_container(m);
+
+        /* The whole struct is checked against the container
+         * signature at once */
+        if (c->signature && c->signature[c->index]) {
+                if (strncmp(c->signature + c->index, l->signature, l->signature_length) != 0)
+                        return -ENXIO;
+        } else {
+                char *e;
+
+                if (c->enclosing != 0)
+                        return -ENXIO;
+
+                e = strextend(&c->signature, l->signature, NULL);
+                if (!e) {
+                        m->poisoned = true;
+                        return -ENOMEM;
+                }
+        }
+
+        a = message_extend_body(m, 8, sz);
+        if (!a)
+                return -ENOMEM;
+
+        /* Second pass: write the fields out */
+        for (i = 0; i < l->n_fields; i++) {
+                const void *f = (const uint8_t*) p + l->fields[i].offset;
+                size_t start;
+
+                start = ALIGN_TO(k, l->fields[i].align);
+                memzero(a + k, start - k);
+                k = start;
+
+                switch (l->fields[i].type) {
+
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_OBJECT_PATH:
+                        *(uint32_t*) (a + k) = lengths[i];
+                        memcpy(a + k + 4, strings[i], lengths[i] + 1);
+                        k += 4 + lengths[i] + 1;
+                        break;
+
+                case SD_BUS_TYPE_SIGNATURE:
+                        a[k] = lengths[i];
+                        memcpy(a + k + 1, strings[i], lengths[i] + 1);
+                        k += 1 + lengths[i] + 1;
+                        break;
+
+                case SD_BUS_TYPE_BOOLEAN:
+                        *(uint32_t*) (a + k) = !!*(const int*) f;
+                        k += 4;
+                        break;
+
+                default:
+                        memcpy(a + k, f, l->fields[i].size);
+                        k += l->fields[i].size;
+                        break;
+                }
+        }
+
+        assert(k == sz);
+
+        if (c->enclosing != SD_BUS_TYPE_ARRAY)
+                c->index += l->signature_length;
+
+        return 0;
+}
+
 _public_ int sd_bus_message_append_string_space(
                 sd_bus_message *m,
                 size_t size,
@@ -1815,8 +2114,7 @@ int bus_message_append_ap(
                 }
 
                 case SD_BUS_TYPE_INT64:
-                case SD_BUS_TYPE_UINT64:
-                case SD_BUS_TYPE_DOUBLE: {
+                case SD_BUS_TYPE_UINT64: {
                         uint64_t x;
 
                         x = va_arg(ap, uint64_t);
@@ -1824,6 +2122,16 @@ int bus_message_append_ap(
                         break;
                 }
 
+                case SD_BUS_TYPE_DOUBLE: {
+                        double x;
+
+                        /* Doubles are passed differently from
+                         * integers through varargs */
+                        x = va_arg(ap, double);
+                        r = sd_bus_message_append_basic(m, *t, &x);
+                        break;
+                }
+
                 case SD_BUS_TYPE_STRING:
                 case SD_BUS_TYPE_OBJECT_PATH:
                 case SD_BUS_TYPE_SIGNATURE: {
@@ -2473,39 +2781,25 @@ static bool validate_object_path(const char *s, size_t l) {
         return true;
 }
 
-_public_ int sd_bus_message_read_basic(sd_bus_message *m, char type, void *p) {
-        struct bus_container *c;
+static int message_read_basic_value(sd_bus_message *m, char type, size_t *rindex, void *p) {
         void *q;
         int r;
 
-        assert_return(m, -EINVAL);
-        assert_return(m->sealed, -EPERM);
-        assert_return(bus_type_is_basic(type), -EINVAL);
-
-        if (message_end_of_signature(m))
-                return -ENXIO;
-
-        if (message_end_of_array(m, m->rindex))
-                return 0;
-
-        c = message_get_container(m);
-        if (c->signature[c->index] != type)
-                return -ENXIO;
+        assert(m);
+        assert(rindex);
 
         switch (type) {
 
         case SD_BUS_TYPE_STRING:
         case SD_BUS_TYPE_OBJECT_PATH: {
                 uint32_t l;
-                size_t rindex;
 
-                rindex = m->rindex;
-                r = message_peek_body(m, &rindex, 4, 4, &q);
+                r = message_peek_body(m, rindex, 4, 4, &q);
                 if (r <= 0)
                         return r;
 
                 l = BUS_MESSAGE_BSWAP32(m, *(uint32_t*) q);
-                r = message_peek_body(m, &rindex, 1, l+1, &q);
+                r = message_peek_body(m, rindex, 1, l+1, &q);
                 if (r < 0)
                         return r;
                 if (r == 0)
@@ -2519,7 +2813,6 @@ _public_ int sd_bus_message_read_basic(sd_bus_message *m, char type, void *p) {
                                 return -EBADMSG;
                 }
 
-                m->rindex = rindex;
                 if (p)
                         *(const char**) p = q;
 
@@ -2528,15 +2821,13 @@ _public_ int sd_bus_message_read_basic(sd_bus_message *m, char type, void *p) {
 
         case SD_BUS_TYPE_SIGNATURE: {
                 uint8_t l;
-                size_t rindex;
 
-                rindex = m->rindex;
-                r = message_peek_body(m, &rindex, 1, 1, &q);
+                r = message_peek_body(m, rindex, 1, 1, &q);
                 if (r <= 0)
                         return r;
 
                 l = *(uint8_t*) q;
-                r = message_peek_body(m, &rindex, 1, l+1, &q);
+                r = message_peek_body(m, rindex, 1, l+1, &q);
                 if (r < 0)
                         return r;
                 if (r == 0)
@@ -2545,8 +2836,6 @@ _public_ int sd_bus_message_read_basic(sd_bus_message *m, char type, void *p) {
                 if (!validate_signature(q, l))
                         return -EBADMSG;
 
-                m->rindex = rindex;
-
                 if (p)
                         *(const char**) p = q;
                 break;
@@ -2554,14 +2843,12 @@ _public_ int sd_bus_message_read_basic(sd_bus_message *m, char type, void *p) {
 
         default: {
                 ssize_t sz, align;
-                size_t rindex;
 
                 align = bus_type_get_alignment(type);
                 sz = bus_type_get_size(type);
                 assert(align > 0 && sz > 0);
 
-                rindex = m->rindex;
-                r = message_peek_body(m, &rindex, align, sz, &q);
+                r = message_peek_body(m, rindex, align, sz, &q);
                 if (r <= 0)
                         return r;
 
@@ -2612,18 +2899,87 @@ _public_ int sd_bus_message_read_basic(sd_bus_message *m, char type, void *p) {
                         assert_not_reached("Unknown basic type...");
                 }
 
-                m->rindex = rindex;
-
                 break;
         }
         }
 
+        return 1;
+}
+
+_public_ int sd_bus_message_read_basic(sd_bus_message *m, char type, void *p) {
+        struct bus_container *c;
+        size_t rindex;
+        int r;
+
+        assert_return(m, -EINVAL);
+        assert_return(m->sealed, -EPERM);
+        assert_return(bus_type_is_basic(type), -EINVAL);
+
+        if (message_end_of_signature(m))
+                return -ENXIO;
+
+        if (message_end_of_array(m, m->rindex))
+                return 0;
+
+        c = message_get_container(m);
+        if (c->signature[c->index] != type)
+                return -ENXIO;
+
+        rindex = m->rindex;
+        r = message_read_basic_value(m, type, &rindex, p);
+        if (r <= 0)
+                return r;
+
+        m->rindex = rindex;
+
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
                 c->index++;
 
         return 1;
 }
 
+int bus_message_read_struct(sd_bus_message *m, const BusStructLayout *l, void *p) {
+        struct bus_container *c;
+        size_t rindex;
+        unsigned i;
+        int r;
+
+        assert_return(m, -EINVAL);
+        assert_return(l, -EINVAL);
+        assert_return(p, -EINVAL);
+        assert_return(m->sealed, -EPERM);
+
+        if (message_end_of_signature(m))
+                return -ENXIO;
+
+        if (message_end_of_array(m, m->rindex))
+                return 0;
+
+        c = message_get_container(m);
+        if (strncmp(c->signature + c->index, l->signature, l->signature_length) != 0)
+                return -ENXIO;
+
+        rindex = m->rindex;
+        r = message_peek_body(m, &rindex, 8, 0, NULL);
+        if (r <= 0)
+                return r;
+
+        for (i = 0; i < l->n_fields; i++) {
+                r = message_read_basic_value(m, l->fields[i].type, &rindex, (uint8_t*) p + l->fields[i].offset);
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        return -EBADMSG;
+        }
+
+        m->rindex = rindex;
+
+        if (c->enclosing != SD_BUS_TYPE_ARRAY)
+                c->index += l->signature_length;
+
+        return 1;
+}
+
 static int bus_message_enter_array(
                 sd_bus_message *m,
                 struct bus_container *c,
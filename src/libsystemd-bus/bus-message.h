@@ -58,6 +58,7 @@ struct bus_body_part {
         void *data;
         size_t size;
         size_t mapped;
+        size_t allocated;
         int memfd;
         bool free_this:1;
         bool munmap_this:1;
@@ -93,12 +94,18 @@ struct sd_bus_message {
         bool free_fds:1;
         bool release_kdbus:1;
         bool poisoned:1;
+        bool recycle:1;
 
         struct bus_header *header;
+        size_t header_allocated;
         struct bus_body_part body;
         struct bus_body_part *body_end;
         unsigned n_body_parts;
 
+        /* Body buffer from the message cache, not used yet */
+        void *spare_body;
+        size_t spare_body_allocated;
+
         size_t rindex;
         struct bus_body_part *cached_rindex_part;
         size_t cached_rindex_part_begin;
@@ -200,6 +207,29 @@ const char* bus_message_get_arg(sd_bus_message *m, unsigned i);
 
 int bus_message_append_ap(sd_bus_message *m, const char *types, va_list ap);
 
+#define BUS_STRUCT_LAYOUT_FIELDS_MAX 32
+
+/* A struct signature made only of basic types, except for "h",
+ * compiled once into the offsets of the matching members of a C
+ * struct. Strings, object paths and signatures are stored as const
+ * char* there, booleans as int. Such a struct can then be appended
+ * and read in a single pass, with a single signature check. */
+typedef struct BusStructLayout {
+        const char *signature;
+        size_t signature_length;
+        unsigned n_fields;
+        struct {
+                char type;
+                uint8_t align;
+                uint8_t size; /* 0 for strings */
+                size_t offset;
+        } fields[BUS_STRUCT_LAYOUT_FIELDS_MAX];
+} BusStructLayout;
+
+int bus_struct_layout_compile(BusStructLayout *l, const char *signature, const size_t offsets[]);
+int bus_message_append_struct(sd_bus_message *m, const BusStructLayout *l, const void *p);
+int bus_message_read_struct(sd_bus_message *m, const BusStructLayout *l, void *p);
+
 int bus_message_parse_fields(sd_bus_message *m);
 
 bool bus_header_is_complete(struct bus_header *h, size_t size);
@@ -215,4 +245,6 @@ void bus_body_part_unmap(struct bus_body_part *part);
 
 int bus_message_to_errno(sd_bus_message *m);
 
+void bus_message_flush_cache(sd_bus *bus);
+
 int bus_message_new_synthetic_error(sd_bus *bus, uint64_t serial, const sd_bus_error *e, sd_bus_message **m);
@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
 #include <sys/poll.h>
 #include <byteswap.h>
 
@@ -779,56 +780,78 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+/* Writes out the messages m[0..n), starting at offset *idx of the
+ * first one. *idx is advanced by the number of bytes written, which
+ * may well reach into later messages. */
+int bus_socket_write_messages(sd_bus *bus, sd_bus_message **m, unsigned n, size_t *idx) {
         struct iovec *iov;
+        unsigned i, j, n_iovec = 0;
         ssize_t k;
-        size_t n;
-        unsigned j;
         int r;
 
         assert(bus);
         assert(m);
+        assert(n > 0);
         assert(idx);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        if (*idx >= BUS_MESSAGE_SIZE(m[0]))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        /* Gather as many messages as fit into a single
+         * sendmsg(). File descriptors are passed along with the
+         * first byte written, hence a message carrying some ends the
+         * batch before it, so that it starts one of its own. */
+        for (i = 0; i < n; i++) {
+                if (i > 0 && m[i]->n_fds > 0)
+                        break;
+
+                r = bus_message_setup_iovec(m[i]);
+                if (r < 0)
+                        return r;
+
+                if (i > 0 && n_iovec + m[i]->n_iovec > IOV_MAX)
+                        break;
+
+                n_iovec += m[i]->n_iovec;
+        }
+        n = i;
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = alloca(n);
-        memcpy(iov, m->iovec, n);
+        iov = newa(struct iovec, n_iovec);
+        for (i = 0, j = 0; i < n; i++) {
+                memcpy(iov + j, m[i]->iovec, sizeof(struct iovec) * m[i]->n_iovec);
+                j += m[i]->n_iovec;
+        }
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         if (bus->prefer_writev)
-                k = writev(bus->output_fd, iov, m->n_iovec);
+                k = writev(bus->output_fd, iov + j, n_iovec - j);
         else {
                 struct msghdr mh;
                 zero(mh);
 
-                if (m->n_fds > 0) {
+                /* If the message was partially written already
+                 * its fds went out with the first part */
+                if (m[0]->n_fds > 0 && *idx == 0) {
                         struct cmsghdr *control;
-                        control = alloca(CMSG_SPACE(sizeof(int) * m->n_fds));
+                        control = alloca(CMSG_SPACE(sizeof(int) * m[0]->n_fds));
 
                         mh.msg_control = control;
                         control->cmsg_level = SOL_SOCKET;
                         control->cmsg_type = SCM_RIGHTS;
-                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
-                        memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                        mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m[0]->n_fds);
+                        memcpy(CMSG_DATA(control), m[0]->fds, sizeof(int) * m[0]->n_fds);
                 }
 
-                mh.msg_iov = iov;
-                mh.msg_iovlen = m->n_iovec;
+                mh.msg_iov = iov + j;
+                mh.msg_iovlen = n_iovec - j;
 
                 k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
                 if (k < 0 && errno == ENOTSOCK) {
                         bus->prefer_writev = true;
-                        k = writev(bus->output_fd, iov, m->n_iovec);
+                        k = writev(bus->output_fd, iov + j, n_iovec - j);
                 }
         }
 
@@ -839,16 +862,31 @@ int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
         return 1;
 }
 
-static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
+int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+        return bus_socket_write_messages(bus, &m, 1, idx);
+}
+
+static uint32_t bus_socket_peek_uint32(const uint8_t *p, uint8_t endian) {
+        uint32_t u;
+
+        /* Messages in the read buffer are not necessarily aligned */
+        memcpy(&u, p, sizeof(u));
+
+        return endian == BUS_LITTLE_ENDIAN ? le32toh(u) : be32toh(u);
+}
+
+static int bus_socket_read_message_need(sd_bus *bus, size_t offset, size_t *need) {
+        const uint8_t *p;
         uint32_t a, b;
         uint8_t e;
         uint64_t sum;
 
         assert(bus);
         assert(need);
+        assert(offset <= bus->rbuffer_size);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-        if (bus->rbuffer_size < sizeof(struct bus_header)) {
+        if (bus->rbuffer_size - offset < sizeof(struct bus_header)) {
                 *need = sizeof(struct bus_header) + 8;
 
                 /* Minimum message size:
@@ -870,19 +908,15 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
                 return 0;
         }
 
-        a = ((const uint32_t*) bus->rbuffer)[1];
-        b = ((const uint32_t*) bus->rbuffer)[3];
-
-        e = ((const uint8_t*) bus->rbuffer)[0];
-        if (e == BUS_LITTLE_ENDIAN) {
-                a = le32toh(a);
-                b = le32toh(b);
-        } else if (e == BUS_BIG_ENDIAN) {
-                a = be32toh(a);
-                b = be32toh(b);
-        } else
+        p = (const uint8_t*) bus->rbuffer + offset;
+
+        e = p[0];
+        if (e != BUS_LITTLE_ENDIAN && e != BUS_BIG_ENDIAN)
                 return -EBADMSG;
 
+        a = bus_socket_peek_uint32(p + 4, e);
+        b = bus_socket_peek_uint32(p + 12, e);
+
         sum = (uint64_t) sizeof(struct bus_header) + (uint64_t) ALIGN_TO(b, 8) + (uint64_t) a;
         if (sum >= BUS_MESSAGE_SIZE_MAX)
                 return -ENOBUFS;
@@ -891,54 +925,227 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
         return 0;
 }
 
-static int bus_socket_make_message(sd_bus *bus, size_t size) {
+static int bus_socket_read_message_unix_fds(const uint8_t *p, size_t size, unsigned *n_fds) {
+        size_t ri, end;
+        uint8_t e;
+
+        assert(p);
+        assert(size >= sizeof(struct bus_header));
+        assert(n_fds);
+
+        /* Finds the UNIX_FDS header field of a complete message
+         * in the read buffer, so that we know how many of the fds
+         * received belong to it, and how many to the messages
+         * after it. Only fields with a basic type as defined by the
+         * specification are understood, for anything else we
+         * return -EOPNOTSUPP. */
+
+        e = p[0];
+        ri = sizeof(struct bus_header);
+        end = ri + bus_socket_peek_uint32(p + 12, e);
+        if (end > size)
+                return -EBADMSG;
+
+        while (ri < end) {
+                uint8_t code, l;
+                uint32_t u;
+                size_t len;
+
+                ri = ALIGN8(ri);
+                if (ri + 4 > end)
+                        return -EBADMSG;
+
+                code = p[ri];
+                l = p[ri + 1];
+                if (l != 1 || p[ri + 3] != 0)
+                        return -EOPNOTSUPP;
+
+                switch (p[ri + 2]) {
+
+                case SD_BUS_TYPE_UINT32:
+                        ri = ALIGN4(ri + 4);
+                        if (ri + 4 > end)
+                                return -EBADMSG;
+
+                        u = bus_socket_peek_uint32(p + ri, e);
+                        if (code == BUS_MESSAGE_HEADER_UNIX_FDS) {
+                                *n_fds = u;
+                                return 0;
+                        }
+
+                        ri += 4;
+                        break;
+
+                case SD_BUS_TYPE_STRING:
+                case SD_BUS_TYPE_OBJECT_PATH:
+                        ri = ALIGN4(ri + 4);
+                        if (ri + 4 > end)
+                                return -EBADMSG;
+
+                        /* Length, string and trailing NUL */
+                        len = bus_socket_peek_uint32(p + ri, e);
+                        if (len >= end - ri - 4)
+                                return -EBADMSG;
+
+                        ri += 4 + len + 1;
+                        break;
+
+                case SD_BUS_TYPE_SIGNATURE:
+                        ri += 4;
+                        if (ri + 1 > end)
+                                return -EBADMSG;
+
+                        /* Length byte, signature and trailing NUL */
+                        len = p[ri];
+                        if (len >= end - ri - 1)
+                                return -EBADMSG;
+
+                        ri += 1 + len + 1;
+                        break;
+
+                default:
+                        return -EOPNOTSUPP;
+                }
+        }
+
+        *n_fds = 0;
+        return 0;
+}
+
+static int bus_socket_make_message(sd_bus *bus, size_t offset, size_t size) {
         sd_bus_message *t;
+        int *fds = NULL;
+        unsigned n_fds = 0;
         void *b;
         int r;
 
         assert(bus);
-        assert(bus->rbuffer_size >= size);
+        assert(bus->rbuffer_size >= offset + size);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
         r = bus_rqueue_make_room(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size > size) {
-                b = memdup((const uint8_t*) bus->rbuffer + size,
-                           bus->rbuffer_size - size);
-                if (!b)
+        if (bus->n_fds > 0) {
+                /* The fds are received along with the first byte of
+                 * the message they belong to, but reading ahead we
+                 * might have got those of a later message too. If we
+                 * cannot tell, pass them all, as we always did, and
+                 * have the message parser judge. */
+                r = bus_socket_read_message_unix_fds((const uint8_t*) bus->rbuffer + offset, size, &n_fds);
+                if (r < 0 || n_fds > bus->n_fds)
+                        n_fds = bus->n_fds;
+
+                if (n_fds == bus->n_fds)
+                        fds = bus->fds;
+                else if (n_fds > 0) {
+                        fds = newdup(int, bus->fds, n_fds);
+                        if (!fds)
+                                return -ENOMEM;
+                }
+        }
+
+        /* A large message that fills the buffer on its own gets to
+         * keep it, everything else is copied out so that the buffer
+         * can be reused for reading ahead */
+        if (offset == 0 && size == bus->rbuffer_size && size > BUS_READ_AHEAD_SIZE)
+                b = bus->rbuffer;
+        else {
+                b = memdup((const uint8_t*) bus->rbuffer + offset, size);
+                if (!b) {
+                        if (fds != bus->fds)
+                                free(fds);
                         return -ENOMEM;
-        } else
-                b = NULL;
+                }
+        }
 
         r = bus_message_from_malloc(bus,
-                                    bus->rbuffer, size,
-                                    bus->fds, bus->n_fds,
+                                    b, size,
+                                    fds, n_fds,
                                     bus->ucred_valid ? &bus->ucred : NULL,
                                     bus->label[0] ? bus->label : NULL,
                                     &t);
         if (r < 0) {
-                free(b);
+                if (b != bus->rbuffer)
+                        free(b);
+                if (fds != bus->fds)
+                        free(fds);
                 return r;
         }
 
-        bus->rbuffer = b;
-        bus->rbuffer_size -= size;
+        if (b == bus->rbuffer) {
+                bus->rbuffer = NULL;
+                bus->rbuffer_size = 0;
+        }
 
-        bus->fds = NULL;
-        bus->n_fds = 0;
+        if (fds == bus->fds) {
+                bus->fds = NULL;
+                bus->n_fds = 0;
+        } else if (n_fds > 0) {
+                memmove(bus->fds, bus->fds + n_fds, sizeof(int) * (bus->n_fds - n_fds));
+                bus->n_fds -= n_fds;
+        }
 
         bus->rqueue[bus->rqueue_size++] = t;
 
         return 1;
 }
 
+static int bus_socket_make_messages(sd_bus *bus) {
+        size_t offset = 0, need;
+        int r, ret = 0;
+
+        assert(bus);
+
+        /* Move all complete messages from the read buffer to the
+         * read queue. Nothing will wake us up for those left behind
+         * in the buffer. */
+
+        while (bus->rbuffer_size > offset) {
+                r = bus_socket_read_message_need(bus, offset, &need);
+                if (r < 0) {
+                        ret = r;
+                        break;
+                }
+
+                if (bus->rbuffer_size - offset < need)
+                        break;
+
+                r = bus_socket_make_message(bus, offset, need);
+                if (r < 0) {
+                        ret = r;
+                        break;
+                }
+
+                ret = 1;
+
+                /* The message took over the buffer */
+                if (!bus->rbuffer)
+                        return ret;
+
+                offset += need;
+        }
+
+        if (offset > 0) {
+                bus->rbuffer_size -= offset;
+
+                if (bus->rbuffer_size > 0)
+                        memmove(bus->rbuffer, (uint8_t*) bus->rbuffer + offset, bus->rbuffer_size);
+                else {
+                        free(bus->rbuffer);
+                        bus->rbuffer = NULL;
+                }
+        }
+
+        return ret;
+}
+
 int bus_socket_read_message(sd_bus *bus) {
         struct msghdr mh;
         struct iovec iov;
         ssize_t k;
-        size_t need;
+        size_t need, n;
         int r;
         void *b;
         union {
@@ -953,14 +1160,19 @@ int bus_socket_read_message(sd_bus *bus) {
         assert(bus);
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_make_messages(bus);
+        if (r != 0)
+                return r;
+
+        r = bus_socket_read_message_need(bus, 0, &need);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
+        /* Read ahead as much as fits in the buffer, unless the
+         * message is large, in which case we read just that. */
+        n = MAX(need, (size_t) BUS_READ_AHEAD_SIZE);
 
-        b = realloc(bus->rbuffer, need);
+        b = realloc(bus->rbuffer, n);
         if (!b)
                 return -ENOMEM;
 
@@ -968,7 +1180,7 @@ int bus_socket_read_message(sd_bus *bus) {
 
         zero(iov);
         iov.iov_base = (uint8_t*) bus->rbuffer + bus->rbuffer_size;
-        iov.iov_len = need - bus->rbuffer_size;
+        iov.iov_len = n - bus->rbuffer_size;
 
         if (bus->prefer_readv)
                 k = readv(bus->input_fd, &iov, 1);
@@ -1010,7 +1222,7 @@ int bus_socket_read_message(sd_bus *bus) {
                                         return -EIO;
                                 }
 
-                                f = realloc(bus->fds, sizeof(int) + (bus->n_fds + n));
+                                f = realloc(bus->fds, sizeof(int) * (bus->n_fds + n));
                                 if (!f) {
                                         close_many((int*) CMSG_DATA(cmsg), n);
                                         return -ENOMEM;
@@ -1043,13 +1255,10 @@ int bus_socket_read_message(sd_bus *bus) {
                 }
         }
 
-        r = bus_socket_read_message_need(bus, &need);
+        r = bus_socket_make_messages(bus);
         if (r < 0)
                 return r;
 
-        if (bus->rbuffer_size >= need)
-                return bus_socket_make_message(bus, need);
-
         return 1;
 }
 
@@ -1149,23 +1149,41 @@ int bus_log_create_error(int r) {
         return r;
 }
 
+static const BusStructLayout *unit_info_layout(void) {
+        static const size_t offsets[] = {
+                offsetof(UnitInfo, id),
+                offsetof(UnitInfo, description),
+                offsetof(UnitInfo, load_state),
+                offsetof(UnitInfo, active_state),
+                offsetof(UnitInfo, sub_state),
+                offsetof(UnitInfo, following),
+                offsetof(UnitInfo, unit_path),
+                offsetof(UnitInfo, job_id),
+                offsetof(UnitInfo, job_type),
+                offsetof(UnitInfo, job_path),
+        };
+        static BusStructLayout layout = {};
+
+        /* ListUnits() replies carry one of these per unit, hence
+         * compile the signature only once */
+        if (!layout.signature)
+                assert_se(bus_struct_layout_compile(&layout, "(ssssssouso)", offsets) >= 0);
+
+        return &layout;
+}
+
 int bus_parse_unit_info(sd_bus_message *message, UnitInfo *u) {
         assert(message);
         assert(u);
 
-        return sd_bus_message_read(
-                        message,
-                        "(ssssssouso)",
-                        &u->id,
-                        &u->description,
-                        &u->load_state,
-                        &u->active_state,
-                        &u->sub_state,
-                        &u->following,
-                        &u->unit_path,
-                        &u->job_id,
-                        &u->job_type,
-                        &u->job_path);
+        return bus_message_read_struct(message, unit_info_layout(), u);
+}
+
+int bus_append_unit_info(sd_bus_message *message, const UnitInfo *u) {
+        assert(message);
+        assert(u);
+
+        return bus_message_append_struct(message, unit_info_layout(), u);
 }
 
 int bus_maybe_reply_error(sd_bus_message *m, int r, sd_bus_error *error) {
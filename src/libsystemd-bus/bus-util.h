@@ -134,6 +134,7 @@ typedef struct UnitInfo {
 } UnitInfo;
 
 int bus_parse_unit_info(sd_bus_message *message, UnitInfo *u);
+int bus_append_unit_info(sd_bus_message *message, const UnitInfo *u);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(sd_bus*, sd_bus_unref);
 DEFINE_TRIVIAL_CLEANUP_FUNC(sd_bus_message*, sd_bus_message_unref);
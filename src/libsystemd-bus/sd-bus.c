@@ -50,6 +50,7 @@
 #include "bus-protocol.h"
 
 static int bus_poll(sd_bus *bus, bool need_more, uint64_t timeout_usec);
+static int process_reply(sd_bus *bus, sd_bus_message *m);
 
 static void bus_close_fds(sd_bus *b) {
         assert(b);
@@ -110,11 +111,12 @@ static void bus_reset_queues(sd_bus *b) {
         free(b->rqueue);
 
         for (i = 0; i < b->wqueue_size; i++)
-                sd_bus_message_unref(b->wqueue[i]);
+                sd_bus_message_unref(b->wqueue[(b->wqueue_head + i) % b->wqueue_allocated]);
         free(b->wqueue);
 
         b->rqueue = b->wqueue = NULL;
         b->rqueue_size = b->wqueue_size = 0;
+        b->wqueue_head = b->wqueue_allocated = 0;
 }
 
 static void bus_free(sd_bus *b) {
@@ -164,8 +166,10 @@ static void bus_free(sd_bus *b) {
         hashmap_free(b->nodes);
 
         bus_kernel_flush_memfd(b);
+        bus_message_flush_cache(b);
 
         assert_se(pthread_mutex_destroy(&b->memfd_cache_mutex) == 0);
+        assert_se(pthread_mutex_destroy(&b->message_cache_mutex) == 0);
 
         free(b);
 }
@@ -188,6 +192,7 @@ _public_ int sd_bus_new(sd_bus **ret) {
         r->original_pid = getpid();
 
         assert_se(pthread_mutex_init(&r->memfd_cache_mutex, NULL) == 0);
+        assert_se(pthread_mutex_init(&r->message_cache_mutex, NULL) == 0);
 
         /* We guarantee that wqueue always has space for at least one
          * entry */
@@ -196,6 +201,7 @@ _public_ int sd_bus_new(sd_bus **ret) {
                 free(r);
                 return -ENOMEM;
         }
+        r->wqueue_allocated = 1;
 
         *ret = r;
         return 0;
@@ -1294,6 +1300,52 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *message, size_t *idx)
                 return bus_socket_write_message(bus, message, idx);
 }
 
+static int bus_wqueue_push(sd_bus *bus, sd_bus_message *m) {
+        assert(bus);
+        assert(m);
+
+        if (bus->wqueue_size >= bus->wqueue_allocated) {
+                sd_bus_message **q;
+                unsigned n, tail;
+
+                if (bus->wqueue_size >= BUS_WQUEUE_MAX)
+                        return -ENOBUFS;
+
+                n = MIN(MAX(bus->wqueue_allocated * 2, 1u), (unsigned) BUS_WQUEUE_MAX);
+
+                q = realloc(bus->wqueue, sizeof(sd_bus_message*) * n);
+                if (!q)
+                        return -ENOMEM;
+
+                /* The queue is full, so if it wraps around, move
+                 * the part from the head to the old end of the array
+                 * to the new end of it */
+                tail = bus->wqueue_allocated - bus->wqueue_head;
+                if (bus->wqueue_head > 0) {
+                        memmove(q + n - tail, q + bus->wqueue_head, sizeof(sd_bus_message*) * tail);
+                        bus->wqueue_head = n - tail;
+                }
+
+                bus->wqueue = q;
+                bus->wqueue_allocated = n;
+        }
+
+        bus->wqueue[(bus->wqueue_head + bus->wqueue_size) % bus->wqueue_allocated] = sd_bus_message_ref(m);
+        bus->wqueue_size ++;
+
+        return 0;
+}
+
+static void bus_wqueue_pop(sd_bus *bus) {
+        assert(bus);
+        assert(bus->wqueue_size > 0);
+
+        sd_bus_message_unref(bus->wqueue[bus->wqueue_head]);
+        bus->wqueue_head = (bus->wqueue_head + 1) % bus->wqueue_allocated;
+        bus->wqueue_size --;
+        bus->windex = 0;
+}
+
 static int dispatch_wqueue(sd_bus *bus) {
         int r, ret = 0;
 
@@ -1301,28 +1353,40 @@ static int dispatch_wqueue(sd_bus *bus) {
         assert(bus->state == BUS_RUNNING || bus->state == BUS_HELLO);
 
         while (bus->wqueue_size > 0) {
+                sd_bus_message **m = bus->wqueue + bus->wqueue_head;
+
+                if (bus->is_kernel) {
+                        r = bus_kernel_write_message(bus, *m);
+                        if (r < 0)
+                                return r;
+                        else if (r == 0)
+                                return ret;
 
-                r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
+                        bus_wqueue_pop(bus);
+                        ret = 1;
+                        continue;
+                }
+
+                /* Hand everything up to the end of the ring to the
+                 * socket at once, it will write out as much of that
+                 * as it can in one go */
+                r = bus_socket_write_messages(
+                                bus, m,
+                                MIN(bus->wqueue_size, bus->wqueue_allocated - bus->wqueue_head),
+                                &bus->windex);
                 if (r < 0)
                         return r;
                 else if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->is_kernel || bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        sd_bus_message_unref(bus->wqueue[0]);
-                        bus->wqueue_size --;
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
+
+                /* Drop all entries that are fully written now */
+                while (bus->wqueue_size > 0 && bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[bus->wqueue_head])) {
+                        size_t windex;
+
+                        windex = bus->windex - BUS_MESSAGE_SIZE(bus->wqueue[bus->wqueue_head]);
+                        bus_wqueue_pop(bus);
+                        bus->windex = windex;
 
                         ret = 1;
                 }
@@ -1390,13 +1454,11 @@ static int dispatch_rqueue(sd_bus *bus, sd_bus_message **m) {
         }
 }
 
-_public_ int sd_bus_send(sd_bus *bus, sd_bus_message *m, uint64_t *serial) {
+static int bus_send_internal(sd_bus *bus, sd_bus_message *m, uint64_t *serial, bool queue) {
         int r;
 
-        assert_return(bus, -EINVAL);
-        assert_return(BUS_IS_OPEN(bus->state), -ENOTCONN);
-        assert_return(m, -EINVAL);
-        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert(bus);
+        assert(m);
 
         if (m->n_fds > 0) {
                 r = sd_bus_can_send(bus, SD_BUS_TYPE_UNIX_FD);
@@ -1420,7 +1482,7 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *m, uint64_t *serial) {
         if (m->dont_send && !serial)
                 return 1;
 
-        if ((bus->state == BUS_RUNNING || bus->state == BUS_HELLO) && bus->wqueue_size <= 0) {
+        if ((bus->state == BUS_RUNNING || bus->state == BUS_HELLO) && bus->wqueue_size <= 0 && !queue) {
                 size_t idx = 0;
 
                 r = bus_write_message(bus, m, &idx);
@@ -1436,23 +1498,16 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *m, uint64_t *serial) {
                          * that we always can remember how much was
                          * written. */
                         bus->wqueue[0] = sd_bus_message_ref(m);
+                        bus->wqueue_head = 0;
                         bus->wqueue_size = 1;
                         bus->windex = idx;
                 }
         } else {
-                sd_bus_message **q;
-
                 /* Just append it to the queue. */
 
-                if (bus->wqueue_size >= BUS_WQUEUE_MAX)
-                        return -ENOBUFS;
-
-                q = realloc(bus->wqueue, sizeof(sd_bus_message*) * (bus->wqueue_size + 1));
-                if (!q)
-                        return -ENOMEM;
-
-                bus->wqueue = q;
-                q[bus->wqueue_size ++] = sd_bus_message_ref(m);
+                r = bus_wqueue_push(bus, m);
+                if (r < 0)
+                        return r;
         }
 
         if (serial)
@@ -1461,6 +1516,15 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *m, uint64_t *serial) {
         return 1;
 }
 
+_public_ int sd_bus_send(sd_bus *bus, sd_bus_message *m, uint64_t *serial) {
+        assert_return(bus, -EINVAL);
+        assert_return(BUS_IS_OPEN(bus->state), -ENOTCONN);
+        assert_return(m, -EINVAL);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        return bus_send_internal(bus, m, serial, false);
+}
+
 _public_ int sd_bus_send_to(sd_bus *bus, sd_bus_message *m, const char *destination, uint64_t *serial) {
         int r;
 
@@ -1510,24 +1574,21 @@ static int timeout_compare(const void *a, const void *b) {
         return 0;
 }
 
-_public_ int sd_bus_call_async(
+static int bus_call_async_internal(
                 sd_bus *bus,
                 sd_bus_message *m,
                 sd_bus_message_handler_t callback,
                 void *userdata,
                 uint64_t usec,
-                uint64_t *serial) {
+                uint64_t *serial,
+                bool queue) {
 
         struct reply_callback *c;
         int r;
 
-        assert_return(bus, -EINVAL);
-        assert_return(BUS_IS_OPEN(bus->state), -ENOTCONN);
-        assert_return(m, -EINVAL);
-        assert_return(m->header->type == SD_BUS_MESSAGE_METHOD_CALL, -EINVAL);
-        assert_return(!(m->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED), -EINVAL);
-        assert_return(callback, -EINVAL);
-        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert(bus);
+        assert(m);
+        assert(callback);
 
         r = hashmap_ensure_allocated(&bus->reply_callbacks, uint64_hash_func, uint64_compare_func);
         if (r < 0)
@@ -1567,7 +1628,7 @@ _public_ int sd_bus_call_async(
                 }
         }
 
-        r = sd_bus_send(bus, m, serial);
+        r = bus_send_internal(bus, m, serial, queue);
         if (r < 0) {
                 sd_bus_call_async_cancel(bus, c->serial);
                 return r;
@@ -1576,6 +1637,25 @@ _public_ int sd_bus_call_async(
         return r;
 }
 
+_public_ int sd_bus_call_async(
+                sd_bus *bus,
+                sd_bus_message *m,
+                sd_bus_message_handler_t callback,
+                void *userdata,
+                uint64_t usec,
+                uint64_t *serial) {
+
+        assert_return(bus, -EINVAL);
+        assert_return(BUS_IS_OPEN(bus->state), -ENOTCONN);
+        assert_return(m, -EINVAL);
+        assert_return(m->header->type == SD_BUS_MESSAGE_METHOD_CALL, -EINVAL);
+        assert_return(!(m->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED), -EINVAL);
+        assert_return(callback, -EINVAL);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        return bus_call_async_internal(bus, m, callback, userdata, usec, serial, false);
+}
+
 _public_ int sd_bus_call_async_cancel(sd_bus *bus, uint64_t serial) {
         struct reply_callback *c;
 
@@ -1737,6 +1817,226 @@ _public_ int sd_bus_call(
         }
 }
 
+struct call_batch {
+        sd_bus_message **reply;
+        sd_bus_error *error;
+        unsigned n_pending;
+        unsigned n_succeeded;
+};
+
+struct call_batch_entry {
+        struct call_batch *batch;
+        unsigned index;
+
+        /* Non-zero as long as the reply is outstanding */
+        uint64_t serial;
+};
+
+static int call_batch_reply(sd_bus *bus, sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct call_batch_entry *e = userdata;
+        struct call_batch *b = e->batch;
+
+        assert(e->serial != 0);
+        assert(b->n_pending > 0);
+
+        e->serial = 0;
+        b->n_pending--;
+
+        if (m->header->type == SD_BUS_MESSAGE_METHOD_RETURN) {
+                if (b->reply)
+                        b->reply[e->index] = sd_bus_message_ref(m);
+
+                b->n_succeeded++;
+        } else if (b->error)
+                sd_bus_error_copy(&b->error[e->index], &m->error);
+
+        return 0;
+}
+
+static bool is_call_batch_reply(sd_bus *bus, uint64_t serial, struct call_batch *batch) {
+        struct reply_callback *c;
+
+        c = hashmap_get(bus->reply_callbacks, &serial);
+
+        return c &&
+                c->callback == call_batch_reply &&
+                ((struct call_batch_entry*) c->userdata)->batch == batch;
+}
+
+/* Issues all n method calls in m[] at once, and waits until each of
+ * them got its reply, or the timeout elapsed. The calls are queued
+ * and written out together, and the replies are matched via the
+ * usual reply callbacks. For each call either reply[i] is set, or
+ * ret_error[i] is, both arrays are optional. Returns the number of
+ * calls that succeeded. */
+_public_ int sd_bus_call_batch(
+                sd_bus *bus,
+                sd_bus_message *m[],
+                unsigned n,
+                uint64_t usec,
+                sd_bus_error ret_error[],
+                sd_bus_message *reply[]) {
+
+        _cleanup_free_ struct call_batch_entry *entries = NULL;
+        struct call_batch batch = {
+                .reply = reply,
+                .error = ret_error,
+        };
+        unsigned i, j, k = 0;
+        usec_t timeout;
+        int r;
+
+        assert_return(bus, -EINVAL);
+        assert_return(BUS_IS_OPEN(bus->state), -ENOTCONN);
+        assert_return(m || n == 0, -EINVAL);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        for (j = 0; j < n; j++) {
+                assert_return(m[j], -EINVAL);
+                assert_return(m[j]->header->type == SD_BUS_MESSAGE_METHOD_CALL, -EINVAL);
+                assert_return(!(m[j]->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED), -EINVAL);
+                assert_return(!ret_error || !bus_error_is_dirty(&ret_error[j]), -EINVAL);
+        }
+
+        if (n <= 0)
+                return 0;
+
+        r = bus_ensure_running(bus);
+        if (r < 0)
+                return r;
+
+        entries = new0(struct call_batch_entry, n);
+        if (!entries)
+                return -ENOMEM;
+
+        if (reply)
+                memzero(reply, sizeof(sd_bus_message*) * n);
+
+        i = bus->rqueue_size;
+        timeout = calc_elapse(usec);
+
+        for (;;) {
+                usec_t left;
+
+                /* Queue as many of the calls as the write queue
+                 * takes, so that they are written out in one go,
+                 * and add more as it drains */
+                while (k < n && bus->wqueue_size < BUS_WQUEUE_MAX) {
+                        entries[k].batch = &batch;
+                        entries[k].index = k;
+
+                        r = bus_call_async_internal(bus, m[k], call_batch_reply, entries + k, usec, &entries[k].serial, true);
+                        if (r < 0)
+                                goto fail;
+
+                        batch.n_pending++;
+                        k++;
+                }
+
+                r = dispatch_wqueue(bus);
+                if (r < 0) {
+                        if (r == -EPIPE || r == -ENOTCONN || r == -ESHUTDOWN)
+                                bus_enter_closing(bus);
+
+                        goto fail;
+                }
+
+                while (i < bus->rqueue_size) {
+                        sd_bus_message *incoming;
+
+                        incoming = bus->rqueue[i];
+
+                        if ((incoming->header->type == SD_BUS_MESSAGE_METHOD_RETURN ||
+                             incoming->header->type == SD_BUS_MESSAGE_METHOD_ERROR) &&
+                            is_call_batch_reply(bus, incoming->reply_serial, &batch)) {
+
+                                memmove(bus->rqueue + i, bus->rqueue + i + 1, sizeof(sd_bus_message*) * (bus->rqueue_size - i - 1));
+                                bus->rqueue_size--;
+
+                                r = process_reply(bus, incoming);
+                                sd_bus_message_unref(incoming);
+                                if (r < 0)
+                                        goto fail;
+
+                                continue;
+
+                        } else if (incoming->header->type == SD_BUS_MESSAGE_METHOD_CALL &&
+                                   is_call_batch_reply(bus, incoming->header->serial, &batch) &&
+                                   bus->unique_name &&
+                                   incoming->sender &&
+                                   streq(bus->unique_name, incoming->sender)) {
+
+                                memmove(bus->rqueue + i, bus->rqueue + i + 1, sizeof(sd_bus_message*) * (bus->rqueue_size - i - 1));
+                                bus->rqueue_size--;
+
+                                /* One of the calls went to ourselves,
+                                 * see sd_bus_call() */
+                                sd_bus_message_unref(incoming);
+                                r = -ELOOP;
+                                goto fail;
+                        }
+
+                        i++;
+                }
+
+                if (k >= n && batch.n_pending <= 0)
+                        return batch.n_succeeded;
+
+                r = bus_read_message(bus);
+                if (r < 0) {
+                        if (r == -EPIPE || r == -ENOTCONN || r == -ESHUTDOWN)
+                                bus_enter_closing(bus);
+
+                        goto fail;
+                }
+                if (r > 0)
+                        continue;
+
+                if (timeout > 0) {
+                        usec_t nw;
+
+                        nw = now(CLOCK_MONOTONIC);
+                        if (nw >= timeout)
+                                break;
+
+                        left = timeout - nw;
+                } else
+                        left = (uint64_t) -1;
+
+                r = bus_poll(bus, true, left);
+                if (r < 0)
+                        goto fail;
+        }
+
+        /* Whatever didn't get its reply in time fails individually */
+        for (j = 0; j < n; j++) {
+                if (j < k && entries[j].serial == 0)
+                        continue;
+
+                if (j < k)
+                        sd_bus_call_async_cancel(bus, entries[j].serial);
+
+                if (ret_error)
+                        sd_bus_error_set_const(&ret_error[j], SD_BUS_ERROR_NO_REPLY, "Method call timed out");
+        }
+
+        return batch.n_succeeded;
+
+fail:
+        for (j = 0; j < n; j++) {
+                if (j < k && entries[j].serial != 0)
+                        sd_bus_call_async_cancel(bus, entries[j].serial);
+
+                if (reply)
+                        reply[j] = sd_bus_message_unref(reply[j]);
+
+                if (ret_error)
+                        sd_bus_error_free(&ret_error[j]);
+        }
+
+        return r;
+}
+
 _public_ int sd_bus_get_fd(sd_bus *bus) {
 
         assert_return(bus, -EINVAL);
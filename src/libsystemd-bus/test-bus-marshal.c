@@ -62,6 +62,117 @@ static void test_bus_label_escape(void) {
         test_bus_label_escape_one(":1", "_3a1");
 }
 
+typedef struct Item {
+        uint8_t byte;
+        int boolean;
+        const char *string;
+        uint64_t number;
+        const char *path;
+        uint16_t small;
+        const char *signature;
+        double real;
+} Item;
+
+static void test_bus_struct_layout(void) {
+        static const size_t offsets[] = {
+                offsetof(Item, byte),
+                offsetof(Item, boolean),
+                offsetof(Item, string),
+                offsetof(Item, number),
+                offsetof(Item, path),
+                offsetof(Item, small),
+                offsetof(Item, signature),
+                offsetof(Item, real),
+        };
+        static const Item items[] = {
+                { 1, true, "foo", 4711, "/foo", 7, "a{sv}", 0.5 },
+                { 255, 7, NULL, (uint64_t) -1, "/", 0, "", -1.0 },
+                { 0, false, "waldo", 0, "/a/b/c", 65535, "(ssssssouso)", 1e9 },
+        };
+        _cleanup_bus_message_unref_ sd_bus_message *a = NULL, *b = NULL;
+        _cleanup_free_ void *blob_a = NULL, *blob_b = NULL;
+        size_t size_a, size_b;
+        BusStructLayout l;
+        unsigned i;
+        Item item;
+
+        assert_se(bus_struct_layout_compile(&l, "(ybstoqgd)", offsets) >= 0);
+        assert_se(bus_struct_layout_compile(&l, "(yh)", offsets) == -EINVAL);
+        assert_se(bus_struct_layout_compile(&l, "(yas)", offsets) == -EINVAL);
+        assert_se(bus_struct_layout_compile(&l, "yb", offsets) == -EINVAL);
+        assert_se(bus_struct_layout_compile(&l, "()", offsets) == -EINVAL);
+        assert_se(bus_struct_layout_compile(&l, "(ybstoqgd)", offsets) >= 0);
+
+        /* The compiled layout has to serialize exactly like the
+         * generic code does */
+        assert_se(sd_bus_message_new_method_call(NULL, "foobar.waldo", "/", "foobar.waldo", "Piep", &a) >= 0);
+        assert_se(sd_bus_message_new_method_call(NULL, "foobar.waldo", "/", "foobar.waldo", "Piep", &b) >= 0);
+
+        assert_se(sd_bus_message_append(a, "y", 3) >= 0);
+        assert_se(sd_bus_message_append(b, "y", 3) >= 0);
+
+        assert_se(sd_bus_message_open_container(a, 'a', "(ybstoqgd)") >= 0);
+        assert_se(sd_bus_message_open_container(b, 'a', "(ybstoqgd)") >= 0);
+
+        for (i = 0; i < ELEMENTSOF(items); i++) {
+                assert_se(sd_bus_message_append(a, "(ybstoqgd)",
+                                                items[i].byte, items[i].boolean, items[i].string,
+                                                items[i].number, items[i].path, items[i].small,
+                                                items[i].signature, items[i].real) >= 0);
+                assert_se(bus_message_append_struct(b, &l, &items[i]) >= 0);
+        }
+
+        assert_se(sd_bus_message_close_container(a) >= 0);
+        assert_se(sd_bus_message_close_container(b) >= 0);
+
+        /* Outside of an array the struct extends the signature */
+        assert_se(sd_bus_message_append(a, "(ybstoqgd)",
+                                        items[0].byte, items[0].boolean, items[0].string,
+                                        items[0].number, items[0].path, items[0].small,
+                                        items[0].signature, items[0].real) >= 0);
+        assert_se(bus_message_append_struct(b, &l, &items[0]) >= 0);
+
+        item = items[0];
+        item.path = NULL;
+        assert_se(bus_message_append_struct(b, &l, &item) == -EINVAL);
+
+        assert_se(bus_message_seal(a, 4711) >= 0);
+        assert_se(bus_message_seal(b, 4711) >= 0);
+
+        assert_se(streq(sd_bus_message_get_signature(b, true), "ya(ybstoqgd)(ybstoqgd)"));
+
+        assert_se(bus_message_get_blob(a, &blob_a, &size_a) >= 0);
+        assert_se(bus_message_get_blob(b, &blob_b, &size_b) >= 0);
+        assert_se(size_a == size_b);
+        assert_se(memcmp(blob_a, blob_b, size_a) == 0);
+
+        /* And read back what the generic code wrote */
+        assert_se(sd_bus_message_rewind(a, true) >= 0);
+        assert_se(bus_message_read_struct(a, &l, &item) == -ENXIO);
+        assert_se(sd_bus_message_skip(a, "y") >= 0);
+        assert_se(sd_bus_message_enter_container(a, 'a', "(ybstoqgd)") > 0);
+
+        for (i = 0; i < ELEMENTSOF(items); i++) {
+                assert_se(bus_message_read_struct(a, &l, &item) > 0);
+
+                assert_se(item.byte == items[i].byte);
+                assert_se(item.boolean == !!items[i].boolean);
+                assert_se(streq(item.string, strempty(items[i].string)));
+                assert_se(item.number == items[i].number);
+                assert_se(streq(item.path, items[i].path));
+                assert_se(item.small == items[i].small);
+                assert_se(streq(item.signature, items[i].signature));
+                assert_se(item.real == items[i].real);
+        }
+
+        assert_se(bus_message_read_struct(a, &l, &item) == 0);
+        assert_se(sd_bus_message_exit_container(a) >= 0);
+
+        assert_se(bus_message_read_struct(a, &l, &item) > 0);
+        assert_se(streq(item.path, items[0].path));
+        assert_se(bus_message_read_struct(a, &l, &item) == -ENXIO);
+}
+
 int main(int argc, char *argv[]) {
         _cleanup_bus_message_unref_ sd_bus_message *m = NULL, *copy = NULL;
         int r, boolean;
@@ -318,6 +429,7 @@ int main(int argc, char *argv[]) {
         assert_se(streq(d, "3"));
 
         test_bus_label_escape();
+        test_bus_struct_layout();
 
         return 0;
 }
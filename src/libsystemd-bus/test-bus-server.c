@@ -34,6 +34,14 @@
 #include "bus-message.h"
 #include "bus-util.h"
 
+/* Enough payload to fill up the socket buffer, so that the client has
+ * to queue messages and write them out in batches */
+#define N_BURST 512
+#define BURST_PAYLOAD 1024
+
+/* More than fit into the write queue at once */
+#define N_BATCH 3000
+
 struct context {
         int fds[2];
 
@@ -49,6 +57,7 @@ static void *server(void *p) {
         sd_bus *bus = NULL;
         sd_id128_t id;
         bool quit = false;
+        uint32_t n_burst = 0, n_batch = 0;
         int r;
 
         assert_se(sd_id128_randomize(&id) >= 0);
@@ -84,9 +93,47 @@ static void *server(void *p) {
 
                 log_info("Got message! member=%s", strna(sd_bus_message_get_member(m)));
 
-                if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
+                if (sd_bus_message_is_signal(m, "org.freedesktop.systemd.test", "Burst") ||
+                    sd_bus_message_is_signal(m, "org.freedesktop.systemd.test", "BurstFd")) {
+                        const char *payload;
+                        uint32_t i;
+
+                        assert_se(sd_bus_message_read(m, "us", &i, &payload) >= 0);
+                        assert_se(i == n_burst);
+                        assert_se(strlen(payload) == BURST_PAYLOAD);
+
+                        if (sd_bus_message_is_signal(m, NULL, "BurstFd")) {
+                                int fd;
+
+                                assert_se(sd_bus_message_read(m, "h", &fd) >= 0);
+                                assert_se(fcntl(fd, F_GETFD) >= 0);
+                        }
+
+                        n_burst++;
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Double")) {
+                        uint32_t i;
+
+                        assert_se(sd_bus_message_read(m, "u", &i) >= 0);
+                        n_batch++;
+
+                        if (i % 5 == 0)
+                                r = sd_bus_message_new_method_errorf(m, &reply, SD_BUS_ERROR_INVALID_ARGS, "Refusing %u.", i);
+                        else {
+                                r = sd_bus_message_new_method_return(m, &reply);
+                                if (r >= 0)
+                                        r = sd_bus_message_append(reply, "u", i * 2);
+                        }
+                        if (r < 0) {
+                                log_error("Failed to allocate return: %s", strerror(-r));
+                                goto fail;
+                        }
+
+                } else if (sd_bus_message_is_method_call(m, "org.freedesktop.systemd.test", "Exit")) {
 
                         assert_se((sd_bus_can_send(bus, 'h') >= 1) == (c->server_negotiate_unix_fds && c->client_negotiate_unix_fds));
+                        assert_se(n_burst == N_BURST);
+                        assert_se(n_batch == N_BATCH);
 
                         r = sd_bus_message_new_method_return(m, &reply);
                         if (r < 0) {
@@ -127,10 +174,74 @@ fail:
         return INT_TO_PTR(r);
 }
 
+static int client_batch(sd_bus *bus) {
+        sd_bus_message *calls[N_BATCH] = {}, *replies[N_BATCH] = {};
+        sd_bus_error errors[N_BATCH] = {};
+        uint32_t i;
+        int r;
+
+        for (i = 0; i < N_BATCH; i++) {
+                r = sd_bus_message_new_method_call(
+                                bus,
+                                "org.freedesktop.systemd.test",
+                                "/",
+                                "org.freedesktop.systemd.test",
+                                "Double",
+                                &calls[i]);
+                if (r < 0) {
+                        log_error("Failed to allocate method call: %s", strerror(-r));
+                        goto finish;
+                }
+
+                r = sd_bus_message_append(calls[i], "u", i);
+                if (r < 0) {
+                        log_error("Failed to append argument: %s", strerror(-r));
+                        goto finish;
+                }
+        }
+
+        r = sd_bus_call_batch(bus, calls, N_BATCH, 0, errors, replies);
+        if (r < 0) {
+                log_error("Failed to issue method calls: %s", strerror(-r));
+                goto finish;
+        }
+
+        assert_se(r == N_BATCH - (N_BATCH + 4) / 5);
+
+        for (i = 0; i < N_BATCH; i++) {
+                uint32_t j;
+
+                if (i % 5 == 0) {
+                        assert_se(!replies[i]);
+                        assert_se(sd_bus_error_has_name(&errors[i], SD_BUS_ERROR_INVALID_ARGS));
+                        continue;
+                }
+
+                assert_se(replies[i]);
+                assert_se(!sd_bus_error_is_set(&errors[i]));
+                assert_se(sd_bus_message_read(replies[i], "u", &j) > 0);
+                assert_se(j == i * 2);
+        }
+
+        r = 0;
+
+finish:
+        for (i = 0; i < N_BATCH; i++) {
+                sd_bus_message_unref(calls[i]);
+                sd_bus_message_unref(replies[i]);
+                sd_bus_error_free(&errors[i]);
+        }
+
+        return r;
+}
+
 static int client(struct context *c) {
         _cleanup_bus_message_unref_ sd_bus_message *m = NULL, *reply = NULL;
         _cleanup_bus_unref_ sd_bus *bus = NULL;
         sd_bus_error error = SD_BUS_ERROR_NULL;
+        char payload[BURST_PAYLOAD + 1];
+        bool fds;
+        uint32_t i;
         int r;
 
         assert_se(sd_bus_new(&bus) >= 0);
@@ -139,6 +250,30 @@ static int client(struct context *c) {
         assert_se(sd_bus_set_anonymous(bus, c->client_anonymous_auth) >= 0);
         assert_se(sd_bus_start(bus) >= 0);
 
+        memset(payload, 'x', BURST_PAYLOAD);
+        payload[BURST_PAYLOAD] = 0;
+
+        fds = sd_bus_can_send(bus, 'h') > 0;
+
+        /* Send a burst of signals, every now and then with an fd
+         * attached, without waiting for the server to catch up */
+        for (i = 0; i < N_BURST; i++) {
+                if (fds && (i % 64 == 7 || i % 64 == 8))
+                        r = sd_bus_emit_signal(bus, "/", "org.freedesktop.systemd.test", "BurstFd", "ush", i, payload, STDERR_FILENO);
+                else
+                        r = sd_bus_emit_signal(bus, "/", "org.freedesktop.systemd.test", "Burst", "us", i, payload);
+                if (r < 0) {
+                        log_error("Failed to emit signal: %s", strerror(-r));
+                        return r;
+                }
+        }
+
+        r = client_batch(bus);
+        if (r < 0) {
+                sd_bus_close(bus);
+                return r;
+        }
+
         r = sd_bus_message_new_method_call(
                         bus,
                         "org.freedesktop.systemd.test",
@@ -154,6 +289,10 @@ static int client(struct context *c) {
         r = sd_bus_call(bus, m, 0, &error, &reply);
         if (r < 0) {
                 log_error("Failed to issue method call: %s", bus_error_message(&error, -r));
+
+                /* Drop the signals still queued, they keep
+                 * references to the bus */
+                sd_bus_close(bus);
                 return r;
         }
 
@@ -55,6 +55,11 @@ static bool show_location = false;
  * use here. */
 static char *log_abort_msg = NULL;
 
+/* Messages of threads that must not log themselves are handed to
+ * this instead */
+static __thread log_redirect_t log_redirect = NULL;
+static __thread void *log_redirect_userdata = NULL;
+
 void log_close_console(void) {
 
         if (console_fd < 0)
@@ -305,6 +310,11 @@ void log_set_facility(int facility) {
         log_facility = facility;
 }
 
+void log_set_redirect(log_redirect_t redirect, void *userdata) {
+        log_redirect = redirect;
+        log_redirect_userdata = userdata;
+}
+
 static int write_to_console(
                 int level,
                 const char*file,
@@ -516,6 +526,11 @@ static int log_dispatch(
         if (log_target == LOG_TARGET_NULL)
                 return 0;
 
+        if (log_redirect) {
+                log_redirect(LOG_PRI(level), buffer, log_redirect_userdata);
+                return 1;
+        }
+
         /* Patch in LOG_DAEMON facility if necessary */
         if ((level & LOG_FACMASK) == 0)
                 level = log_facility | LOG_PRI(level);
@@ -695,6 +710,9 @@ _noreturn_ static void log_assert(const char *text, const char *file, int line,
         char_array_0(buffer);
         log_abort_msg = buffer;
 
+        /* Nobody is going to pick up a redirected message anymore */
+        log_redirect = NULL;
+
         log_dispatch(LOG_CRIT, file, line, func, NULL, NULL, buffer);
         abort();
 }
@@ -736,7 +754,7 @@ int log_struct_internal(
         if ((log_target == LOG_TARGET_AUTO ||
              log_target == LOG_TARGET_JOURNAL_OR_KMSG ||
              log_target == LOG_TARGET_JOURNAL) &&
-            journal_fd >= 0) {
+            journal_fd >= 0 && !log_redirect) {
 
                 char header[LINE_MAX];
                 struct iovec iovec[17] = {};
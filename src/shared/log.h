@@ -47,6 +47,11 @@ void log_set_target(LogTarget target);
 void log_set_max_level(int level);
 void log_set_facility(int facility);
 
+/* Diverts everything the calling thread logs to a callback, for
+ * threads that must not write log messages themselves */
+typedef void (*log_redirect_t)(int level, const char *message, void *userdata);
+void log_set_redirect(log_redirect_t redirect, void *userdata);
+
 int log_set_target_from_string(const char *e);
 int log_set_max_level_from_string(const char *e);
 
@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <sys/poll.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "logs-show.h"
 #include "log.h"
@@ -484,88 +485,251 @@ static int output_verbose(
         return 0;
 }
 
-static int output_export(
-                FILE *f,
-                sd_journal *j,
-                OutputMode mode,
-                unsigned n_columns,
-                OutputFlags flags) {
-
+/* A copy of the fields of an entry, so that it may be formatted after
+ * the journal has moved on, possibly on a different thread */
+typedef struct OutputEntry {
+        char *cursor;
+        usec_t realtime;
+        usec_t monotonic;
         sd_id128_t boot_id;
-        char sid[33];
-        int r;
-        usec_t realtime, monotonic;
-        _cleanup_free_ char *cursor = NULL;
+
+        /* The fields, one after the other, and where each ends */
+        char *data;
+        size_t data_size, data_allocated;
+        size_t *ends;
+        size_t ends_allocated;
+        unsigned n_fields;
+} OutputEntry;
+
+static void output_entry_done(OutputEntry *e) {
+        assert(e);
+
+        free(e->cursor);
+        free(e->data);
+        free(e->ends);
+        zero(*e);
+}
+
+static void output_entry_field(const OutputEntry *e, unsigned i, const char **data, size_t *length) {
+        size_t start;
+
+        assert(e);
+        assert(i < e->n_fields);
+
+        start = i > 0 ? e->ends[i-1] : 0;
+
+        *data = e->data + start;
+        *length = e->ends[i] - start;
+}
+
+static int output_entry_read(OutputEntry *e, sd_journal *j, OutputMode mode, OutputFlags flags) {
         const void *data;
         size_t length;
+        int r;
 
+        assert(e);
         assert(j);
 
-        sd_journal_set_data_threshold(j, 0);
+        sd_journal_set_data_threshold(j, mode == OUTPUT_EXPORT || (flags & OUTPUT_SHOW_ALL) ? 0 : JSON_THRESHOLD);
 
-        r = sd_journal_get_realtime_usec(j, &realtime);
+        r = sd_journal_get_realtime_usec(j, &e->realtime);
         if (r < 0) {
                 log_error("Failed to get realtime timestamp: %s", strerror(-r));
                 return r;
         }
 
-        r = sd_journal_get_monotonic_usec(j, &monotonic, &boot_id);
+        r = sd_journal_get_monotonic_usec(j, &e->monotonic, &e->boot_id);
         if (r < 0) {
                 log_error("Failed to get monotonic timestamp: %s", strerror(-r));
                 return r;
         }
 
-        r = sd_journal_get_cursor(j, &cursor);
+        free(e->cursor);
+        e->cursor = NULL;
+
+        r = sd_journal_get_cursor(j, &e->cursor);
         if (r < 0) {
                 log_error("Failed to get cursor: %s", strerror(-r));
                 return r;
         }
 
-        fprintf(f,
-                "__CURSOR=%s\n"
-                "__REALTIME_TIMESTAMP=%llu\n"
-                "__MONOTONIC_TIMESTAMP=%llu\n"
-                "_BOOT_ID=%s\n",
-                cursor,
-                (unsigned long long) realtime,
-                (unsigned long long) monotonic,
-                sd_id128_to_string(boot_id, sid));
+        e->data_size = 0;
+        e->n_fields = 0;
 
         JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
 
-                /* We already printed the boot id, from the data in
-                 * the header, hence let's suppress it here */
+                /* The boot id is printed from the data in the header,
+                 * hence let's suppress it here */
                 if (length >= 9 &&
-                    startswith(data, "_BOOT_ID="))
+                    memcmp(data, "_BOOT_ID=", 9) == 0)
                         continue;
 
-                if (!utf8_is_printable(data, length)) {
-                        const char *c;
-                        uint64_t le64;
+                if (!GREEDY_REALLOC(e->data, e->data_allocated, e->data_size + length) ||
+                    !GREEDY_REALLOC(e->ends, e->ends_allocated, e->n_fields + 1))
+                        return -ENOMEM;
 
-                        c = memchr(data, '=', length);
-                        if (!c) {
-                                log_error("Invalid field.");
-                                return -EINVAL;
-                        }
+                memcpy(e->data + e->data_size, data, length);
+                e->data_size += length;
+                e->ends[e->n_fields++] = e->data_size;
+        }
 
-                        fwrite(data, c - (const char*) data, 1, f);
-                        fputc('\n', f);
-                        le64 = htole64(length - (c - (const char*) data) - 1);
-                        fwrite(&le64, sizeof(le64), 1, f);
-                        fwrite(c + 1, length - (c - (const char*) data) - 1, 1, f);
-                } else
-                        fwrite(data, length, 1, f);
+        return r;
+}
+
+static int export_append(char **buffer, size_t *allocated, size_t *size, const void *p, size_t l) {
+        assert(buffer);
+        assert(allocated);
+        assert(size);
 
-                fputc('\n', f);
+        if (!GREEDY_REALLOC(*buffer, *allocated, *size + l))
+                return -ENOMEM;
+
+        memcpy(*buffer + *size, p, l);
+        *size += l;
+
+        return 0;
+}
+
+static int export_header(
+                char **buffer,
+                size_t *allocated,
+                size_t *size,
+                const char *cursor,
+                usec_t realtime,
+                usec_t monotonic,
+                sd_id128_t boot_id) {
+
+        char sid[33], t[256];
+
+        assert(cursor);
+
+        snprintf(t, sizeof(t),
+                 "\n"
+                 "__REALTIME_TIMESTAMP=%llu\n"
+                 "__MONOTONIC_TIMESTAMP=%llu\n"
+                 "_BOOT_ID=%s\n",
+                 (unsigned long long) realtime,
+                 (unsigned long long) monotonic,
+                 sd_id128_to_string(boot_id, sid));
+
+        if (export_append(buffer, allocated, size, "__CURSOR=", 9) < 0 ||
+            export_append(buffer, allocated, size, cursor, strlen(cursor)) < 0 ||
+            export_append(buffer, allocated, size, t, strlen(t)) < 0)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int export_field(char **buffer, size_t *allocated, size_t *size, const char *data, size_t length) {
+        const char *c;
+        uint64_t le64;
+
+        assert(data);
+
+        if (utf8_is_printable(data, length)) {
+                if (export_append(buffer, allocated, size, data, length) < 0 ||
+                    export_append(buffer, allocated, size, "\n", 1) < 0)
+                        return -ENOMEM;
+
+                return 0;
         }
 
+        c = memchr(data, '=', length);
+        if (!c) {
+                log_error("Invalid field.");
+                return -EINVAL;
+        }
+
+        le64 = htole64(length - (c - data) - 1);
+
+        if (export_append(buffer, allocated, size, data, c - data) < 0 ||
+            export_append(buffer, allocated, size, "\n", 1) < 0 ||
+            export_append(buffer, allocated, size, &le64, sizeof(le64)) < 0 ||
+            export_append(buffer, allocated, size, c + 1, length - (c - data) - 1) < 0 ||
+            export_append(buffer, allocated, size, "\n", 1) < 0)
+                return -ENOMEM;
+
+        return 0;
+}
+
+static int output_export(
+                const OutputEntry *e,
+                char **buffer,
+                size_t *allocated,
+                size_t *size) {
+
+        unsigned i;
+        int r;
+
+        assert(e);
+
+        r = export_header(buffer, allocated, size, e->cursor, e->realtime, e->monotonic, e->boot_id);
         if (r < 0)
                 return r;
 
-        fputc('\n', f);
+        for (i = 0; i < e->n_fields; i++) {
+                const char *data;
+                size_t length;
 
-        return 0;
+                output_entry_field(e, i, &data, &length);
+
+                r = export_field(buffer, allocated, size, data, length);
+                if (r < 0)
+                        return r;
+        }
+
+        return export_append(buffer, allocated, size, "\n", 1);
+}
+
+int output_export_append(sd_journal *j, char **buffer, size_t *allocated, size_t *size) {
+        _cleanup_free_ char *cursor = NULL;
+        usec_t realtime, monotonic;
+        sd_id128_t boot_id;
+        const void *data;
+        size_t length;
+        int r;
+
+        assert(j);
+        assert(buffer);
+        assert(allocated);
+        assert(size);
+
+        /* Like output_export(), but straight from the journal, without
+         * copying the entry first */
+
+        sd_journal_set_data_threshold(j, 0);
+
+        r = sd_journal_get_realtime_usec(j, &realtime);
+        if (r < 0)
+                return r;
+
+        r = sd_journal_get_monotonic_usec(j, &monotonic, &boot_id);
+        if (r < 0)
+                return r;
+
+        r = sd_journal_get_cursor(j, &cursor);
+        if (r < 0)
+                return r;
+
+        r = export_header(buffer, allocated, size, cursor, realtime, monotonic, boot_id);
+        if (r < 0)
+                return r;
+
+        JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
+
+                if (length >= 9 &&
+                    memcmp(data, "_BOOT_ID=", 9) == 0)
+                        continue;
+
+                r = export_field(buffer, allocated, size, data, length);
+                if (r < 0)
+                        return r;
+        }
+
+        if (r < 0)
+                return r;
+
+        return export_append(buffer, allocated, size, "\n", 1);
 }
 
 void json_escape(
@@ -603,15 +767,28 @@ void json_escape(
                 fputc('\"', f);
 
                 while (l > 0) {
+                        size_t n;
+
+                        /* Write out runs of characters that need no
+                         * escaping in one go */
+                        for (n = 0; n < l; n++)
+                                if (p[n] == '"' || p[n] == '\\' || p[n] < ' ')
+                                        break;
+
+                        if (n > 0) {
+                                fwrite(p, 1, n, f);
+                                p += n;
+                                l -= n;
+                                continue;
+                        }
+
                         if (*p == '"' || *p == '\\') {
                                 fputc('\\', f);
                                 fputc(*p, f);
                         } else if (*p == '\n')
                                 fputs("\\n", f);
-                        else if (*p < ' ')
-                                fprintf(f, "\\u%04x", *p);
                         else
-                                fputc(*p, f);
+                                fprintf(f, "\\u%04x", *p);
 
                         p++;
                         l--;
@@ -623,42 +800,15 @@ void json_escape(
 
 static int output_json(
                 FILE *f,
-                sd_journal *j,
+                const OutputEntry *e,
                 OutputMode mode,
-                unsigned n_columns,
                 OutputFlags flags) {
 
-        uint64_t realtime, monotonic;
-        _cleanup_free_ char *cursor = NULL;
-        const void *data;
-        size_t length;
-        sd_id128_t boot_id;
-        char sid[33], *k;
-        int r;
-        Hashmap *h = NULL;
-        bool done, separator;
-
-        assert(j);
-
-        sd_journal_set_data_threshold(j, flags & OUTPUT_SHOW_ALL ? 0 : JSON_THRESHOLD);
-
-        r = sd_journal_get_realtime_usec(j, &realtime);
-        if (r < 0) {
-                log_error("Failed to get realtime timestamp: %s", strerror(-r));
-                return r;
-        }
-
-        r = sd_journal_get_monotonic_usec(j, &monotonic, &boot_id);
-        if (r < 0) {
-                log_error("Failed to get monotonic timestamp: %s", strerror(-r));
-                return r;
-        }
+        _cleanup_free_ bool *done = NULL;
+        char sid[33];
+        unsigned i;
 
-        r = sd_journal_get_cursor(j, &cursor);
-        if (r < 0) {
-                log_error("Failed to get cursor: %s", strerror(-r));
-                return r;
-        }
+        assert(e);
 
         if (mode == OUTPUT_JSON_PRETTY)
                 fprintf(f,
@@ -667,10 +817,10 @@ static int output_json(
                         "\t\"__REALTIME_TIMESTAMP\" : \"%llu\",\n"
                         "\t\"__MONOTONIC_TIMESTAMP\" : \"%llu\",\n"
                         "\t\"_BOOT_ID\" : \"%s\"",
-                        cursor,
-                        (unsigned long long) realtime,
-                        (unsigned long long) monotonic,
-                        sd_id128_to_string(boot_id, sid));
+                        e->cursor,
+                        (unsigned long long) e->realtime,
+                        (unsigned long long) e->monotonic,
+                        sd_id128_to_string(e->boot_id, sid));
         else {
                 if (mode == OUTPUT_JSON_SSE)
                         fputs("data: ", f);
@@ -680,149 +830,75 @@ static int output_json(
                         "\"__REALTIME_TIMESTAMP\" : \"%llu\", "
                         "\"__MONOTONIC_TIMESTAMP\" : \"%llu\", "
                         "\"_BOOT_ID\" : \"%s\"",
-                        cursor,
-                        (unsigned long long) realtime,
-                        (unsigned long long) monotonic,
-                        sd_id128_to_string(boot_id, sid));
+                        e->cursor,
+                        (unsigned long long) e->realtime,
+                        (unsigned long long) e->monotonic,
+                        sd_id128_to_string(e->boot_id, sid));
         }
 
-        h = hashmap_new(string_hash_func, string_compare_func);
-        if (!h)
+        done = new0(bool, e->n_fields);
+        if (e->n_fields > 0 && !done)
                 return -ENOMEM;
 
-        /* First round, iterate through the entry and count how often each field appears */
-        JOURNAL_FOREACH_DATA_RETVAL(j, data, length, r) {
-                const char *eq;
-                char *n;
-                unsigned u;
+        /* Fields are written in the order they first appear in, and
+         * a field that appears multiple times is written as an array
+         * of all its values at that place */
+        for (i = 0; i < e->n_fields; i++) {
+                const char *data, *eq;
+                size_t length, m;
+                unsigned k;
+                bool array = false;
 
-                if (length >= 9 &&
-                    memcmp(data, "_BOOT_ID=", 9) == 0)
+                if (done[i])
                         continue;
 
+                output_entry_field(e, i, &data, &length);
+
                 eq = memchr(data, '=', length);
                 if (!eq)
                         continue;
 
-                n = strndup(data, eq - (const char*) data);
-                if (!n) {
-                        r = -ENOMEM;
-                        goto finish;
-                }
-
-                u = PTR_TO_UINT(hashmap_get(h, n));
-                if (u == 0) {
-                        r = hashmap_put(h, n, UINT_TO_PTR(1));
-                        if (r < 0) {
-                                free(n);
-                                goto finish;
-                        }
-                } else {
-                        r = hashmap_update(h, n, UINT_TO_PTR(u + 1));
-                        free(n);
-                        if (r < 0)
-                                goto finish;
-                }
-        }
-
-        if (r < 0)
-                return r;
+                m = eq - data;
 
-        separator = true;
-        do {
-                done = true;
+                if (mode == OUTPUT_JSON_PRETTY)
+                        fputs(",\n\t", f);
+                else
+                        fputs(", ", f);
 
-                SD_JOURNAL_FOREACH_DATA(j, data, length) {
-                        const char *eq;
-                        char *kk, *n;
-                        size_t m;
-                        unsigned u;
+                json_escape(f, data, m, flags);
+                fputs(" : ", f);
 
-                        /* We already printed the boot id, from the data in
-                         * the header, hence let's suppress it here */
-                        if (length >= 9 &&
-                            memcmp(data, "_BOOT_ID=", 9) == 0)
-                                continue;
+                for (k = i + 1; k < e->n_fields; k++) {
+                        const char *d;
+                        size_t l;
 
-                        eq = memchr(data, '=', length);
-                        if (!eq)
+                        if (done[k])
                                 continue;
 
-                        if (separator) {
-                                if (mode == OUTPUT_JSON_PRETTY)
-                                        fputs(",\n\t", f);
-                                else
-                                        fputs(", ", f);
-                        }
-
-                        m = eq - (const char*) data;
-
-                        n = strndup(data, m);
-                        if (!n) {
-                                r = -ENOMEM;
-                                goto finish;
-                        }
-
-                        u = PTR_TO_UINT(hashmap_get2(h, n, (void**) &kk));
-                        if (u == 0) {
-                                /* We already printed this, let's jump to the next */
-                                free(n);
-                                separator = false;
-
-                                continue;
-                        } else if (u == 1) {
-                                /* Field only appears once, output it directly */
-
-                                json_escape(f, data, m, flags);
-                                fputs(" : ", f);
-
-                                json_escape(f, eq + 1, length - m - 1, flags);
-
-                                hashmap_remove(h, n);
-                                free(kk);
-                                free(n);
-
-                                separator = true;
+                        output_entry_field(e, k, &d, &l);
 
+                        if (l < m + 1 ||
+                            d[m] != '=' ||
+                            memcmp(d, data, m) != 0)
                                 continue;
 
-                        } else {
-                                /* Field appears multiple times, output it as array */
-                                json_escape(f, data, m, flags);
-                                fputs(" : [ ", f);
+                        if (!array) {
+                                fputs("[ ", f);
                                 json_escape(f, eq + 1, length - m - 1, flags);
+                                array = true;
+                        }
 
-                                /* Iterate through the end of the list */
-
-                                while (sd_journal_enumerate_data(j, &data, &length) > 0) {
-                                        if (length < m + 1)
-                                                continue;
-
-                                        if (memcmp(data, n, m) != 0)
-                                                continue;
-
-                                        if (((const char*) data)[m] != '=')
-                                                continue;
-
-                                        fputs(", ", f);
-                                        json_escape(f, (const char*) data + m + 1, length - m - 1, flags);
-                                }
-
-                                fputs(" ]", f);
-
-                                hashmap_remove(h, n);
-                                free(kk);
-                                free(n);
-
-                                /* Iterate data fields form the beginning */
-                                done = false;
-                                separator = true;
+                        fputs(", ", f);
+                        json_escape(f, d + m + 1, l - m - 1, flags);
 
-                                break;
-                        }
+                        done[k] = true;
                 }
 
-        } while (!done);
+                if (array)
+                        fputs(" ]", f);
+                else
+                        json_escape(f, eq + 1, length - m - 1, flags);
+        }
 
         if (mode == OUTPUT_JSON_PRETTY)
                 fputs("\n}\n", f);
@@ -831,15 +907,36 @@ static int output_json(
         else
                 fputs(" }\n", f);
 
-        r = 0;
+        return 0;
+}
 
-finish:
-        while ((k = hashmap_steal_first_key(h)))
-                free(k);
+static int output_detached(
+                FILE *f,
+                sd_journal *j,
+                OutputMode mode,
+                unsigned n_columns,
+                OutputFlags flags) {
+
+        _cleanup_(output_entry_done) OutputEntry e = {};
+        int r;
 
-        hashmap_free(h);
+        r = output_entry_read(&e, j, mode, flags);
+        if (r < 0)
+                return r;
 
-        return r;
+        if (mode == OUTPUT_EXPORT) {
+                _cleanup_free_ char *buffer = NULL;
+                size_t allocated = 0, size = 0;
+
+                r = output_export(&e, &buffer, &allocated, &size);
+                if (r < 0)
+                        return r;
+
+                fwrite(buffer, 1, size, f);
+                return 0;
+        }
+
+        return output_json(f, &e, mode, flags);
 }
 
 static int output_cat(
@@ -888,10 +985,10 @@ static int (*output_funcs[_OUTPUT_MODE_MAX])(
         [OUTPUT_SHORT_PRECISE] = output_short,
         [OUTPUT_SHORT_MONOTONIC] = output_short,
         [OUTPUT_VERBOSE] = output_verbose,
-        [OUTPUT_EXPORT] = output_export,
-        [OUTPUT_JSON] = output_json,
-        [OUTPUT_JSON_PRETTY] = output_json,
-        [OUTPUT_JSON_SSE] = output_json,
+        [OUTPUT_EXPORT] = output_detached,
+        [OUTPUT_JSON] = output_detached,
+        [OUTPUT_JSON_PRETTY] = output_detached,
+        [OUTPUT_JSON_SSE] = output_detached,
         [OUTPUT_CAT] = output_cat
 };
 
@@ -911,7 +1008,6 @@ int output_journal(
                 n_columns = columns();
 
         ret = output_funcs[mode](f, j, mode, n_columns, flags);
-        fflush(stdout);
 
         if (ellipsized && ret > 0)
                 *ellipsized = true;
@@ -919,6 +1015,315 @@ int output_journal(
         return ret;
 }
 
+#define OUTPUT_BATCH_SIZE 256
+
+/* Entries are copied with all their fields, which in export mode may
+ * be arbitrarily large, hence a batch is also closed once it holds
+ * this much field data. This bounds what is in flight to about this
+ * much per batch, plus the formatted output of it. */
+#define OUTPUT_BATCH_BYTES (1024*1024)
+
+typedef struct OutputBatch {
+        OutputEntry entries[OUTPUT_BATCH_SIZE];
+        unsigned n_entries;
+        size_t data_size;
+
+        /* Set once the entries have been formatted into buffer */
+        bool formatted;
+        char *buffer;
+        size_t size, allocated;
+        int r;
+} OutputBatch;
+
+struct OutputPipeline {
+        FILE *f;
+        OutputMode mode;
+        OutputFlags flags;
+
+        pthread_mutex_t mutex;
+        pthread_cond_t work_cond;
+        pthread_cond_t done_cond;
+        bool quit;
+
+        /* The batches form a ring, the counters are taken modulo
+         * n_batches to find the slot */
+        OutputBatch *batches;
+        unsigned n_batches;
+        unsigned n_filled, n_claimed, n_written;
+
+        pthread_t *threads;
+        unsigned n_threads;
+};
+
+bool output_pipeline_supported(OutputMode mode) {
+        return IN_SET(mode, OUTPUT_EXPORT, OUTPUT_JSON, OUTPUT_JSON_PRETTY, OUTPUT_JSON_SSE);
+}
+
+static int output_batch_format(OutputBatch *b, OutputMode mode, OutputFlags flags) {
+        FILE *f;
+        unsigned i;
+        int r = 0;
+
+        assert(b);
+
+        if (mode == OUTPUT_EXPORT) {
+                for (i = 0; i < b->n_entries; i++) {
+                        r = output_export(b->entries + i, &b->buffer, &b->allocated, &b->size);
+                        if (r < 0)
+                                break;
+                }
+
+                return r;
+        }
+
+        f = open_memstream(&b->buffer, &b->size);
+        if (!f)
+                return -errno;
+
+        for (i = 0; i < b->n_entries; i++) {
+                r = output_json(f, b->entries + i, mode, flags);
+                if (r < 0)
+                        break;
+        }
+
+        if (fclose(f) != 0 && r >= 0)
+                r = -errno;
+
+        return r;
+}
+
+static void *output_pipeline_thread(void *userdata) {
+        OutputPipeline *p = userdata;
+
+        for (;;) {
+                OutputBatch *b;
+
+                pthread_mutex_lock(&p->mutex);
+
+                while (p->n_claimed >= p->n_filled && !p->quit)
+                        pthread_cond_wait(&p->work_cond, &p->mutex);
+
+                if (p->quit) {
+                        pthread_mutex_unlock(&p->mutex);
+                        break;
+                }
+
+                b = p->batches + p->n_claimed++ % p->n_batches;
+                pthread_mutex_unlock(&p->mutex);
+
+                b->r = output_batch_format(b, p->mode, p->flags);
+
+                pthread_mutex_lock(&p->mutex);
+                b->formatted = true;
+                pthread_cond_signal(&p->done_cond);
+                pthread_mutex_unlock(&p->mutex);
+        }
+
+        return NULL;
+}
+
+int output_pipeline_new(OutputPipeline **ret, FILE *f, OutputMode mode, OutputFlags flags, unsigned n_threads) {
+        OutputPipeline *p;
+        unsigned i;
+
+        assert(ret);
+        assert(f);
+        assert(output_pipeline_supported(mode));
+
+        p = new0(OutputPipeline, 1);
+        if (!p)
+                return -ENOMEM;
+
+        p->f = f;
+        p->mode = mode;
+        p->flags = flags;
+
+        pthread_mutex_init(&p->mutex, NULL);
+        pthread_cond_init(&p->work_cond, NULL);
+        pthread_cond_init(&p->done_cond, NULL);
+
+        /* Two batches per thread, so that every thread has the next
+         * one queued while the oldest is written out */
+        p->n_batches = MAX(n_threads * 2, 1u);
+        p->batches = new0(OutputBatch, p->n_batches);
+        p->threads = new(pthread_t, MAX(n_threads, 1u));
+        if (!p->batches || !p->threads) {
+                output_pipeline_free(p);
+                return -ENOMEM;
+        }
+
+        /* If no thread can be started, the batches are simply
+         * formatted in the calling thread */
+        for (i = 0; i < n_threads; i++) {
+                int r;
+
+                r = pthread_create(p->threads + p->n_threads, NULL, output_pipeline_thread, p);
+                if (r != 0) {
+                        log_debug("Failed to start output thread: %s", strerror(r));
+                        break;
+                }
+
+                p->n_threads++;
+        }
+
+        *ret = p;
+        return 0;
+}
+
+static void output_pipeline_submit(OutputPipeline *p) {
+        OutputBatch *b;
+
+        assert(p);
+
+        /* If the ring is full the slot is still taken by the oldest
+         * pending batch, and nothing is being filled */
+        if (p->n_filled - p->n_written >= p->n_batches)
+                return;
+
+        b = p->batches + p->n_filled % p->n_batches;
+        if (b->n_entries <= 0)
+                return;
+
+        if (p->n_threads <= 0) {
+                b->r = output_batch_format(b, p->mode, p->flags);
+                b->formatted = true;
+
+                p->n_filled++;
+                p->n_claimed++;
+                return;
+        }
+
+        pthread_mutex_lock(&p->mutex);
+        p->n_filled++;
+        pthread_cond_signal(&p->work_cond);
+        pthread_mutex_unlock(&p->mutex);
+}
+
+static int output_pipeline_write_one(OutputPipeline *p) {
+        OutputBatch *b;
+        unsigned i;
+        int r;
+
+        assert(p);
+        assert(p->n_written < p->n_filled);
+
+        b = p->batches + p->n_written % p->n_batches;
+
+        pthread_mutex_lock(&p->mutex);
+        while (!b->formatted)
+                pthread_cond_wait(&p->done_cond, &p->mutex);
+        pthread_mutex_unlock(&p->mutex);
+
+        /* Whatever was formatted before a failure is written out,
+         * like it would be without batching */
+        if (b->size > 0)
+                fwrite(b->buffer, 1, b->size, p->f);
+
+        r = b->r;
+
+        /* Entry buffers are reused for the next batch, but don't
+         * hold on to the memory of exceptionally large entries */
+        for (i = 0; i < b->n_entries; i++)
+                if (b->entries[i].data_allocated > OUTPUT_BATCH_BYTES)
+                        output_entry_done(b->entries + i);
+
+        free(b->buffer);
+        b->buffer = NULL;
+        b->size = b->allocated = 0;
+        b->n_entries = 0;
+        b->data_size = 0;
+        b->formatted = false;
+        b->r = 0;
+
+        p->n_written++;
+
+        if (r < 0)
+                return r;
+
+        return ferror(p->f) ? -EIO : 0;
+}
+
+int output_pipeline_add(OutputPipeline *p, sd_journal *j) {
+        OutputBatch *b;
+        int r;
+
+        assert(p);
+        assert(j);
+
+        /* Make room in the ring first */
+        if (p->n_filled - p->n_written >= p->n_batches) {
+                r = output_pipeline_write_one(p);
+                if (r < 0)
+                        return r;
+        }
+
+        b = p->batches + p->n_filled % p->n_batches;
+
+        r = output_entry_read(b->entries + b->n_entries, j, p->mode, p->flags);
+        if (r < 0)
+                return r;
+
+        b->data_size += b->entries[b->n_entries].data_size;
+        b->n_entries++;
+
+        if (b->n_entries >= OUTPUT_BATCH_SIZE ||
+            b->data_size >= OUTPUT_BATCH_BYTES)
+                output_pipeline_submit(p);
+
+        return 0;
+}
+
+int output_pipeline_flush(OutputPipeline *p) {
+        int r = 0;
+
+        assert(p);
+
+        output_pipeline_submit(p);
+
+        while (p->n_written < p->n_filled) {
+                int k;
+
+                k = output_pipeline_write_one(p);
+                if (k < 0 && r >= 0)
+                        r = k;
+        }
+
+        fflush(p->f);
+
+        return r;
+}
+
+void output_pipeline_free(OutputPipeline *p) {
+        unsigned i, k;
+
+        if (!p)
+                return;
+
+        pthread_mutex_lock(&p->mutex);
+        p->quit = true;
+        pthread_cond_broadcast(&p->work_cond);
+        pthread_mutex_unlock(&p->mutex);
+
+        for (i = 0; i < p->n_threads; i++)
+                pthread_join(p->threads[i], NULL);
+
+        pthread_cond_destroy(&p->done_cond);
+        pthread_cond_destroy(&p->work_cond);
+        pthread_mutex_destroy(&p->mutex);
+
+        if (p->batches)
+                for (i = 0; i < p->n_batches; i++) {
+                        for (k = 0; k < OUTPUT_BATCH_SIZE; k++)
+                                output_entry_done(p->batches[i].entries + k);
+
+                        free(p->batches[i].buffer);
+                }
+
+        free(p->batches);
+        free(p->threads);
+        free(p);
+}
+
 static int show_journal(FILE *f,
                         sd_journal *j,
                         OutputMode mode,
@@ -38,6 +38,20 @@ int output_journal(
                 OutputFlags flags,
                 bool *ellipsized);
 
+/* Appends the current entry in export format to a growing buffer */
+int output_export_append(sd_journal *j, char **buffer, size_t *allocated, size_t *size);
+
+/* Formats entries on a pool of threads, in batches that are written
+ * out in order. Only modes that don't need anything but the fields of
+ * an entry are supported. */
+typedef struct OutputPipeline OutputPipeline;
+
+bool output_pipeline_supported(OutputMode mode) _const_;
+int output_pipeline_new(OutputPipeline **ret, FILE *f, OutputMode mode, OutputFlags flags, unsigned n_threads);
+int output_pipeline_add(OutputPipeline *p, sd_journal *j);
+int output_pipeline_flush(OutputPipeline *p);
+void output_pipeline_free(OutputPipeline *p);
+
 int add_match_this_boot(sd_journal *j);
 
 int add_matches_for_unit(
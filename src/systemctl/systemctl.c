@@ -746,49 +746,132 @@ static int list_sockets(sd_bus *bus, char **args) {
         return r;
 }
 
-static int get_next_elapse(
+static int get_timer_properties(
                 sd_bus *bus,
-                const char *path,
-                dual_timestamp *next) {
-
-        _cleanup_bus_error_free_ sd_bus_error error = SD_BUS_ERROR_NULL;
-        dual_timestamp t;
+                const UnitInfo *timers[],
+                unsigned n,
+                char **triggered[],
+                dual_timestamp next[]) {
+
+        static const char* const properties[] = {
+                "org.freedesktop.systemd1.Unit", "Triggers",
+                "org.freedesktop.systemd1.Timer", "NextElapseUSecMonotonic",
+                "org.freedesktop.systemd1.Timer", "NextElapseUSecRealtime",
+        };
+        const unsigned n_properties = ELEMENTSOF(properties) / 2;
+        sd_bus_message **calls = NULL, **replies = NULL;
+        sd_bus_error *errors = NULL;
+        unsigned i, j;
         int r;
 
         assert(bus);
-        assert(path);
-        assert(next);
+        assert(timers || n == 0);
+        assert(triggered || n == 0);
+        assert(next || n == 0);
+
+        calls = new0(sd_bus_message*, n * n_properties);
+        replies = new0(sd_bus_message*, n * n_properties);
+        errors = new0(sd_bus_error, n * n_properties);
+        if (!calls || !replies || !errors) {
+                r = log_oom();
+                goto finish;
+        }
 
-        r = sd_bus_get_property_trivial(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.systemd1.Timer",
-                        "NextElapseUSecMonotonic",
-                        &error,
-                        't',
-                        &t.monotonic);
+        for (i = 0; i < n; i++)
+                for (j = 0; j < n_properties; j++) {
+                        sd_bus_message **m = calls + i * n_properties + j;
+
+                        r = sd_bus_message_new_method_call(
+                                        bus,
+                                        "org.freedesktop.systemd1",
+                                        timers[i]->unit_path,
+                                        "org.freedesktop.DBus.Properties",
+                                        "Get",
+                                        m);
+                        if (r < 0) {
+                                r = bus_log_create_error(r);
+                                goto finish;
+                        }
+
+                        r = sd_bus_message_append(*m, "ss", properties[j*2], properties[j*2+1]);
+                        if (r < 0) {
+                                r = bus_log_create_error(r);
+                                goto finish;
+                        }
+                }
+
+        /* Issue the calls for all timers at once, instead of one
+         * round trip per property */
+        r = sd_bus_call_batch(bus, calls, n * n_properties, 0, errors, replies);
         if (r < 0) {
-                log_error("Failed to get next elapsation time: %s", bus_error_message(&error, r));
-                return r;
+                log_error("Failed to query timers: %s", strerror(-r));
+                goto finish;
         }
 
-        r = sd_bus_get_property_trivial(
-                        bus,
-                        "org.freedesktop.systemd1",
-                        path,
-                        "org.freedesktop.systemd1.Timer",
-                        "NextElapseUSecRealtime",
-                        &error,
-                        't',
-                        &t.realtime);
-        if (r < 0) {
-                log_error("Failed to get next elapsation time: %s", bus_error_message(&error, r));
-                return r;
+        for (i = 0; i < n; i++) {
+                sd_bus_message **reply = replies + i * n_properties;
+                sd_bus_error *error = errors + i * n_properties;
+
+                if (reply[0]) {
+                        r = sd_bus_message_enter_container(reply[0], SD_BUS_TYPE_VARIANT, "as");
+                        if (r < 0) {
+                                r = bus_log_parse_error(r);
+                                goto finish;
+                        }
+
+                        r = sd_bus_message_read_strv(reply[0], &triggered[i]);
+                        if (r < 0) {
+                                r = bus_log_parse_error(r);
+                                goto finish;
+                        }
+                } else {
+                        /* Like get_triggered_units(), a timer whose
+                         * triggers can't be read is listed without
+                         * them */
+                        r = sd_bus_error_get_errno(&error[0]);
+                        log_error("Failed to determine triggers: %s", bus_error_message(&error[0], r > 0 ? -r : -EIO));
+                }
+
+                for (j = 1; j < n_properties; j++) {
+                        if (!reply[j]) {
+                                r = sd_bus_error_get_errno(&error[j]);
+                                r = r > 0 ? -r : -EIO;
+
+                                log_error("Failed to get next elapsation time: %s", bus_error_message(&error[j], r));
+                                goto finish;
+                        }
+
+                        r = sd_bus_message_read(reply[j], "v", "t", j == 1 ? &next[i].monotonic : &next[i].realtime);
+                        if (r < 0) {
+                                r = bus_log_parse_error(r);
+                                goto finish;
+                        }
+                }
         }
 
-        *next = t;
-        return 0;
+        r = 0;
+
+finish:
+        for (i = 0; i < n * n_properties; i++) {
+                if (calls)
+                        sd_bus_message_unref(calls[i]);
+                if (replies)
+                        sd_bus_message_unref(replies[i]);
+                if (errors)
+                        sd_bus_error_free(&errors[i]);
+        }
+
+        free(calls);
+        free(replies);
+        free(errors);
+
+        if (r < 0)
+                for (i = 0; i < n; i++) {
+                        strv_free(triggered[i]);
+                        triggered[i] = NULL;
+                }
+
+        return r;
 }
 
 struct timer_info {
@@ -889,10 +972,12 @@ static int list_timers(sd_bus *bus, char **args) {
         _cleanup_bus_message_unref_ sd_bus_message *reply = NULL;
         _cleanup_free_ struct timer_info *timer_infos = NULL;
         _cleanup_free_ UnitInfo *unit_infos = NULL;
+        _cleanup_free_ const UnitInfo **timers = NULL;
+        _cleanup_free_ dual_timestamp *next = NULL;
+        _cleanup_free_ char ***triggered = NULL;
         struct timer_info *t;
         const UnitInfo *u;
-        size_t size = 0;
-        int n, c = 0;
+        int n, i, c = 0;
         dual_timestamp nw;
         int r = 0;
 
@@ -902,54 +987,55 @@ static int list_timers(sd_bus *bus, char **args) {
         if (n < 0)
                 return n;
 
-        dual_timestamp_get(&nw);
+        timers = new(const UnitInfo*, n);
+        if (!timers)
+                return log_oom();
 
         for (u = unit_infos; u < unit_infos + n; u++) {
-                _cleanup_strv_free_ char **triggered = NULL;
-                dual_timestamp next;
-                usec_t m;
-
                 if (!output_show_unit(u))
                         continue;
 
                 if (!endswith(u->id, ".timer"))
                         continue;
 
-                r = get_triggered_units(bus, u->unit_path, &triggered);
-                if (r < 0)
-                        goto cleanup;
+                timers[c++] = u;
+        }
 
-                r = get_next_elapse(bus, u->unit_path, &next);
-                if (r < 0)
-                        goto cleanup;
+        timer_infos = new0(struct timer_info, c);
+        next = new0(dual_timestamp, c);
+        triggered = new0(char**, c);
+        if (!timer_infos || !next || !triggered)
+                return log_oom();
+
+        r = get_timer_properties(bus, timers, c, triggered, next);
+        if (r < 0)
+                return r;
+
+        dual_timestamp_get(&nw);
 
-                if (next.monotonic != (usec_t) -1 && next.monotonic > 0) {
+        for (i = 0; i < c; i++) {
+                usec_t m;
+
+                if (next[i].monotonic != (usec_t) -1 && next[i].monotonic > 0) {
                         usec_t converted;
 
-                        if (next.monotonic > nw.monotonic)
-                                converted = nw.realtime + (next.monotonic - nw.monotonic);
+                        if (next[i].monotonic > nw.monotonic)
+                                converted = nw.realtime + (next[i].monotonic - nw.monotonic);
                         else
-                                converted = nw.realtime - (nw.monotonic - next.monotonic);
+                                converted = nw.realtime - (nw.monotonic - next[i].monotonic);
 
-                        if (next.realtime != (usec_t) -1 && next.realtime > 0)
-                                m = MIN(converted, next.realtime);
+                        if (next[i].realtime != (usec_t) -1 && next[i].realtime > 0)
+                                m = MIN(converted, next[i].realtime);
                         else
                                 m = converted;
                 } else
-                        m = next.realtime;
+                        m = next[i].realtime;
 
-                if (!GREEDY_REALLOC(timer_infos, size, c+1)) {
-                        r = log_oom();
-                        goto cleanup;
-                }
-
-                timer_infos[c++] = (struct timer_info) {
-                        .id = u->id,
+                timer_infos[i] = (struct timer_info) {
+                        .id = timers[i]->id,
                         .next_elapse = m,
-                        .triggered = triggered,
+                        .triggered = triggered[i],
                 };
-
-                triggered = NULL; /* avoid cleanup */
         }
 
         qsort_safe(timer_infos, c, sizeof(struct timer_info),
@@ -957,7 +1043,6 @@ static int list_timers(sd_bus *bus, char **args) {
 
         output_timers_list(timer_infos, c);
 
- cleanup:
         for (t = timer_infos; t < timer_infos + c; t++)
                 strv_free(t->triggered);
 
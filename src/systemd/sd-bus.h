@@ -123,6 +123,7 @@ int sd_bus_send_to(sd_bus *bus, sd_bus_message *m, const char *destination, uint
 int sd_bus_call(sd_bus *bus, sd_bus_message *m, uint64_t usec, sd_bus_error *ret_error, sd_bus_message **reply);
 int sd_bus_call_async(sd_bus *bus, sd_bus_message *m, sd_bus_message_handler_t callback, void *userdata, uint64_t usec, uint64_t *serial);
 int sd_bus_call_async_cancel(sd_bus *bus, uint64_t serial);
+int sd_bus_call_batch(sd_bus *bus, sd_bus_message *m[], unsigned n, uint64_t usec, sd_bus_error ret_error[], sd_bus_message *reply[]);
 
 int sd_bus_get_fd(sd_bus *bus);
 int sd_bus_get_events(sd_bus *bus);
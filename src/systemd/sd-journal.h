@@ -122,6 +122,7 @@ int sd_journal_get_cutoff_realtime_usec(sd_journal *j, uint64_t *from, uint64_t
 int sd_journal_get_cutoff_monotonic_usec(sd_journal *j, const sd_id128_t boot_id, uint64_t *from, uint64_t *to);
 
 int sd_journal_get_usage(sd_journal *j, uint64_t *bytes);
+int sd_journal_get_mmap_cache_statistics(sd_journal *j, uint64_t *hit, uint64_t *missed, uint64_t *sequential);
 
 int sd_journal_query_unique(sd_journal *j, const char *field);
 int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_t *l);